@@ -0,0 +1,137 @@
+;
+;Copyright 2026 Jay Sorg
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to ABGR
+;amd64 AVX2
+;
+
+%include "common.asm"
+
+PREPARE_RODATA
+cshuf db 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+      db 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+; s8 and d8 do not need to be aligned
+;int
+;a8r8g8b8_to_a8b8g8r8_box_amd64_avx2(const char *s8, int src_stride,
+;                                    char *d8, int dst_stride,
+;                                    int width, int height);
+PROC a8r8g8b8_to_a8b8g8r8_box_amd64_avx2
+    push rbx
+    push rbp
+
+    vmovdqu ymm4, [lsym(cshuf)]
+
+    ; local vars
+    ; long src_stride
+    ; long dst_stride
+    ; long width
+    ; long height
+    ; const char* src
+    ; char* dst
+    sub rsp, 48         ; local vars, 48 bytes
+
+    mov [rsp + 0], rsi   ; src_stride
+    mov [rsp + 8], rcx   ; dst_stride
+    mov [rsp + 16], r8   ; width
+    mov [rsp + 24], r9   ; height
+    mov [rsp + 32], rdi  ; src
+    mov [rsp + 40], rdx  ; dst
+
+    mov rsi, rdi         ; src
+    mov rdi, rdx         ; dst
+
+loop_y:
+    mov rcx, [rsp + 16]  ; width
+
+; A R G B A R G B A R G B A R G B to
+; A B G R A B G R A B G R A B G R
+
+loop_x16:
+    cmp rcx, 16
+    jl done_loop_x16
+
+    vmovdqu ymm0, [rsi]
+    vmovdqu ymm1, [rsi + 32]
+    lea rsi, [rsi + 64]
+    vpshufb ymm0, ymm0, ymm4
+    vpshufb ymm1, ymm1, ymm4
+    vmovdqu [rdi], ymm0
+    vmovdqu [rdi + 32], ymm1
+    lea rdi, [rdi + 64]
+    sub rcx, 16
+
+    jmp loop_x16
+done_loop_x16:
+
+    cmp rcx, 8
+    jl done_loop_x8
+
+    vmovdqu ymm0, [rsi]
+    lea rsi, [rsi + 32]
+    vpshufb ymm0, ymm0, ymm4
+    vmovdqu [rdi], ymm0
+    lea rdi, [rdi + 32]
+    sub rcx, 8
+done_loop_x8:
+
+loop_x:
+    cmp rcx, 1
+    jl done_loop_x
+    mov eax, [rsi]
+    lea rsi, [rsi + 4]
+    mov edx, eax         ; a and g
+    and edx, 0xFF00FF00
+    mov ebx, eax         ; r
+    and ebx, 0x00FF0000
+    shr ebx, 16
+    or edx, ebx
+    mov ebx, eax         ; b
+    and ebx, 0x000000FF
+    shl ebx, 16
+    or edx, ebx
+    mov [rdi], edx
+    lea rdi, [rdi + 4]
+    dec rcx
+    jmp loop_x
+done_loop_x:
+
+    mov rsi, [rsp + 32] ; src
+    add rsi, [rsp + 0]  ; src_stride
+    mov [rsp + 32], rsi
+
+    mov rdi, [rsp + 40] ; dst
+    add rdi, [rsp + 8]  ; dst_stride
+    mov [rsp + 40], rdi
+
+    mov rcx, [rsp + 24] ; height
+    dec rcx
+    mov [rsp + 24], rcx
+    jnz loop_y
+
+    vzeroupper
+    mov eax, 0          ; return value
+    add rsp, 48
+    pop rbp
+    pop rbx
+    ret
+END_OF_FILE
@@ -0,0 +1,259 @@
+;
+;Copyright 2026 Jay Sorg
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to NV12
+;amd64 AVX2
+;
+; notes
+;   same math as the SSE2 version, 16 pixels per iteration
+;   width should be multiple of 8 and > 0
+;   height should be even and > 0
+
+%include "common.asm"
+
+PREPARE_RODATA
+    cd255  times 8 dd 255
+    cd2    times 8 dd 2
+
+    cw1    times 16 dw 1
+    cw16   times 16 dw 16
+    cw128  times 16 dw 128
+    cw66   times 16 dw 66
+    cw129  times 16 dw 129
+    cw25   times 16 dw 25
+    cw38   times 16 dw 38
+    cw74   times 16 dw 74
+    cw112  times 16 dw 112
+    cw94   times 16 dw 94
+    cw18   times 16 dw 18
+
+%define LS8            [rsp +   0] ; s8
+%define LSRC_STRIDE    [rsp +   8] ; src_stride
+%define LD8_Y          [rsp +  16] ; d8_y
+%define LDST_Y_STRIDE  [rsp +  24] ; dst_stride_y
+%define LD8_UV         [rsp +  32] ; d8_uv
+%define LDST_UV_STRIDE [rsp +  40] ; dst_stride_uv
+
+%define LWIDTH         [rsp + 104] ; width
+%define LHEIGHT        [rsp + 112] ; height
+
+; one line, 16 pixels
+; in  ymm0 pixels 0 to 7, ymm1 pixels 8 to 15
+;     ymm14 cw128, ymm15 cd255
+; out xmm5 16 bytes yyyyyyyyyyyyyyyy
+;     ymm8 16 u words, ymm9 16 v words
+do16_line:
+    vpand ymm2, ymm0, ymm15      ; blue
+    vpand ymm3, ymm1, ymm15      ; blue
+    vpackssdw ymm2, ymm2, ymm3   ; ymm2 = 16 blues
+    vpermq ymm2, ymm2, 0xD8      ; pack works within 128 bit lanes
+
+    vpsrld ymm3, ymm0, 8         ; green
+    vpand ymm3, ymm3, ymm15      ; green
+    vpsrld ymm4, ymm1, 8         ; green
+    vpand ymm4, ymm4, ymm15      ; green
+    vpackssdw ymm3, ymm3, ymm4   ; ymm3 = 16 greens
+    vpermq ymm3, ymm3, 0xD8
+
+    vpsrld ymm4, ymm0, 16        ; red
+    vpand ymm4, ymm4, ymm15      ; red
+    vpsrld ymm5, ymm1, 16        ; red
+    vpand ymm5, ymm5, ymm15      ; red
+    vpackssdw ymm4, ymm4, ymm5   ; ymm4 = 16 reds
+    vpermq ymm4, ymm4, 0xD8
+
+    ; _Y = (( 66 * _R + 129 * _G +  25 * _B + 128) >> 8) +  16;
+    vpmullw ymm5, ymm2, [lsym(cw25)]
+    vpmullw ymm6, ymm3, [lsym(cw129)]
+    vpaddw ymm5, ymm5, ymm6
+    vpmullw ymm6, ymm4, [lsym(cw66)]
+    vpaddw ymm5, ymm5, ymm6
+    vpaddw ymm5, ymm5, ymm14
+    vpsrlw ymm5, ymm5, 8
+    vpaddw ymm5, ymm5, [lsym(cw16)]
+    vpackuswb ymm5, ymm5, ymm5
+    vpermq ymm5, ymm5, 0x08
+
+    ; _U = ((-38 * _R -  74 * _G + 112 * _B + 128) >> 8) + 128;
+    vpmullw ymm8, ymm2, [lsym(cw112)]
+    vpmullw ymm6, ymm3, [lsym(cw74)]
+    vpsubw ymm8, ymm8, ymm6
+    vpmullw ymm6, ymm4, [lsym(cw38)]
+    vpsubw ymm8, ymm8, ymm6
+    vpaddw ymm8, ymm8, ymm14
+    vpsraw ymm8, ymm8, 8
+    vpaddw ymm8, ymm8, ymm14
+
+    ; _V = ((112 * _R -  94 * _G -  18 * _B + 128) >> 8) + 128;
+    vpmullw ymm9, ymm4, [lsym(cw112)]
+    vpmullw ymm6, ymm3, [lsym(cw94)]
+    vpsubw ymm9, ymm9, ymm6
+    vpmullw ymm6, ymm2, [lsym(cw18)]
+    vpsubw ymm9, ymm9, ymm6
+    vpaddw ymm9, ymm9, ymm14
+    vpsraw ymm9, ymm9, 8
+    vpaddw ymm9, ymm9, ymm14
+
+    ret
+
+; uv add and divide(average)
+; in  ymm10 u, ymm11 v from first line
+;     ymm8 u, ymm9 v from second line
+; out xmm8 16 bytes uvuvuvuvuvuvuvuv
+do16_uv:
+    vpaddw ymm8, ymm8, ymm10     ; add lines
+    vpmaddwd ymm8, ymm8, [lsym(cw1)] ; add pairs
+    vpaddd ymm8, ymm8, [lsym(cd2)] ; add 2
+    vpsrld ymm8, ymm8, 2         ; div 4
+
+    vpaddw ymm9, ymm9, ymm11     ; add lines
+    vpmaddwd ymm9, ymm9, [lsym(cw1)] ; add pairs
+    vpaddd ymm9, ymm9, [lsym(cd2)] ; add 2
+    vpsrld ymm9, ymm9, 2         ; div 4
+
+    vpslld ymm9, ymm9, 16
+    vpor ymm8, ymm8, ymm9        ; uv
+    vpackuswb ymm8, ymm8, ymm8
+    vpermq ymm8, ymm8, 0x08
+
+    ret
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+;int
+;a8r8g8b8_to_nv12_box_amd64_avx2(const char *s8, int src_stride,
+;                                char *d8_y, int dst_stride_y,
+;                                char *d8_uv, int dst_stride_uv,
+;                                int width, int height);
+PROC a8r8g8b8_to_nv12_box_amd64_avx2
+    push rbx
+    push rbp
+    sub rsp, 80                ; local vars, 80 bytes
+
+    mov LS8, rdi               ; s8
+    mov LSRC_STRIDE, rsi       ; src_stride
+    mov LD8_Y, rdx             ; d8_y
+    mov LDST_Y_STRIDE, rcx     ; dst_stride_y
+    mov LD8_UV, r8             ; d8_uv
+    mov LDST_UV_STRIDE, r9     ; dst_stride_uv
+
+    vmovdqu ymm14, [lsym(cw128)]
+    vmovdqu ymm15, [lsym(cd255)]
+
+    mov ebx, LHEIGHT           ; ebx = height
+    shr ebx, 1                 ; doing 2 lines at a time
+
+row_loop1:
+    mov rsi, LS8               ; s8
+    mov rdi, LD8_Y             ; d8_y
+    mov rdx, LD8_UV            ; d8_uv
+
+    mov ecx, LWIDTH            ; ecx = width
+    shr ecx, 4                 ; doing 16 pixels at a time
+    jz loop1_8
+
+loop1:
+    ; first line
+    vmovdqu ymm0, [rsi]        ; 8 pixels, 32 bytes
+    vmovdqu ymm1, [rsi + 32]   ; 8 pixels, 32 bytes
+    call do16_line
+    vmovdqu [rdi], xmm5        ; out 16 bytes yyyyyyyyyyyyyyyy
+    vmovdqa ymm10, ymm8        ; save for later
+    vmovdqa ymm11, ymm9        ; save for later
+
+    ; go down to second line
+    add rsi, LSRC_STRIDE
+    add rdi, LDST_Y_STRIDE
+
+    ; second line
+    vmovdqu ymm0, [rsi]        ; 8 pixels, 32 bytes
+    vmovdqu ymm1, [rsi + 32]   ; 8 pixels, 32 bytes
+    call do16_line
+    vmovdqu [rdi], xmm5        ; out 16 bytes yyyyyyyyyyyyyyyy
+
+    call do16_uv
+    vmovdqu [rdx], xmm8        ; out 16 bytes uvuvuvuvuvuvuvuv
+
+    ; go up to first line
+    sub rsi, LSRC_STRIDE
+    sub rdi, LDST_Y_STRIDE
+
+    ; move right
+    lea rsi, [rsi + 64]
+    lea rdi, [rdi + 16]
+    lea rdx, [rdx + 16]
+
+    dec ecx
+    jnz loop1
+
+loop1_8:
+    mov eax, LWIDTH
+    test eax, 8
+    jz loop1_done
+
+    ; first line, 8 pixels left
+    vmovdqu ymm0, [rsi]        ; 8 pixels, 32 bytes
+    vpxor ymm1, ymm1, ymm1
+    call do16_line
+    vmovq [rdi], xmm5          ; out 8 bytes yyyyyyyy
+    vmovdqa ymm10, ymm8        ; save for later
+    vmovdqa ymm11, ymm9        ; save for later
+
+    ; go down to second line
+    add rsi, LSRC_STRIDE
+    add rdi, LDST_Y_STRIDE
+
+    ; second line, 8 pixels left
+    vmovdqu ymm0, [rsi]        ; 8 pixels, 32 bytes
+    vpxor ymm1, ymm1, ymm1
+    call do16_line
+    vmovq [rdi], xmm5          ; out 8 bytes yyyyyyyy
+
+    call do16_uv
+    vmovq [rdx], xmm8          ; out 8 bytes uvuvuvuv
+
+loop1_done:
+    ; update s8
+    mov rax, LS8               ; s8
+    add rax, LSRC_STRIDE       ; s8 += src_stride
+    add rax, LSRC_STRIDE       ; s8 += src_stride
+    mov LS8, rax
+
+    ; update d8_y
+    mov rax, LD8_Y             ; d8_y
+    add rax, LDST_Y_STRIDE     ; d8_y += dst_stride_y
+    add rax, LDST_Y_STRIDE     ; d8_y += dst_stride_y
+    mov LD8_Y, rax
+
+    ; update d8_uv
+    mov rax, LD8_UV            ; d8_uv
+    add rax, LDST_UV_STRIDE    ; d8_uv += dst_stride_uv
+    mov LD8_UV, rax
+
+    dec ebx
+    jnz row_loop1
+
+    vzeroupper
+    mov rax, 0                 ; return value
+    add rsp, 80                ; local vars, 80 bytes
+    pop rbp
+    pop rbx
+    ret
+END_OF_FILE
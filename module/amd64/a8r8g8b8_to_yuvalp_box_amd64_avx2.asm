@@ -0,0 +1,229 @@
+;
+;Copyright 2026 Jay Sorg
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to 64x64 linear planar YUVA
+;amd64 AVX2
+;
+; y = (r *  19595 + g *  38470 + b *   7471) >> 16
+; u = (r * -11071 + g * -21736 + b *  32807) >> 16 + 128
+; v = (r *  32756 + g * -27429 + b *  -5327) >> 16 + 128
+;
+; 38470 and 32807 do not fit vpmaddwd's signed words so they are
+; done as (c - 65536) and the missing (g << 16) or (b << 16) added back
+;
+; notes
+;   d8 points into the y plane, u, v and a planes follow every 64 * 64 bytes
+;   any width and height
+
+%include "common.asm"
+
+PREPARE_RODATA
+    cwy    times 4 dw   7471, -27066,  19595, 0 ; b g r a
+    cwu    times 4 dw -32729, -21736, -11071, 0 ; b g r a
+    cwv    times 4 dw  -5327, -27429,  32756, 0 ; b g r a
+    cd255  times 8 dd 255
+    cd128  times 8 dd 128
+    cperm  dd 0, 4, 1, 5, 2, 6, 3, 7
+
+%define LTMP_IN        [rsp +   0] ; 16 pixels, for the right edge
+%define LTMP_OUT       [rsp +  64] ; 16 bytes per plane, for the right edge
+%define LS8            [rsp + 128] ; s8
+%define LSRC_STRIDE    [rsp + 136] ; src_stride
+%define LD8            [rsp + 144] ; d8
+%define LDST_STRIDE    [rsp + 152] ; dst_stride
+%define LWIDTH         [rsp + 160] ; width
+%define LHEIGHT        [rsp + 168] ; height
+
+; in  ymm0 8 pixels, ymm7 zero
+; out ymm1 y, ymm2 u, ymm3 v, ymm4 a as dwords
+; unpack and shuffle work within 128 bit lanes so the dword results
+; come out in pixel order
+do8:
+    vpunpcklbw ymm5, ymm0, ymm7 ; pixels 0, 1, 4 and 5, b g r a words
+    vpunpckhbw ymm6, ymm0, ymm7 ; pixels 2, 3, 6 and 7, b g r a words
+
+    ; y
+    vpmaddwd ymm1, ymm5, [lsym(cwy)]
+    vpmaddwd ymm8, ymm6, [lsym(cwy)]
+    vshufps ymm9, ymm1, ymm8, 0xDD ; r a sums
+    vshufps ymm1, ymm1, ymm8, 0x88 ; b g sums
+    vpaddd ymm1, ymm1, ymm9
+    vpsrld ymm9, ymm0, 8       ; g << 16
+    vpand ymm9, ymm9, [lsym(cd255)]
+    vpslld ymm9, ymm9, 16
+    vpaddd ymm1, ymm1, ymm9
+    vpsrad ymm1, ymm1, 16
+
+    ; u
+    vpmaddwd ymm2, ymm5, [lsym(cwu)]
+    vpmaddwd ymm8, ymm6, [lsym(cwu)]
+    vshufps ymm9, ymm2, ymm8, 0xDD ; r a sums
+    vshufps ymm2, ymm2, ymm8, 0x88 ; b g sums
+    vpaddd ymm2, ymm2, ymm9
+    vpand ymm9, ymm0, [lsym(cd255)] ; b << 16
+    vpslld ymm9, ymm9, 16
+    vpaddd ymm2, ymm2, ymm9
+    vpsrad ymm2, ymm2, 16
+    vpaddd ymm2, ymm2, [lsym(cd128)]
+
+    ; v
+    vpmaddwd ymm3, ymm5, [lsym(cwv)]
+    vpmaddwd ymm8, ymm6, [lsym(cwv)]
+    vshufps ymm9, ymm3, ymm8, 0xDD ; r a sums
+    vshufps ymm3, ymm3, ymm8, 0x88 ; b g sums
+    vpaddd ymm3, ymm3, ymm9
+    vpsrad ymm3, ymm3, 16
+    vpaddd ymm3, ymm3, [lsym(cd128)]
+
+    ; a
+    vpsrld ymm4, ymm0, 24
+
+    ret
+
+; in  rsi 16 pixels, ymm14 cperm
+;     rdi y out, r8 plane size, r9 3 * plane size
+do16:
+    vmovdqu ymm0, [rsi]
+    call do8
+    vmovdqa ymm10, ymm1
+    vmovdqa ymm11, ymm2
+    vmovdqa ymm12, ymm3
+    vmovdqa ymm13, ymm4
+
+    vmovdqu ymm0, [rsi + 32]
+    call do8
+
+    ; pack clamps to 0 - 255, it works within 128 bit lanes so
+    ; vpermd puts the dwords back in order
+    vpackssdw ymm10, ymm10, ymm1 ; y
+    vpackssdw ymm11, ymm11, ymm2 ; u
+    vpackuswb ymm10, ymm10, ymm11
+    vpermd ymm10, ymm14, ymm10
+    vmovdqu [rdi], xmm10       ; out 16 bytes y
+    vextracti128 [rdi + r8], ymm10, 1 ; out 16 bytes u
+    vpackssdw ymm12, ymm12, ymm3 ; v
+    vpackssdw ymm13, ymm13, ymm4 ; a
+    vpackuswb ymm12, ymm12, ymm13
+    vpermd ymm12, ymm14, ymm12
+    vmovdqu [rdi + r8 * 2], xmm12 ; out 16 bytes v
+    vextracti128 [rdi + r9], ymm12, 1 ; out 16 bytes a
+
+    lea rsi, [rsi + 64]
+    lea rdi, [rdi + 16]
+    ret
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+;int
+;a8r8g8b8_to_yuvalp_box_amd64_avx2(const char *s8, int src_stride,
+;                                  char *d8, int dst_stride,
+;                                  int width, int height);
+PROC a8r8g8b8_to_yuvalp_box_amd64_avx2
+    push rbx
+    push rbp
+    sub rsp, 176               ; local vars, 176 bytes
+
+    mov LS8, rdi               ; s8
+    movsxd rsi, esi
+    mov LSRC_STRIDE, rsi       ; src_stride
+    mov LD8, rdx               ; d8
+    movsxd rcx, ecx
+    mov LDST_STRIDE, rcx       ; dst_stride
+    mov LWIDTH, r8             ; width
+    mov LHEIGHT, r9            ; height
+
+    vpxor ymm7, ymm7, ymm7
+    vmovdqu ymm14, [lsym(cperm)]
+
+    mov ebx, LHEIGHT           ; ebx = height
+    cmp ebx, 0
+    jle done
+
+row_loop:
+    mov rsi, LS8               ; s8
+    mov rdi, LD8               ; d8
+    mov r8, 4096               ; 64 * 64
+    lea r9, [r8 + r8 * 2]
+
+    mov ecx, LWIDTH            ; ecx = width
+
+loop16:
+    cmp ecx, 16
+    jl loop16_done
+    call do16
+    sub ecx, 16
+    jmp loop16
+loop16_done:
+
+    cmp ecx, 0
+    jle row_done
+
+    ; right edge, less than 16 pixels left, go through LTMP_IN and LTMP_OUT
+    xor eax, eax
+tmp_in:
+    mov edx, [rsi + rax * 4]
+    mov [rsp + rax * 4], edx   ; LTMP_IN
+    inc eax
+    cmp eax, ecx
+    jl tmp_in
+
+    mov rbp, rdi               ; save d8
+    lea rsi, LTMP_IN
+    lea rdi, LTMP_OUT
+    mov r8, 16
+    lea r9, [r8 + r8 * 2]
+    call do16
+
+    xor eax, eax
+tmp_out:
+    mov dl, [rsp + rax + 64]   ; LTMP_OUT y
+    mov [rbp + rax], dl
+    mov dl, [rsp + rax + 80]   ; LTMP_OUT u
+    mov [rbp + rax + 4096], dl
+    mov dl, [rsp + rax + 96]   ; LTMP_OUT v
+    mov [rbp + rax + 8192], dl
+    mov dl, [rsp + rax + 112]  ; LTMP_OUT a
+    mov [rbp + rax + 12288], dl
+    inc eax
+    cmp eax, ecx
+    jl tmp_out
+
+row_done:
+    ; update s8
+    mov rax, LS8               ; s8
+    add rax, LSRC_STRIDE       ; s8 += src_stride
+    mov LS8, rax
+
+    ; update d8
+    mov rax, LD8               ; d8
+    add rax, LDST_STRIDE       ; d8 += dst_stride
+    mov LD8, rax
+
+    dec ebx
+    jnz row_loop
+
+done:
+    vzeroupper
+    mov rax, 0                 ; return value
+    add rsp, 176               ; local vars, 176 bytes
+    pop rbp
+    pop rbx
+    ret
+END_OF_FILE
@@ -0,0 +1,237 @@
+;
+;Copyright 2026 Jay Sorg
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;ARGB to 64x64 linear planar YUVA
+;amd64 SSE2
+;
+; y = (r *  19595 + g *  38470 + b *   7471) >> 16
+; u = (r * -11071 + g * -21736 + b *  32807) >> 16 + 128
+; v = (r *  32756 + g * -27429 + b *  -5327) >> 16 + 128
+;
+; 38470 and 32807 do not fit pmaddwd's signed words so they are
+; done as (c - 65536) and the missing (g << 16) or (b << 16) added back
+;
+; notes
+;   d8 points into the y plane, u, v and a planes follow every 64 * 64 bytes
+;   any width and height
+
+%include "common.asm"
+
+PREPARE_RODATA
+    cwy    times 2 dw   7471, -27066,  19595, 0 ; b g r a
+    cwu    times 2 dw -32729, -21736, -11071, 0 ; b g r a
+    cwv    times 2 dw  -5327, -27429,  32756, 0 ; b g r a
+    cd255  times 4 dd 255
+    cd128  times 4 dd 128
+
+%define LTMP_IN        [rsp +   0] ; 16 pixels, for the right edge
+%define LTMP_OUT       [rsp +  64] ; 16 bytes per plane, for the right edge
+%define LS8            [rsp + 128] ; s8
+%define LSRC_STRIDE    [rsp + 136] ; src_stride
+%define LD8            [rsp + 144] ; d8
+%define LDST_STRIDE    [rsp + 152] ; dst_stride
+%define LWIDTH         [rsp + 160] ; width
+%define LHEIGHT        [rsp + 168] ; height
+
+; in  xmm0 4 pixels, xmm7 zero
+; out xmm1 y, xmm2 u, xmm3 v, xmm4 a as dwords
+do4:
+    movdqa xmm5, xmm0
+    punpcklbw xmm5, xmm7       ; pixels 0 and 1, b g r a words
+    movdqa xmm6, xmm0
+    punpckhbw xmm6, xmm7       ; pixels 2 and 3, b g r a words
+
+    ; y
+    movdqa xmm1, xmm5
+    pmaddwd xmm1, [lsym(cwy)]
+    movdqa xmm8, xmm6
+    pmaddwd xmm8, [lsym(cwy)]
+    movaps xmm9, xmm1
+    shufps xmm1, xmm8, 0x88    ; b g sums
+    shufps xmm9, xmm8, 0xDD    ; r a sums
+    paddd xmm1, xmm9
+    movdqa xmm9, xmm0          ; g << 16
+    psrld xmm9, 8
+    pand xmm9, [lsym(cd255)]
+    pslld xmm9, 16
+    paddd xmm1, xmm9
+    psrad xmm1, 16
+
+    ; u
+    movdqa xmm2, xmm5
+    pmaddwd xmm2, [lsym(cwu)]
+    movdqa xmm8, xmm6
+    pmaddwd xmm8, [lsym(cwu)]
+    movaps xmm9, xmm2
+    shufps xmm2, xmm8, 0x88    ; b g sums
+    shufps xmm9, xmm8, 0xDD    ; r a sums
+    paddd xmm2, xmm9
+    movdqa xmm9, xmm0          ; b << 16
+    pand xmm9, [lsym(cd255)]
+    pslld xmm9, 16
+    paddd xmm2, xmm9
+    psrad xmm2, 16
+    paddd xmm2, [lsym(cd128)]
+
+    ; v
+    movdqa xmm3, xmm5
+    pmaddwd xmm3, [lsym(cwv)]
+    movdqa xmm8, xmm6
+    pmaddwd xmm8, [lsym(cwv)]
+    movaps xmm9, xmm3
+    shufps xmm3, xmm8, 0x88    ; b g sums
+    shufps xmm9, xmm8, 0xDD    ; r a sums
+    paddd xmm3, xmm9
+    psrad xmm3, 16
+    paddd xmm3, [lsym(cd128)]
+
+    ; a
+    movdqa xmm4, xmm0
+    psrld xmm4, 24
+
+    ret
+
+; in  rsi 8 pixels
+;     rdi y out, r8 plane size, r9 3 * plane size
+do8:
+    movdqu xmm0, [rsi]
+    call do4
+    movdqa xmm10, xmm1
+    movdqa xmm11, xmm2
+    movdqa xmm12, xmm3
+    movdqa xmm13, xmm4
+
+    movdqu xmm0, [rsi + 16]
+    call do4
+
+    ; pack clamps to 0 - 255
+    packssdw xmm10, xmm1
+    packuswb xmm10, xmm10
+    movq [rdi], xmm10          ; out 8 bytes y
+    packssdw xmm11, xmm2
+    packuswb xmm11, xmm11
+    movq [rdi + r8], xmm11     ; out 8 bytes u
+    packssdw xmm12, xmm3
+    packuswb xmm12, xmm12
+    movq [rdi + r8 * 2], xmm12 ; out 8 bytes v
+    packssdw xmm13, xmm4
+    packuswb xmm13, xmm13
+    movq [rdi + r9], xmm13     ; out 8 bytes a
+
+    lea rsi, [rsi + 32]
+    lea rdi, [rdi + 8]
+    ret
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+;int
+;a8r8g8b8_to_yuvalp_box_amd64_sse2(const char *s8, int src_stride,
+;                                  char *d8, int dst_stride,
+;                                  int width, int height);
+PROC a8r8g8b8_to_yuvalp_box_amd64_sse2
+    push rbx
+    push rbp
+    sub rsp, 176               ; local vars, 176 bytes
+
+    mov LS8, rdi               ; s8
+    movsxd rsi, esi
+    mov LSRC_STRIDE, rsi       ; src_stride
+    mov LD8, rdx               ; d8
+    movsxd rcx, ecx
+    mov LDST_STRIDE, rcx       ; dst_stride
+    mov LWIDTH, r8             ; width
+    mov LHEIGHT, r9            ; height
+
+    pxor xmm7, xmm7
+
+    mov ebx, LHEIGHT           ; ebx = height
+    cmp ebx, 0
+    jle done
+
+row_loop:
+    mov rsi, LS8               ; s8
+    mov rdi, LD8               ; d8
+    mov r8, 4096               ; 64 * 64
+    lea r9, [r8 + r8 * 2]
+
+    mov ecx, LWIDTH            ; ecx = width
+
+loop8:
+    cmp ecx, 8
+    jl loop8_done
+    call do8
+    sub ecx, 8
+    jmp loop8
+loop8_done:
+
+    cmp ecx, 0
+    jle row_done
+
+    ; right edge, less than 8 pixels left, go through LTMP_IN and LTMP_OUT
+    xor eax, eax
+tmp_in:
+    mov edx, [rsi + rax * 4]
+    mov [rsp + rax * 4], edx   ; LTMP_IN
+    inc eax
+    cmp eax, ecx
+    jl tmp_in
+
+    mov rbp, rdi               ; save d8
+    lea rsi, LTMP_IN
+    lea rdi, LTMP_OUT
+    mov r8, 16
+    lea r9, [r8 + r8 * 2]
+    call do8
+
+    xor eax, eax
+tmp_out:
+    mov dl, [rsp + rax + 64]   ; LTMP_OUT y
+    mov [rbp + rax], dl
+    mov dl, [rsp + rax + 80]   ; LTMP_OUT u
+    mov [rbp + rax + 4096], dl
+    mov dl, [rsp + rax + 96]   ; LTMP_OUT v
+    mov [rbp + rax + 8192], dl
+    mov dl, [rsp + rax + 112]  ; LTMP_OUT a
+    mov [rbp + rax + 12288], dl
+    inc eax
+    cmp eax, ecx
+    jl tmp_out
+
+row_done:
+    ; update s8
+    mov rax, LS8               ; s8
+    add rax, LSRC_STRIDE       ; s8 += src_stride
+    mov LS8, rax
+
+    ; update d8
+    mov rax, LD8               ; d8
+    add rax, LDST_STRIDE       ; d8 += dst_stride
+    mov LD8, rax
+
+    dec ebx
+    jnz row_loop
+
+done:
+    mov rax, 0                 ; return value
+    add rsp, 176               ; local vars, 176 bytes
+    pop rbp
+    pop rbx
+    ret
+END_OF_FILE
@@ -27,6 +27,8 @@ amd64 asm functions
 int
 cpuid_amd64(int eax_in, int ecx_in, int *eax, int *ebx, int *ecx, int *edx);
 int
+xgetbv_amd64(int ecx_in, int *eax, int *edx);
+int
 yv12_to_rgb32_amd64_sse2(const uint8_t *yuvs, int width, int height, int *rgbs);
 int
 i420_to_rgb32_amd64_sse2(const uint8_t *yuvs, int width, int height, int *rgbs);
@@ -43,6 +45,31 @@ a8r8g8b8_to_nv12_box_amd64_sse2(const uint8_t *s8, int src_stride,
                                 uint8_t *d8_y, int dst_stride_y,
                                 uint8_t *d8_uv, int dst_stride_uv,
                                 int width, int height);
+int
+a8r8g8b8_to_yuvalp_box_amd64_sse2(const uint8_t *s8, int src_stride,
+                                  uint8_t *d8, int dst_stride,
+                                  int width, int height);
+int
+yv12_to_rgb32_amd64_avx2(const uint8_t *yuvs, int width, int height, int *rgbs);
+int
+i420_to_rgb32_amd64_avx2(const uint8_t *yuvs, int width, int height, int *rgbs);
+int
+yuy2_to_rgb32_amd64_avx2(const uint8_t *yuvs, int width, int height, int *rgbs);
+int
+uyvy_to_rgb32_amd64_avx2(const uint8_t *yuvs, int width, int height, int *rgbs);
+int
+a8r8g8b8_to_a8b8g8r8_box_amd64_avx2(const uint8_t *s8, int src_stride,
+                                    uint8_t *d8, int dst_stride,
+                                    int width, int height);
+int
+a8r8g8b8_to_nv12_box_amd64_avx2(const uint8_t *s8, int src_stride,
+                                uint8_t *d8_y, int dst_stride_y,
+                                uint8_t *d8_uv, int dst_stride_uv,
+                                int width, int height);
+int
+a8r8g8b8_to_yuvalp_box_amd64_avx2(const uint8_t *s8, int src_stride,
+                                  uint8_t *d8, int dst_stride,
+                                  int width, int height);
 
 #endif
 
@@ -0,0 +1,296 @@
+;
+;Copyright 2026 Jay Sorg
+;
+;Permission to use, copy, modify, distribute, and sell this software and its
+;documentation for any purpose is hereby granted without fee, provided that
+;the above copyright notice appear in all copies and that both that
+;copyright notice and this permission notice appear in supporting
+;documentation.
+;
+;The above copyright notice and this permission notice shall be included in
+;all copies or substantial portions of the Software.
+;
+;THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+;OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+;AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+;CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;
+;YV12 to RGB32
+;amd64 AVX2
+;
+; same math as the SSE2 version, 16 pixels per iteration
+; width should be a multiple of 8
+;
+; YUV to RGB
+;   1        0        1.13983
+;   1       -0.39465 -0.58060
+;   1        2.03211  0
+; shift left 12
+;   4096     0        4669
+;   4096    -1616    -2378
+;   4096     9324     0
+
+%include "common.asm"
+
+PREPARE_RODATA
+c128 times 16 dw 128
+c4669 times 16 dw 4669
+c1616 times 16 dw 1616
+c2378 times 16 dw 2378
+c9324 times 16 dw 9324
+
+; in  ymm0 16 y words, ymm1 16 (u - 128) << 4 words
+;     ymm2 16 (v - 128) << 4 words
+; out ymm3 pixels 0 to 7, ymm4 pixels 8 to 15
+do16_rgb:
+
+    ; r = y + hiword(4669 * (v << 4))
+    vpmulhw ymm4, ymm2, [lsym(c4669)]
+    vpaddw ymm3, ymm0, ymm4
+
+    ; g = y - hiword(1616 * (u << 4)) - hiword(2378 * (v << 4))
+    vpmulhw ymm5, ymm1, [lsym(c1616)]
+    vpmulhw ymm6, ymm2, [lsym(c2378)]
+    vpsubw ymm4, ymm0, ymm5
+    vpsubw ymm4, ymm4, ymm6
+
+    ; b = y + hiword(9324 * (u << 4))
+    vpmulhw ymm6, ymm1, [lsym(c9324)]
+    vpaddw ymm5, ymm0, ymm6
+
+    vpackuswb ymm3, ymm3, ymm3  ; b
+    vpackuswb ymm4, ymm4, ymm4  ; g
+    vpunpcklbw ymm3, ymm3, ymm4 ; gb
+
+    vpxor ymm4, ymm4, ymm4      ; a
+    vpackuswb ymm5, ymm5, ymm5  ; r
+    vpunpcklbw ymm5, ymm5, ymm4 ; ar
+
+    ; unpack works within 128 bit lanes, low lane has pixels 0 to 7,
+    ; high lane has pixels 8 to 15
+    vpunpckhwd ymm4, ymm3, ymm5 ; argb, pixels 4 to 7, 12 to 15
+    vpunpcklwd ymm3, ymm3, ymm5 ; argb, pixels 0 to 3, 8 to 11
+    vperm2i128 ymm5, ymm3, ymm4, 0x20
+    vperm2i128 ymm4, ymm3, ymm4, 0x31
+    vmovdqa ymm3, ymm5
+
+    ret
+
+do16_uv:
+
+    ; u
+    vmovq xmm1, [rbx]    ; 8 at a time
+    lea rbx, [rbx + 8]
+    vpunpcklbw xmm1, xmm1, xmm1
+    vpmovzxbw ymm1, xmm1
+    vpsubw ymm1, ymm1, [lsym(c128)]
+    vpsllw ymm1, ymm1, 4
+
+    ; v
+    vmovq xmm2, [rdx]    ; 8 at a time
+    lea rdx, [rdx + 8]
+    vpunpcklbw xmm2, xmm2, xmm2
+    vpmovzxbw ymm2, xmm2
+    vpsubw ymm2, ymm2, [lsym(c128)]
+    vpsllw ymm2, ymm2, 4
+
+do16:
+
+    ; y
+    vpmovzxbw ymm0, [rsi] ; 16 at a time
+    lea rsi, [rsi + 16]
+
+    call do16_rgb
+
+    vmovdqu [rdi], ymm3
+    vmovdqu [rdi + 32], ymm4
+    lea rdi, [rdi + 64]
+
+    ret
+
+do8_uv:
+
+    ; u
+    vmovd xmm1, [rbx]    ; 4 at a time
+    lea rbx, [rbx + 4]
+    vpunpcklbw xmm1, xmm1, xmm1
+    vpmovzxbw ymm1, xmm1
+    vpsubw ymm1, ymm1, [lsym(c128)]
+    vpsllw ymm1, ymm1, 4
+
+    ; v
+    vmovd xmm2, [rdx]    ; 4 at a time
+    lea rdx, [rdx + 4]
+    vpunpcklbw xmm2, xmm2, xmm2
+    vpmovzxbw ymm2, xmm2
+    vpsubw ymm2, ymm2, [lsym(c128)]
+    vpsllw ymm2, ymm2, 4
+
+do8:
+
+    ; y
+    vmovq xmm0, [rsi]    ; 8 at a time
+    lea rsi, [rsi + 8]
+    vpmovzxbw ymm0, xmm0
+
+    call do16_rgb
+
+    vmovdqu [rdi], ymm3
+    lea rdi, [rdi + 32]
+
+    ret
+
+;The first six integer or pointer arguments are passed in registers
+; RDI, RSI, RDX, RCX, R8, and R9
+
+;int
+;yv12_to_rgb32_amd64_avx2(unsigned char *yuvs, int width, int height, int *rgbs)
+
+PROC yv12_to_rgb32_amd64_avx2
+    push rbx
+    push rbp
+
+    push rdi
+    push rdx
+    mov rdi, rcx        ; rgbs
+
+    mov rcx, rsi        ; width
+    mov rdx, rcx
+    pop rbp             ; height
+    mov rax, rbp
+    shr rbp, 1
+    imul rax, rcx       ; rax = width * height
+
+    pop rsi             ; y
+
+    mov rbx, rsi        ; u = y + width * height
+    add rbx, rax
+
+    ; local vars
+    ; char* yptr1
+    ; char* yptr2
+    ; char* uptr
+    ; char* vptr
+    ; int* rgbs1
+    ; int* rgbs2
+    ; int width
+    sub rsp, 56         ; local vars, 56 bytes
+    mov [rsp + 0], rsi  ; save y1
+    add rsi, rdx
+    mov [rsp + 8], rsi  ; save y2
+    mov [rsp + 16], rbx ; save u
+    shr rax, 2
+    add rbx, rax        ; v = u + (width * height / 4)
+    mov [rsp + 24], rbx ; save v
+
+    mov [rsp + 32], rdi ; save rgbs1
+    mov rax, rdx
+    shl rax, 2
+    add rdi, rax
+    mov [rsp + 40], rdi ; save rgbs2
+
+loop_y:
+
+    ; save rdx
+    mov [rsp + 48], rdx
+
+    mov rcx, rdx        ; width
+    shr rcx, 4
+    jz loop_x8
+
+loop_x16:
+
+    mov rsi, [rsp + 0]  ; y1
+    mov rbx, [rsp + 16] ; u
+    mov rdx, [rsp + 24] ; v
+    mov rdi, [rsp + 32] ; rgbs1
+
+    ; y1
+    call do16_uv
+
+    mov [rsp + 0], rsi  ; y1
+    mov [rsp + 32], rdi ; rgbs1
+
+    mov rsi, [rsp + 8]  ; y2
+    mov rdi, [rsp + 40] ; rgbs2
+
+    ; y2
+    call do16
+
+    mov [rsp + 8], rsi  ; y2
+    mov [rsp + 16], rbx ; u
+    mov [rsp + 24], rdx ; v
+    mov [rsp + 40], rdi ; rgbs2
+
+    dec rcx             ; width
+    jnz loop_x16
+
+loop_x8:
+
+    mov rax, [rsp + 48]
+    test rax, 8
+    jz done_loop_x
+
+    mov rsi, [rsp + 0]  ; y1
+    mov rbx, [rsp + 16] ; u
+    mov rdx, [rsp + 24] ; v
+    mov rdi, [rsp + 32] ; rgbs1
+
+    ; y1
+    call do8_uv
+
+    mov [rsp + 0], rsi  ; y1
+    mov [rsp + 32], rdi ; rgbs1
+
+    mov rsi, [rsp + 8]  ; y2
+    mov rdi, [rsp + 40] ; rgbs2
+
+    ; y2
+    call do8
+
+    mov [rsp + 8], rsi  ; y2
+    mov [rsp + 16], rbx ; u
+    mov [rsp + 24], rdx ; v
+    mov [rsp + 40], rdi ; rgbs2
+
+done_loop_x:
+
+    ; restore rdx
+    mov rdx, [rsp + 48]
+
+    ; update y1 and 2
+    mov rax, [rsp + 0]
+    mov rbx, rdx
+    add rax, rbx
+    mov [rsp + 0], rax
+
+    mov rax, [rsp + 8]
+    add rax, rbx
+    mov [rsp + 8], rax
+
+    ; update rgb1 and 2
+    mov rax, [rsp + 32]
+    mov rbx, rdx
+    shl rbx, 2
+    add rax, rbx
+    mov [rsp + 32], rax
+
+    mov rax, [rsp + 40]
+    add rax, rbx
+    mov [rsp + 40], rax
+
+    mov rcx, rbp
+    dec rcx             ; height
+    mov rbp, rcx
+    jnz loop_y
+
+    add rsp, 56
+
+    vzeroupper
+    mov rax, 0
+    pop rbp
+    pop rbx
+    ret
+END_OF_FILE
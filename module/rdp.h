@@ -33,6 +33,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <damage.h>
 
 #include "rdpPri.h"
+#include "rdpTrace.h"
 
 #include "xrdp_client_info.h"
 #include "xrdp_constants.h"
@@ -204,6 +205,9 @@ typedef int (*copy_box_dst2_proc)(const uint8_t *s8, int src_stride,
                                   uint8_t *d8_y, int dst_stride_y,
                                   uint8_t *d8_uv, int dst_stride_uv,
                                   int width, int height);
+/* 64 bit hash of a tile, pass the last result as seed to chain */
+typedef uint64_t (*tile_hash_proc)(uint64_t seed, const void *data,
+                                   int data_bytes);
 
 /* move this to common header */
 struct _rdpRec
@@ -219,6 +223,12 @@ struct _rdpRec
     int Bpp_mask;
     uint8_t *pfbMemory_alloc;
     uint8_t *pfbMemory;
+    /* when fb_fd is not -1 pfbMemory is a mapping of it that xrdp can
+       map too, fb_gen changes each time it is allocated
+       fb_bytes is the size mapped, 0 when pfbMemory_alloc is used */
+    int fb_fd;
+    int fb_bytes;
+    int fb_gen;
     ScreenPtr pScreen;
     rdpDevPrivateKey privateKeyRecGC;
     rdpDevPrivateKey privateKeyRecPixmap;
@@ -262,6 +272,8 @@ struct _rdpRec
     char uds_data[256];
     int disconnect_sck;
     char disconnect_uds[256];
+    /* SIGUSR1 writes a byte here to have the counters logged */
+    int stats_fd;
     rdpClientCon *clientConHead;
     rdpClientCon *clientConTail;
 
@@ -275,6 +287,8 @@ struct _rdpRec
 
     OsTimerPtr disconnectTimer;
     int disconnect_timeout_s;
+    /* removes clients whose connection failed, see rdpClientConLost */
+    OsTimerPtr reapTimer;
     CARD32 disconnect_time_ms;
 
     OsTimerPtr idleDisconnectTimer;
@@ -284,6 +298,32 @@ struct _rdpRec
 
     int conNumber;
 
+    /* number of shm frame buffers per connection, see "ShmFrameBuffers" */
+    int shm_slots;
+    /* capture worker threads, see "CaptureThreads", 0 is one per cpu */
+    int capture_threads;
+    struct rdp_thread_pool *capture_pool;
+    /* dirty tracking tile size, see "DirtyTileSize", 0 is regions only */
+    int dirty_tile_size;
+    /* send scrolls and window moves as copies, see "ScreenCopies" */
+    int screen_copies;
+    /* capture rate limits, see "MinFps" and "MaxFps" */
+    int min_fps;
+    int max_fps;
+    /* share the frame buffer with xrdp, see "ZeroCopy" */
+    int zero_copy;
+    /* back the frame buffer and shm with huge pages, see "HugePages" */
+    int huge_pages;
+    /* pass shm fds once, not with every paint, see "ShmRegister" */
+    int shm_register;
+    /* every monitor in one gfx frame, see "MonitorFrames" */
+    int monitor_frames;
+    /* events kept in the trace ring, see "TraceEvents", 0 is off */
+    int trace_events;
+    struct rdp_trace trace;
+    /* log the counters and write the trace on SIGUSR1, see "StatsSignal" */
+    int stats_signal;
+
     struct _rdpCounts counts;
 
     yuv_to_rgb32_proc i420_to_rgb32;
@@ -297,6 +337,8 @@ struct _rdpRec
 
     copy_box_proc a8r8g8b8_to_a8b8g8r8_box;
     copy_box_dst2_proc a8r8g8b8_to_nv12_box;
+    copy_box_proc a8r8g8b8_to_yuvalp_box;
+    tile_hash_proc tile_hash;
 
     /* multimon */
     struct monitor_info minfo[16]; /* client monitor data */
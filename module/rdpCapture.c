@@ -45,6 +45,7 @@ capture
 #include "rdpReg.h"
 #include "rdpMisc.h"
 #include "rdpCapture.h"
+#include "rdpThreads.h"
 
 #if defined(XORGXRDP_GLAMOR)
 #include "rdpEgl.h"
@@ -108,8 +109,9 @@ rdpFillBox_yuvalp(int ax, int ay,
 }
 
 /******************************************************************************/
-/* copy rects with no error checking
- * convert ARGB32 to 64x64 linear planar YUVA */
+/* convert ARGB32 to 64x64 linear planar YUVA
+ * d8 points into the y plane of a tile, the u, v and a planes follow
+ * every 64 * 64 bytes */
 /* http://msdn.microsoft.com/en-us/library/ff635643.aspx
  * 0.299   -0.168935    0.499813
  * 0.587   -0.331665   -0.418531
@@ -120,24 +122,18 @@ rdpFillBox_yuvalp(int ax, int ay,
 /* 19595  38470   7471
   -11071 -21736  32807
    32756 -27429  -5327 */
-static int
-rdpCopyBox_a8r8g8b8_to_yuvalp(int ax, int ay,
-                              const uint8_t *src, int src_stride,
-                              uint8_t *dst, int dst_stride,
-                              BoxPtr rects, int num_rects)
+int
+a8r8g8b8_to_yuvalp_box(const uint8_t *s8, int src_stride,
+                       uint8_t *d8, int dst_stride,
+                       int width, int height)
 {
-    const uint8_t *s8;
-    uint8_t *d8;
     uint8_t *yptr;
     uint8_t *uptr;
     uint8_t *vptr;
     uint8_t *aptr;
     const uint32_t *s32;
-    int index;
     int jndex;
     int kndex;
-    int width;
-    int height;
     uint32_t pixel;
     uint8_t a;
     int r;
@@ -146,6 +142,53 @@ rdpCopyBox_a8r8g8b8_to_yuvalp(int ax, int ay,
     int y;
     int u;
     int v;
+
+    for (jndex = 0; jndex < height; jndex++)
+    {
+        s32 = (const uint32_t *) s8;
+        yptr = d8;
+        uptr = yptr + 64 * 64;
+        vptr = uptr + 64 * 64;
+        aptr = vptr + 64 * 64;
+        kndex = 0;
+        while (kndex < width)
+        {
+            pixel = *(s32++);
+            RGB_SPLIT(a, r, g, b, pixel);
+            y = (r *  19595 + g *  38470 + b *   7471) >> 16;
+            u = (r * -11071 + g * -21736 + b *  32807) >> 16;
+            v = (r *  32756 + g * -27429 + b *  -5327) >> 16;
+            u = u + 128;
+            v = v + 128;
+            y = RDPCLAMP(y, 0, UCHAR_MAX);
+            u = RDPCLAMP(u, 0, UCHAR_MAX);
+            v = RDPCLAMP(v, 0, UCHAR_MAX);
+            *(yptr++) = y;
+            *(uptr++) = u;
+            *(vptr++) = v;
+            *(aptr++) = a;
+            kndex++;
+        }
+        d8 += dst_stride;
+        s8 += src_stride;
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* copy rects with no error checking
+ * convert ARGB32 to 64x64 linear planar YUVA */
+static int
+rdpCopyBox_a8r8g8b8_to_yuvalp(copy_box_proc copy_box, int ax, int ay,
+                              const uint8_t *src, int src_stride,
+                              uint8_t *dst, int dst_stride,
+                              BoxPtr rects, int num_rects)
+{
+    const uint8_t *s8;
+    uint8_t *d8;
+    int index;
+    int width;
+    int height;
     BoxPtr box;
 
     dst = dst + (ay << 8) * (dst_stride >> 8) + (ax << 8);
@@ -158,35 +201,7 @@ rdpCopyBox_a8r8g8b8_to_yuvalp(int ax, int ay,
         d8 += box->x1 - ax;
         width = box->x2 - box->x1;
         height = box->y2 - box->y1;
-        for (jndex = 0; jndex < height; jndex++)
-        {
-            s32 = (const uint32_t *) s8;
-            yptr = d8;
-            uptr = yptr + 64 * 64;
-            vptr = uptr + 64 * 64;
-            aptr = vptr + 64 * 64;
-            kndex = 0;
-            while (kndex < width)
-            {
-                pixel = *(s32++);
-                RGB_SPLIT(a, r, g, b, pixel);
-                y = (r *  19595 + g *  38470 + b *   7471) >> 16;
-                u = (r * -11071 + g * -21736 + b *  32807) >> 16;
-                v = (r *  32756 + g * -27429 + b *  -5327) >> 16;
-                u = u + 128;
-                v = v + 128;
-                y = RDPCLAMP(y, 0, UCHAR_MAX);
-                u = RDPCLAMP(u, 0, UCHAR_MAX);
-                v = RDPCLAMP(v, 0, UCHAR_MAX);
-                *(yptr++) = y;
-                *(uptr++) = u;
-                *(vptr++) = v;
-                *(aptr++) = a;
-                kndex++;
-            }
-            d8 += 64;
-            s8 += src_stride;
-        }
+        copy_box(s8, src_stride, d8, 64, width, height);
     }
     return 0;
 }
@@ -573,6 +588,281 @@ rdpCopyBox_a8r8g8b8_to_nv12(rdpClientCon *clientCon,
     return 0;
 }
 
+/* smallest band of rows worth handing to a worker thread */
+#define MIN_BAND_PIXELS (64 * 1024)
+
+struct copy_boxes_job
+{
+    rdpClientCon *clientCon;
+    int dst_format;
+    const uint8_t *src;
+    int src_stride;
+    uint8_t *dst;
+    int dst_stride;
+    uint8_t *dst_uv;
+    BoxPtr rects;
+    int num_rects;
+    int top;
+    int band_height;
+};
+
+/* one 64x64 tile for rdpCapture2 */
+struct rfx_tile_job
+{
+    int x;
+    int y;
+    int rect_index; /* into part_rects, -1 if the tile is all dirty */
+    int num_rects;
+    uint64_t crc;
+};
+
+struct rfx_tiles_job
+{
+    const uint8_t *src;
+    int src_stride;
+    uint8_t *dst;
+    int dst_stride;
+    copy_box_proc copy_box;
+    tile_hash_proc tile_hash;
+    const uint64_t *crcs; /* last sent hash of each tile */
+    int crc_stride;
+    struct rfx_tile_job *tiles;
+    BoxPtr part_rects;
+};
+
+/******************************************************************************/
+/* returns boolean */
+static Bool
+rdpCopyBoxesFormatOk(int dst_format)
+{
+    switch (dst_format)
+    {
+        case XRDP_a8r8g8b8:
+        case XRDP_a8b8g8r8:
+        case XRDP_r5g6b5:
+        case XRDP_a1r5g5b5:
+        case XRDP_r3g3b2:
+        case XRDP_nv12:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+/******************************************************************************/
+/* copy rects with no error checking, src and dst have the same origin,
+   safe to call from worker threads */
+static void
+rdpCopyBoxes(const struct copy_boxes_job *job, BoxPtr rects, int num_rects)
+{
+    rdpClientCon *clientCon;
+    const uint8_t *src;
+    uint8_t *dst;
+    int src_stride;
+    int dst_stride;
+
+    clientCon = job->clientCon;
+    src = job->src;
+    dst = job->dst;
+    src_stride = job->src_stride;
+    dst_stride = job->dst_stride;
+    switch (job->dst_format)
+    {
+        case XRDP_a8r8g8b8:
+            rdpCopyBox_a8r8g8b8_to_a8r8g8b8(clientCon,
+                                            src, src_stride, 0, 0,
+                                            dst, dst_stride, 0, 0,
+                                            rects, num_rects);
+            break;
+        case XRDP_a8b8g8r8:
+            rdpCopyBox_a8r8g8b8_to_a8b8g8r8(clientCon,
+                                            src, src_stride, 0, 0,
+                                            dst, dst_stride, 0, 0,
+                                            rects, num_rects);
+            break;
+        case XRDP_r5g6b5:
+            rdpCopyBox_a8r8g8b8_to_r5g6b5(clientCon,
+                                          src, src_stride, 0, 0,
+                                          dst, dst_stride, 0, 0,
+                                          rects, num_rects);
+            break;
+        case XRDP_a1r5g5b5:
+            rdpCopyBox_a8r8g8b8_to_a1r5g5b5(clientCon,
+                                            src, src_stride, 0, 0,
+                                            dst, dst_stride, 0, 0,
+                                            rects, num_rects);
+            break;
+        case XRDP_r3g3b2:
+            rdpCopyBox_a8r8g8b8_to_r3g3b2(clientCon,
+                                          src, src_stride, 0, 0,
+                                          dst, dst_stride, 0, 0,
+                                          rects, num_rects);
+            break;
+        case XRDP_nv12:
+            rdpCopyBox_a8r8g8b8_to_nv12(clientCon,
+                                        src, src_stride, 0, 0,
+                                        dst, dst_stride,
+                                        job->dst_uv, dst_stride,
+                                        0, 0,
+                                        rects, num_rects);
+            break;
+    }
+}
+
+/******************************************************************************/
+/* rdp_thread_work_proc, copies the part of every rect in one band */
+static void
+rdpCopyBoxesBand(void *arg, int index)
+{
+    const struct copy_boxes_job *job;
+    BoxRec box;
+    int y1;
+    int y2;
+    int jndex;
+
+    job = (const struct copy_boxes_job *) arg;
+    y1 = job->top + index * job->band_height;
+    y2 = y1 + job->band_height;
+    for (jndex = 0; jndex < job->num_rects; jndex++)
+    {
+        box = job->rects[jndex];
+        box.y1 = RDPMAX(box.y1, y1);
+        box.y2 = RDPMIN(box.y2, y2);
+        if (box.y1 < box.y2)
+        {
+            rdpCopyBoxes(job, &box, 1);
+        }
+    }
+}
+
+/******************************************************************************/
+/* splits the rects into bands of rows when there are worker threads and
+   enough pixels, bands are even so nv12 chroma rows are not shared */
+static void
+rdpCopyBoxesThreaded(struct copy_boxes_job *job)
+{
+    struct rdp_thread_pool *pool;
+    int index;
+    int num_threads;
+    int num_bands;
+    int pixels;
+    int top;
+    int bottom;
+    BoxPtr box;
+
+    pool = job->clientCon->dev->capture_pool;
+    num_threads = rdpThreadPoolGetNumThreads(pool);
+    pixels = 0;
+    top = INT_MAX;
+    bottom = 0;
+    for (index = 0; index < job->num_rects; index++)
+    {
+        box = job->rects + index;
+        pixels += (box->x2 - box->x1) * (box->y2 - box->y1);
+        top = RDPMIN(top, box->y1);
+        bottom = RDPMAX(bottom, box->y2);
+    }
+    num_bands = RDPMIN(num_threads * 2, pixels / MIN_BAND_PIXELS);
+    if (num_bands < 2)
+    {
+        rdpCopyBoxes(job, job->rects, job->num_rects);
+        return;
+    }
+    job->top = top & ~1;
+    job->band_height = (bottom - job->top + num_bands - 1) / num_bands;
+    job->band_height = RDPALIGN(job->band_height, 2);
+    num_bands = (bottom - job->top + job->band_height - 1) /
+                job->band_height;
+    LLOGLN(10, ("rdpCopyBoxesThreaded: pixels %d num_bands %d",
+           pixels, num_bands));
+    rdpThreadPoolRun(pool, num_bands, rdpCopyBoxesBand, job);
+}
+
+/******************************************************************************/
+/* hash the ARGB source of rects, the rects are in the same coordinates
+ * as the source */
+static uint64_t
+rdpHashBox_a8r8g8b8(tile_hash_proc tile_hash, uint64_t hash,
+                    const uint8_t *src, int src_stride,
+                    BoxPtr rects, int num_rects)
+{
+    const uint8_t *s8;
+    int index;
+    int jndex;
+    int bytes;
+    int height;
+    BoxPtr box;
+
+    for (index = 0; index < num_rects; index++)
+    {
+        box = rects + index;
+        s8 = src + box->y1 * src_stride;
+        s8 += box->x1 * 4;
+        bytes = (box->x2 - box->x1) * 4;
+        height = box->y2 - box->y1;
+        for (jndex = 0; jndex < height; jndex++)
+        {
+            hash = tile_hash(hash, s8, bytes);
+            s8 += src_stride;
+        }
+    }
+    return hash;
+}
+
+/******************************************************************************/
+/* rdp_thread_work_proc, hashes the source of one rfx tile and converts it
+ * if the hash does not match the last one sent
+ * the yuvalp output only depends on the dirty rects and the source pixels
+ * in them so the source hash stands in for the output */
+static void
+rdpCaptureRfxTile(void *arg, int index)
+{
+    const struct rfx_tiles_job *job;
+    struct rfx_tile_job *tile;
+    BoxRec rect;
+    BoxPtr rects;
+    int num_rects;
+    int crc_offset;
+    uint64_t crc;
+
+    job = (const struct rfx_tiles_job *) arg;
+    tile = job->tiles + index;
+    crc = 0;
+    if (tile->rect_index >= 0)
+    {
+        rects = job->part_rects + tile->rect_index;
+        num_rects = tile->num_rects;
+        crc = job->tile_hash(crc, rects, num_rects * sizeof(BoxRec));
+    }
+    else
+    {
+        rect.x1 = tile->x;
+        rect.y1 = tile->y;
+        rect.x2 = rect.x1 + XRDP_RFX_ALIGN;
+        rect.y2 = rect.y1 + XRDP_RFX_ALIGN;
+        rects = &rect;
+        num_rects = 1;
+    }
+    crc = rdpHashBox_a8r8g8b8(job->tile_hash, crc, job->src, job->src_stride,
+                              rects, num_rects);
+    tile->crc = crc;
+    crc_offset = (tile->y / XRDP_RFX_ALIGN) * job->crc_stride
+                 + (tile->x / XRDP_RFX_ALIGN);
+    if (crc == job->crcs[crc_offset])
+    {
+        /* unchanged, rdpCapture2 drops it */
+        return;
+    }
+    if (tile->rect_index >= 0)
+    {
+        rdpFillBox_yuvalp(tile->x, tile->y, job->dst, job->dst_stride);
+    }
+    rdpCopyBox_a8r8g8b8_to_yuvalp(job->copy_box, tile->x, tile->y,
+                                  job->src, job->src_stride,
+                                  job->dst, job->dst_stride,
+                                  rects, num_rects);
+}
+
 /******************************************************************************/
 static Bool
 isShmStatusActive(enum shared_memory_status status) {
@@ -596,11 +886,8 @@ rdpCapture0(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
     int num_rects;
     int i;
     Bool rv;
-    const uint8_t *src;
-    uint8_t *dst;
-    int src_stride;
-    int dst_stride;
     int dst_format;
+    struct copy_boxes_job job;
 
     LLOGLN(10, ("rdpCapture0:"));
 
@@ -630,46 +917,23 @@ rdpCapture0(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
         (*out_rects)[i] = rect;
     }
 
-    src = id->pixels;
-    dst = id->shmem_pixels;
     dst_format = clientCon->rdp_format;
-    src_stride = id->lineBytes;
-    dst_stride = clientCon->cap_stride_bytes;
-
-    if (dst_format == XRDP_a8r8g8b8)
+    if (id->shmem_pixels == id->pixels)
     {
-        rdpCopyBox_a8r8g8b8_to_a8r8g8b8(clientCon,
-                                        src, src_stride, 0, 0,
-                                        dst, dst_stride, 0, 0,
-                                        psrc_rects, num_rects);
-    }
-    else if (dst_format == XRDP_a8b8g8r8)
-    {
-        rdpCopyBox_a8r8g8b8_to_a8b8g8r8(clientCon,
-                                        src, src_stride, 0, 0,
-                                        dst, dst_stride, 0, 0,
-                                        psrc_rects, num_rects);
-    }
-    else if (dst_format == XRDP_r5g6b5)
-    {
-        rdpCopyBox_a8r8g8b8_to_r5g6b5(clientCon,
-                                      src, src_stride, 0, 0,
-                                      dst, dst_stride, 0, 0,
-                                      psrc_rects, num_rects);
-    }
-    else if (dst_format == XRDP_a1r5g5b5)
-    {
-        rdpCopyBox_a8r8g8b8_to_a1r5g5b5(clientCon,
-                                        src, src_stride, 0, 0,
-                                        dst, dst_stride, 0, 0,
-                                        psrc_rects, num_rects);
+        /* zero copy, xrdp reads the frame buffer in place */
     }
-    else if (dst_format == XRDP_r3g3b2)
+    else if (rdpCopyBoxesFormatOk(dst_format) && (dst_format != XRDP_nv12))
     {
-        rdpCopyBox_a8r8g8b8_to_r3g3b2(clientCon,
-                                      src, src_stride, 0, 0,
-                                      dst, dst_stride, 0, 0,
-                                      psrc_rects, num_rects);
+        job.clientCon = clientCon;
+        job.dst_format = dst_format;
+        job.src = id->pixels;
+        job.src_stride = id->lineBytes;
+        job.dst = id->shmem_pixels;
+        job.dst_stride = clientCon->cap_stride_bytes;
+        job.dst_uv = NULL;
+        job.rects = psrc_rects;
+        job.num_rects = num_rects;
+        rdpCopyBoxesThreaded(&job);
     }
     else
     {
@@ -837,20 +1101,20 @@ rdpCapture2(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
     int out_rect_index;
     int num_rects;
     int rcode;
+    int index;
+    int num_tiles;
+    int num_part_rects;
+    int part_rects_alloc;
     BoxRec rect;
     BoxRec extents_rect;
     BoxPtr rects;
     RegionRec tile_reg;
-    const uint8_t *src;
-    uint8_t *dst;
-    uint8_t *crc_dst;
-    int src_stride;
-    int dst_stride;
     int crc_offset;
     int crc_stride;
-    int crc;
     int num_crcs;
     int mon_index;
+    struct rfx_tile_job *tile;
+    struct rfx_tiles_job job;
 
     LLOGLN(10, ("rdpCapture2:"));
 
@@ -870,12 +1134,14 @@ rdpCapture2(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
 
     rdpRegionTranslate(in_reg, -id->left, -id->top);
 
-    src = id->pixels;
-    dst = id->shmem_pixels;
-    src_stride = id->lineBytes;
-    dst_stride = ((id->width + 63) & ~63) * 4;
+    job.src = id->pixels;
+    job.dst = id->shmem_pixels;
+    job.src_stride = id->lineBytes;
+    job.dst_stride = ((id->width + 63) & ~63) * 4;
+    job.copy_box = clientCon->dev->a8r8g8b8_to_yuvalp_box;
+    job.tile_hash = clientCon->dev->tile_hash;
 
-    src = src + src_stride * id->top + id->left * 4;
+    job.src = job.src + job.src_stride * id->top + id->left * 4;
 
     mon_index = (id->flags >> 28) & 0xF;
     crc_stride = (id->width + 63) / 64;
@@ -887,10 +1153,20 @@ rdpCapture2(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
         /* resize the crc list */
         clientCon->num_rfx_crcs_alloc[mon_index] = num_crcs;
         free(clientCon->rfx_crcs[mon_index]);
-        clientCon->rfx_crcs[mon_index] = g_new0(int, num_crcs);
+        clientCon->rfx_crcs[mon_index] = g_new0(uint64_t, num_crcs);
     }
+    job.crcs = clientCon->rfx_crcs[mon_index];
+    job.crc_stride = crc_stride;
 
+    /* find the dirty tiles, the region work stays on this thread */
     extents_rect = *rdpRegionExtents(in_reg);
+    x = (extents_rect.x2 - (extents_rect.x1 & ~63) + 63) / 64;
+    y = (extents_rect.y2 - (extents_rect.y1 & ~63) + 63) / 64;
+    job.tiles = g_new(struct rfx_tile_job, RDPMAX(x * y, 1));
+    part_rects_alloc = 64;
+    job.part_rects = g_new(BoxRec, part_rects_alloc);
+    num_tiles = 0;
+    num_part_rects = 0;
     y = extents_rect.y1 & ~63;
     while (y < extents_rect.y2)
     {
@@ -913,62 +1189,86 @@ rdpCapture2(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
             }
             else
             {
-                crc = crc_start();
+                tile = job.tiles + num_tiles;
+                num_tiles++;
+                tile->x = x;
+                tile->y = y;
+                tile->rect_index = -1;
+                tile->num_rects = 0;
                 if (rcode == rgnPART)
                 {
                     LLOGLN(10, ("rdpCapture2: rgnPART"));
-                    rdpFillBox_yuvalp(x, y, dst, dst_stride);
                     rdpRegionInit(&tile_reg, &rect, 0);
                     rdpRegionIntersect(&tile_reg, in_reg, &tile_reg);
                     rects = REGION_RECTS(&tile_reg);
                     num_rects = REGION_NUM_RECTS(&tile_reg);
-                    crc = crc_process_data(crc, rects,
-                                           num_rects * sizeof(BoxRec));
-                    rdpCopyBox_a8r8g8b8_to_yuvalp(x, y,
-                                                  src, src_stride,
-                                                  dst, dst_stride,
-                                                  rects, num_rects);
+                    if (num_part_rects + num_rects > part_rects_alloc)
+                    {
+                        part_rects_alloc = (num_part_rects + num_rects) * 2;
+                        job.part_rects = g_renew(BoxRec, job.part_rects,
+                                                 part_rects_alloc);
+                    }
+                    g_memcpy(job.part_rects + num_part_rects, rects,
+                             num_rects * sizeof(BoxRec));
+                    tile->rect_index = num_part_rects;
+                    tile->num_rects = num_rects;
+                    num_part_rects += num_rects;
                     rdpRegionUninit(&tile_reg);
                 }
                 else /* rgnIN */
                 {
                     LLOGLN(10, ("rdpCapture2: rgnIN"));
-                    rdpCopyBox_a8r8g8b8_to_yuvalp(x, y,
-                                                  src, src_stride,
-                                                  dst, dst_stride,
-                                                  &rect, 1);
-                }
-                crc_dst = dst + (y << 8) * (dst_stride >> 8) + (x << 8);
-                crc = crc_process_data(crc, crc_dst, 64 * 64 * 4);
-                crc = crc_end(crc);
-                crc_offset = (y / XRDP_RFX_ALIGN) * crc_stride 
-                             + (x / XRDP_RFX_ALIGN);
-                LLOGLN(10, ("rdpCapture2: crc 0x%8.8x 0x%8.8x",
-                       crc, clientCon->rfx_crcs[mon_index][crc_offset]));
-                if (crc == clientCon->rfx_crcs[mon_index][crc_offset])
-                {
-                    LLOGLN(10, ("rdpCapture2: crc skip at x %d y %d", x, y));
-                    rdpRegionInit(&tile_reg, &rect, 0);
-                    rdpRegionSubtract(in_reg, in_reg, &tile_reg);
-                    rdpRegionUninit(&tile_reg);
-                }
-                else
-                {
-                    clientCon->rfx_crcs[mon_index][crc_offset] = crc;
-                    (*out_rects)[out_rect_index] = rect;
-                    out_rect_index++;
-                    if (out_rect_index >= RDP_MAX_TILES)
-                    {
-                        free(*out_rects);
-                        *out_rects = NULL;
-                        return FALSE;
-                    }
                 }
             }
             x += XRDP_RFX_ALIGN;
         }
         y += XRDP_RFX_ALIGN;
     }
+
+    /* hash and convert the tiles, spread over the worker threads */
+    rdpThreadPoolRun(clientCon->dev->capture_pool, num_tiles,
+                     rdpCaptureRfxTile, &job);
+
+    /* drop the tiles that did not change, in tile order */
+    clientCon->stats.crc_tiles += num_tiles;
+    for (index = 0; index < num_tiles; index++)
+    {
+        tile = job.tiles + index;
+        rect.x1 = tile->x;
+        rect.y1 = tile->y;
+        rect.x2 = rect.x1 + XRDP_RFX_ALIGN;
+        rect.y2 = rect.y1 + XRDP_RFX_ALIGN;
+        crc_offset = (tile->y / XRDP_RFX_ALIGN) * crc_stride
+                     + (tile->x / XRDP_RFX_ALIGN);
+        LLOGLN(10, ("rdpCapture2: crc 0x%16.16llx 0x%16.16llx",
+               (unsigned long long) tile->crc,
+               (unsigned long long) clientCon->rfx_crcs[mon_index][crc_offset]));
+        if (tile->crc == clientCon->rfx_crcs[mon_index][crc_offset])
+        {
+            LLOGLN(10, ("rdpCapture2: crc skip at x %d y %d",
+                   tile->x, tile->y));
+            clientCon->stats.crc_skips++;
+            rdpRegionInit(&tile_reg, &rect, 0);
+            rdpRegionSubtract(in_reg, in_reg, &tile_reg);
+            rdpRegionUninit(&tile_reg);
+        }
+        else
+        {
+            clientCon->rfx_crcs[mon_index][crc_offset] = tile->crc;
+            (*out_rects)[out_rect_index] = rect;
+            out_rect_index++;
+            if (out_rect_index >= RDP_MAX_TILES)
+            {
+                free(job.tiles);
+                free(job.part_rects);
+                free(*out_rects);
+                *out_rects = NULL;
+                return FALSE;
+            }
+        }
+    }
+    free(job.tiles);
+    free(job.part_rects);
     *num_out_rects = out_rect_index;
     return TRUE;
 }
@@ -983,13 +1283,9 @@ rdpCapture3(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
     BoxRec rect;
     int num_rects;
     int index;
-    uint8_t *dst_uv;
     Bool rv;
-    const uint8_t *src;
-    uint8_t *dst;
-    int src_stride;
-    int dst_stride;
     int dst_format;
+    struct copy_boxes_job job;
 
     LLOGLN(10, ("rdpCapture3:"));
 
@@ -1029,29 +1325,19 @@ rdpCapture3(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
         index++;
     }
 
-    src = id->pixels;
-    dst = id->shmem_pixels;
     dst_format = clientCon->rdp_format;
-    src_stride = id->lineBytes;
-    dst_stride = clientCon->cap_stride_bytes;
-
-    if (dst_format == XRDP_a8r8g8b8)
-    {
-        rdpCopyBox_a8r8g8b8_to_a8r8g8b8(clientCon,
-                                        src, src_stride, 0, 0,
-                                        dst, dst_stride, 0, 0,
-                                        *out_rects, num_rects);
-    }
-    else if (dst_format == XRDP_nv12)
+    if ((dst_format == XRDP_a8r8g8b8) || (dst_format == XRDP_nv12))
     {
-        dst_uv = dst;
-        dst_uv += clientCon->cap_width * clientCon->cap_height;
-        rdpCopyBox_a8r8g8b8_to_nv12(clientCon,
-                                    src, src_stride, 0, 0,
-                                    dst, dst_stride,
-                                    dst_uv, dst_stride,
-                                    0, 0,
-                                    *out_rects, num_rects);
+        job.clientCon = clientCon;
+        job.dst_format = dst_format;
+        job.src = id->pixels;
+        job.src_stride = id->lineBytes;
+        job.dst = id->shmem_pixels;
+        job.dst_stride = clientCon->cap_stride_bytes;
+        job.dst_uv = job.dst + clientCon->cap_width * clientCon->cap_height;
+        job.rects = *out_rects;
+        job.num_rects = num_rects;
+        rdpCopyBoxesThreaded(&job);
     }
     else
     {
@@ -1128,16 +1414,23 @@ rdpCapture(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
            int *num_out_rects, struct image_data *id)
 {
     int mode;
+    Bool rv;
 
     LLOGLN(10, ("rdpCapture:"));
     mode = clientCon->client_info.capture_code;
+    RDP_TRACE(&(clientCon->dev->trace), capture, 'B',
+              clientCon->conNumber, mode, 0);
+    rv = FALSE;
     if (clientCon->dev->glamor)
     {
 #if defined(XORGXRDP_GLAMOR)
         if ((mode == 2) || (mode == 4))
         {
-            return rdpEglCaptureRfx(clientCon, in_reg, out_rects,
-                                    num_out_rects, id);
+            rv = rdpEglCaptureRfx(clientCon, in_reg, out_rects,
+                                  num_out_rects, id);
+            RDP_TRACE(&(clientCon->dev->trace), capture, 'E',
+                      clientCon->conNumber, mode, rv ? *num_out_rects : 0);
+            return rv;
         }
         copy_vmem(clientCon->dev, in_reg);
 #endif
@@ -1145,22 +1438,28 @@ rdpCapture(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
     switch (mode)
     {
         case 0:
-            return rdpCapture0(clientCon, in_reg, out_rects, num_out_rects, id);
+            rv = rdpCapture0(clientCon, in_reg, out_rects, num_out_rects, id);
+            break;
         case 1:
-            return rdpCapture1(clientCon, in_reg, out_rects, num_out_rects, id);
+            rv = rdpCapture1(clientCon, in_reg, out_rects, num_out_rects, id);
+            break;
         case 2:
         case 4:
             /* used for remotefx capture */
-            return rdpCapture2(clientCon, in_reg, out_rects, num_out_rects, id);
+            rv = rdpCapture2(clientCon, in_reg, out_rects, num_out_rects, id);
+            break;
         case 3:
         case 5:
             /* used for even align capture */
-            return rdpCapture3(clientCon, in_reg, out_rects, num_out_rects, id);
+            rv = rdpCapture3(clientCon, in_reg, out_rects, num_out_rects, id);
+            break;
         default:
             LLOGLN(0, ("rdpCapture: mode %d not implemented", mode));
             break;
     }
-    return FALSE;
+    RDP_TRACE(&(clientCon->dev->trace), capture, 'E',
+              clientCon->conNumber, mode, rv ? *num_out_rects : 0);
+    return rv;
 }
 
 /**
@@ -1182,6 +1481,8 @@ rdpCaptureResetState(rdpClientCon *clientCon)
             {
                 free(clientCon->rfx_crcs[i]);
                 clientCon->rfx_crcs[i] = NULL;
+                free(clientCon->rfx_src_crcs[i]);
+                clientCon->rfx_src_crcs[i] = NULL;
                 clientCon->num_rfx_crcs_alloc[i] = 0;
                 clientCon->send_key_frame[i] = 1;
             }
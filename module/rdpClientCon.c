@@ -34,6 +34,7 @@ Client connection to xrdp
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <limits.h>
+#include <unistd.h>
 
 /* this should be before all X11 .h files */
 #include <xorg-server.h>
@@ -51,6 +52,10 @@ Client connection to xrdp
 #include "rdpReg.h"
 #include "rdpCapture.h"
 #include "rdpRandR.h"
+#include "rdpThreads.h"
+#include "rdpCursor.h"
+#include "rdpOutQueue.h"
+#include "rdpLatency.h"
 
 #define LOG_LEVEL 1
 #define LLOGLN(_level, _args) \
@@ -61,6 +66,9 @@ Client connection to xrdp
 #define USE_MAX_OS_BYTES 1
 #define MAX_OS_BYTES (16 * 1024 * 1024)
 
+/* longest message read from xrdp, anything longer is a broken stream */
+#define XRDP_MAX_IN_MSG_BYTES (1024 * 1024)
+
 /*
 0 GXclear,        0
 1 GXnor,          DPon
@@ -80,6 +88,10 @@ e GXor,           DPo
 f GXset           1
 */
 
+/* write end of dev->stats_fd, for the signal handler */
+static int g_stats_pipe_write = -1;
+static struct sigaction g_old_sigusr1;
+
 static int g_rdp_opcodes[16] =
 {
     0x00, /* GXclear        0x0 0 */
@@ -107,15 +119,45 @@ rdpDeferredIdleDisconnectCallback(OsTimerPtr timer, CARD32 now, pointer arg);
 static void
 rdpScheduleDeferredUpdate(rdpClientCon *clientCon);
 static void
+rdpClientConMovesFree(rdpClientCon *clientCon);
+static int
+rdpClientConMonitorsFit(rdpClientCon *clientCon);
+static void
 rdpClientConProcessClientInfoMonitors(rdpPtr dev, rdpClientCon *clientCon);
 static int
 rdpSendMemoryAllocationComplete(rdpPtr dev, rdpClientCon *clientCon);
+static void
+rdpClientConFreeSharedMemory(rdpClientCon *clientCon);
+static void
+rdpClientConLost(rdpPtr dev, rdpClientCon *clientCon);
+static void
+rdpClientConNotifyData(int fd, int ready, void *data);
+static void
+rdpClientConNotifyControlListen(int fd, int ready, void *data);
+static void
+rdpClientConNotifyControl(int fd, int ready, void *data);
+static void
+rdpClientConNotifyStats(int fd, int ready, void *data);
+static void
+rdpClientConWantWrite(rdpClientCon *clientCon, int want);
+static void
+rdpClientConFlush(rdpPtr dev, rdpClientCon *clientCon);
+static int
+rdpClientConDirtyNotEmpty(rdpClientCon *clientCon);
+
+/* called when fd is readable with the data it was added with */
+typedef void (*rdpClientConFdProc)(int fd, int ready, void *data);
 
 #if XORG_VERSION_CURRENT < XORG_VERSION_NUMERIC(1, 18, 5, 0, 0)
 
+/* the ready mask rdpClientConNotifyData gets, as newer servers have it */
+#define X_NOTIFY_READ 1
+#define X_NOTIFY_WRITE 2
+
 /******************************************************************************/
+/* the fds are polled by rdpClientConCheck from the wakeup handler */
 static int
-rdpClientConAddEnabledDevice(ScreenPtr pScreen, int fd)
+rdpClientConAddEnabledDevice(int fd, rdpClientConFdProc proc, void *data)
 {
     AddEnabledDevice(fd);
     return 0;
@@ -129,21 +171,21 @@ rdpClientConRemoveEnabledDevice(int fd)
     return 0;
 }
 
-#else
-
 /******************************************************************************/
+/* the out queue is flushed by rdpClientConCheck */
 static void
-rdpClientConNotifyFdProcPtr(int fd, int ready, void *data)
+rdpClientConWantWrite(rdpClientCon *clientCon, int want)
 {
-    ScreenPtr pScreen = (ScreenPtr) data;
-    rdpClientConCheck(pScreen);
 }
 
+#else
+
 /******************************************************************************/
+/* the server calls proc for just this fd when it is readable */
 static int
-rdpClientConAddEnabledDevice(ScreenPtr pScreen, int fd)
+rdpClientConAddEnabledDevice(int fd, rdpClientConFdProc proc, void *data)
 {
-    SetNotifyFd(fd, rdpClientConNotifyFdProcPtr, X_NOTIFY_READ, pScreen);
+    SetNotifyFd(fd, proc, X_NOTIFY_READ, data);
     return 0;
 }
 
@@ -155,6 +197,20 @@ rdpClientConRemoveEnabledDevice(int fd)
     return 0;
 }
 
+/******************************************************************************/
+/* watch for the socket being writable while the out queue is not empty */
+static void
+rdpClientConWantWrite(rdpClientCon *clientCon, int want)
+{
+    if (want != clientCon->want_write)
+    {
+        clientCon->want_write = want;
+        SetNotifyFd(clientCon->sck, rdpClientConNotifyData,
+                    want ? X_NOTIFY_READ | X_NOTIFY_WRITE : X_NOTIFY_READ,
+                    clientCon);
+    }
+}
+
 #endif
 
 /******************************************************************************/
@@ -207,12 +263,67 @@ rdpRemoveClientConFromDev(rdpPtr dev, rdpClientCon *clientCon)
     }
 }
 
+/******************************************************************************/
+/* a socket next to the display socket to read the counters of clientCon
+   from, write a line to it and the counters come back */
+static void
+rdpClientConControlListen(rdpPtr dev, rdpClientCon *clientCon)
+{
+    int sck;
+
+    snprintf(clientCon->control_uds, sizeof(clientCon->control_uds),
+             "%s/xrdp_display_%s_stats_%d", g_socket_dir(), display,
+             clientCon->conNumber);
+    unlink(clientCon->control_uds);
+    sck = g_sck_local_socket_stream();
+    if (g_sck_local_bind(sck, clientCon->control_uds) != 0)
+    {
+        LLOGLN(0, ("rdpClientConControlListen: g_sck_local_bind failed "
+               "at %s", clientCon->control_uds));
+        g_sck_close(sck);
+        clientCon->control_uds[0] = 0;
+        return;
+    }
+    g_sck_listen(sck);
+    g_chmod_hex(clientCon->control_uds, 0x0660);
+    clientCon->sckControlListener = sck;
+    rdpClientConAddEnabledDevice(sck, rdpClientConNotifyControlListen,
+                                 clientCon);
+}
+
+/******************************************************************************/
+static void
+rdpClientConControlCloseCon(rdpClientCon *clientCon)
+{
+    if (clientCon->sckControl > 0)
+    {
+        rdpClientConRemoveEnabledDevice(clientCon->sckControl);
+        g_sck_close(clientCon->sckControl);
+        clientCon->sckControl = 0;
+    }
+}
+
+/******************************************************************************/
+static void
+rdpClientConControlClose(rdpClientCon *clientCon)
+{
+    rdpClientConControlCloseCon(clientCon);
+    if (clientCon->sckControlListener > 0)
+    {
+        rdpClientConRemoveEnabledDevice(clientCon->sckControlListener);
+        g_sck_close(clientCon->sckControlListener);
+        clientCon->sckControlListener = 0;
+        unlink(clientCon->control_uds);
+    }
+}
+
 /******************************************************************************/
 static int
 rdpClientConGotConnection(ScreenPtr pScreen, rdpPtr dev)
 {
     rdpClientCon *clientCon;
     int new_sck;
+    int index;
 
     LLOGLN(0, ("rdpClientConGotConnection:"));
     clientCon = g_new0(rdpClientCon, 1);
@@ -220,6 +331,16 @@ rdpClientConGotConnection(ScreenPtr pScreen, rdpPtr dev)
     clientCon->updateRetries = 0;
     clientCon->dev = dev;
     clientCon->shmemfd = -1;
+    clientCon->shm_slot_count = RDPCLAMP(dev->shm_slots, 1,
+                                         XRDP_MAX_SHM_SLOTS);
+    rdpPacingInit(&(clientCon->pacing), dev->min_fps, dev->max_fps,
+                  clientCon->shm_slot_count);
+    rdpLatencyInit(&(clientCon->latency));
+    for (index = 0; index < XRDP_MAX_SHM_SLOTS; index++)
+    {
+        clientCon->shm_slot_fd[index] = -1;
+    }
+    clientCon->cursor_last = -1;
     dev->last_event_time_ms = GetTimeInMillis();
     dev->do_dirty_ons = 1;
 
@@ -244,7 +365,9 @@ rdpClientConGotConnection(ScreenPtr pScreen, rdpPtr dev)
         clientCon->begin = FALSE;
         dev->conNumber++;
         clientCon->conNumber = dev->conNumber;
-        rdpClientConAddEnabledDevice(pScreen, clientCon->sck);
+        rdpClientConAddEnabledDevice(clientCon->sck, rdpClientConNotifyData,
+                                     clientCon);
+        rdpClientConControlListen(dev, clientCon);
     }
 
 #if 1
@@ -254,7 +377,7 @@ rdpClientConGotConnection(ScreenPtr pScreen, rdpPtr dev)
         LLOGLN(0, ("rdpClientConGotConnection: "
                    "marking only clientCon %p for disconnect",
                    dev->clientConTail));
-        dev->clientConTail->connected = FALSE;
+        rdpClientConLost(dev, dev->clientConTail);
     }
 #endif
 
@@ -276,6 +399,14 @@ rdpClientConGotConnection(ScreenPtr pScreen, rdpPtr dev)
 
     clientCon->dirtyRegion = rdpRegionCreate(NullBox, 0);
     clientCon->shmRegion = rdpRegionCreate(NullBox, 0);
+    if (dev->dirty_tile_size == 16)
+    {
+        clientCon->dirty_tile_shift = 4;
+    }
+    else if (dev->dirty_tile_size == 64)
+    {
+        clientCon->dirty_tile_shift = 6;
+    }
 
     return 0;
 }
@@ -390,6 +521,7 @@ rdpClientConDisconnect(rdpPtr dev, rdpClientCon *clientCon)
 
     rdpClientConRemoveEnabledDevice(clientCon->sck);
     g_sck_close(clientCon->sck);
+    rdpClientConControlClose(clientCon);
     if (clientCon->maxOsBitmaps > 0)
     {
         for (index = 0; index < clientCon->maxOsBitmaps; index++)
@@ -409,81 +541,106 @@ rdpClientConDisconnect(rdpPtr dev, rdpClientCon *clientCon)
 
     rdpRegionDestroy(clientCon->dirtyRegion);
     rdpRegionDestroy(clientCon->shmRegion);
+    free(clientCon->dirty_tiles);
+    free(clientCon->dirty_tile_rows);
+    rdpClientConMovesFree(clientCon);
     if (clientCon->updateTimer != NULL)
     {
         TimerCancel(clientCon->updateTimer);
         TimerFree(clientCon->updateTimer);
     }
+    LLOGLN(0, ("rdpClientConDisconnect: %d frames sent in %d send calls",
+           clientCon->paint_frames, clientCon->paint_syscalls));
+    LLOGLN(0, ("rdpClientConDisconnect: %d mouse motions coalesced",
+           clientCon->motion_coalesced));
+    rdpLatencyLog(&(clientCon->latency), clientCon->conNumber);
+    rdpOutQueueDeinit(&(clientCon->out_queue));
     free_stream(clientCon->out_s);
     free_stream(clientCon->in_s);
-    if (clientCon->shmemptr != NULL)
+    rdpClientConFreeSharedMemory(clientCon);
+    rdpCursorCacheFree(clientCon);
+    free(clientCon);
+    return 0;
+}
+
+/******************************************************************************/
+/* disconnect the clients whose connection failed */
+static void
+rdpClientConReap(rdpPtr dev)
+{
+    rdpClientCon *clientCon;
+    rdpClientCon *nextCon;
+
+    clientCon = dev->clientConHead;
+    while (clientCon != NULL)
     {
-        g_free_unmap_fd(clientCon->shmemptr,
-                        clientCon->shmemfd,
-                        clientCon->shmem_bytes);
+        nextCon = clientCon->next;
+        if (!clientCon->connected)
+        {
+            /* I/O error on this client - remove it */
+            rdpClientConDisconnect(dev, clientCon);
+        }
+        clientCon = nextCon;
     }
-    free(clientCon);
+}
+
+/******************************************************************************/
+static CARD32
+rdpClientConReapCallback(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+    LLOGLN(10, ("rdpClientConReapCallback:"));
+    rdpClientConReap((rdpPtr) arg);
     return 0;
 }
 
+/******************************************************************************/
+/* mark clientCon for disconnect, it can be in use by the caller so it is
+   removed from a timer */
+static void
+rdpClientConLost(rdpPtr dev, rdpClientCon *clientCon)
+{
+    clientCon->connected = FALSE;
+    dev->reapTimer = TimerSet(dev->reapTimer, 0, 1,
+                              rdpClientConReapCallback, dev);
+}
+
 /*****************************************************************************/
-/* returns error */
+/* returns error, never blocks, what the socket does not take waits in
+   clientCon->out_queue until it is writable */
 static int
-rdpClientConSend(rdpPtr dev, rdpClientCon *clientCon, const char *data, int len)
+rdpClientConSendWithFd(rdpPtr dev, rdpClientCon *clientCon,
+                       const char *data, int len, int fd)
 {
-    int sent;
-    int retries = 0;
-
-    LLOGLN(10, ("rdpClientConSend - sending %d bytes", len));
+    LLOGLN(10, ("rdpClientConSendWithFd - sending %d bytes fd %d", len, fd));
 
     if (!clientCon->connected)
     {
         return 1;
     }
-
-    while (len > 0)
+    RDP_TRACE(&(dev->trace), send, 'i', clientCon->conNumber, len, fd);
+    if (rdpOutQueueSend(&(clientCon->out_queue), clientCon->sck,
+                        data, len, fd) != 0)
     {
-        sent = g_sck_send(clientCon->sck, data, len, 0);
-
-        if (sent == -1)
-        {
-            if (g_sck_last_error_would_block(clientCon->sck))
-            {
-                // Just because we couldn't after 100 retries
-                // does not mean we're disconnected.
-                if (retries > 100)
-                {
-                    return 0;
-                }
-                ++retries;
-                g_sleep(1);
-            }
-            else
-            {
-                LLOGLN(0, ("rdpClientConSend: g_tcp_send failed(returned -1)"));
-                clientCon->connected = FALSE;
-                return 1;
-            }
-        }
-        else if (sent == 0)
-        {
-            LLOGLN(0, ("rdpClientConSend: g_tcp_send failed(returned zero)"));
-            clientCon->connected = FALSE;
-            return 1;
-        }
-        else
-        {
-            data += sent;
-            len -= sent;
-        }
+        LLOGLN(0, ("rdpClientConSendWithFd: rdpOutQueueSend failed"));
+        rdpClientConLost(dev, clientCon);
+        return 1;
     }
-
+    rdpClientConWantWrite(clientCon, clientCon->out_queue.head != NULL);
     return 0;
 }
 
+/*****************************************************************************/
+/* returns error */
+static int
+rdpClientConSend(rdpPtr dev, rdpClientCon *clientCon, const char *data, int len)
+{
+    return rdpClientConSendWithFd(dev, clientCon, data, len, -1);
+}
+
 /******************************************************************************/
+/* fd, if not -1, is passed to xrdp after the message */
 static int
-rdpClientConSendMsg(rdpPtr dev, rdpClientCon *clientCon)
+rdpClientConSendMsg(rdpPtr dev, rdpClientCon *clientCon, int fd)
 {
     int len;
     int rv;
@@ -506,7 +663,7 @@ rdpClientConSendMsg(rdpPtr dev, rdpClientCon *clientCon)
         out_uint16_le(s, 3);
         out_uint16_le(s, clientCon->count);
         out_uint32_le(s, len - 8);
-        rv = rdpClientConSend(dev, clientCon, s->data, len);
+        rv = rdpClientConSendWithFd(dev, clientCon, s->data, len, fd);
     }
 
     if (rv != 0)
@@ -518,8 +675,10 @@ rdpClientConSendMsg(rdpPtr dev, rdpClientCon *clientCon)
 }
 
 /******************************************************************************/
+/* fd, if not -1, goes with the update, in the same send call when the
+   socket allows */
 static int
-rdpClientConSendPending(rdpPtr dev, rdpClientCon *clientCon)
+rdpClientConSendPendingFd(rdpPtr dev, rdpClientCon *clientCon, int fd)
 {
     int rv;
 
@@ -530,7 +689,7 @@ rdpClientConSendPending(rdpPtr dev, rdpClientCon *clientCon)
         out_uint16_le(clientCon->out_s, 4); /* size */
         clientCon->count++;
         s_mark_end(clientCon->out_s);
-        if (rdpClientConSendMsg(dev, clientCon) != 0)
+        if (rdpClientConSendMsg(dev, clientCon, fd) != 0)
         {
             LLOGLN(0, ("rdpClientConSendPending: rdpClientConSendMsg failed"));
             rv = 1;
@@ -542,89 +701,90 @@ rdpClientConSendPending(rdpPtr dev, rdpClientCon *clientCon)
 }
 
 /******************************************************************************/
-/* returns error */
 static int
-rdpClientConRecv(rdpPtr dev, rdpClientCon *clientCon, char *data, int len)
+rdpClientConSendPending(rdpPtr dev, rdpClientCon *clientCon)
+{
+    return rdpClientConSendPendingFd(dev, clientCon, -1);
+}
+
+/******************************************************************************/
+/* send a frame update and its shm fd, counting the send calls it took */
+static int
+rdpClientConSendPaint(rdpPtr dev, rdpClientCon *clientCon, int fd)
+{
+    int syscalls;
+    int rv;
+
+    syscalls = clientCon->out_queue.syscalls;
+    rv = rdpClientConSendPendingFd(dev, clientCon, fd);
+    clientCon->paint_frames++;
+    clientCon->paint_syscalls += clientCon->out_queue.syscalls - syscalls;
+    return rv;
+}
+
+/******************************************************************************/
+/* read what the socket has into in_s after the bytes already there
+   returns bytes read, 0 when there is nothing to read, -1 when the
+   connection is lost */
+static int
+rdpClientConRecv(rdpPtr dev, rdpClientCon *clientCon)
 {
+    struct stream *s;
     int rcvd;
 
     if (!clientCon->connected)
     {
-        return 1;
+        return -1;
     }
-
-    while (len > 0)
+    s = clientCon->in_s;
+    rcvd = g_sck_recv(clientCon->sck, s->end,
+                      (int) ((s->data + s->size) - s->end), 0);
+    if (rcvd == -1)
     {
-        rcvd = g_sck_recv(clientCon->sck, data, len, 0);
-
-        if (rcvd == -1)
-        {
-            if (g_sck_last_error_would_block(clientCon->sck))
-            {
-                g_sleep(1);
-            }
-            else
-            {
-                LLOGLN(0, ("rdpClientConRecv: g_sck_recv failed(returned -1)"));
-                clientCon->connected = FALSE;
-                return 1;
-            }
-        }
-        else if (rcvd == 0)
-        {
-            LLOGLN(0, ("rdpClientConRecv: g_sck_recv failed(returned 0)"));
-            clientCon->connected = FALSE;
-            return 1;
-        }
-        else
+        if (g_sck_last_error_would_block(clientCon->sck))
         {
-            data += rcvd;
-            len -= rcvd;
+            return 0;
         }
+        LLOGLN(0, ("rdpClientConRecv: g_sck_recv failed(returned -1)"));
+        rdpClientConLost(dev, clientCon);
+        return -1;
     }
-
-    return 0;
+    if (rcvd == 0)
+    {
+        LLOGLN(0, ("rdpClientConRecv: g_sck_recv failed(returned 0)"));
+        rdpClientConLost(dev, clientCon);
+        return -1;
+    }
+    s->end += rcvd;
+    return rcvd;
 }
 
 /******************************************************************************/
-static int
-rdpClientConRecvMsg(rdpPtr dev, rdpClientCon *clientCon)
+/* move the unprocessed bytes, from p to end, to the front of in_s and
+   grow it so a message of bytes fits */
+static void
+rdpClientConRecvMakeRoom(rdpClientCon *clientCon, int bytes)
 {
-    int len;
-    int rv;
     struct stream *s;
-
-    rv = 1;
+    char *data;
+    int kept;
 
     s = clientCon->in_s;
-    if (s != 0)
+    kept = (int) (s->end - s->p);
+    if (bytes > s->size)
     {
-        init_stream(s, 4);
-        rv = rdpClientConRecv(dev, clientCon, s->data, 4);
-
-        if (rv == 0)
-        {
-            s->end = s->data + 4;
-            in_uint32_le(s, len);
-
-            if (len > 3)
-            {
-                init_stream(s, len);
-                rv = rdpClientConRecv(dev, clientCon, s->data, len - 4);
-                if (rv == 0)
-                {
-                    s->end = s->data + len;
-                }
-            }
-        }
+        data = g_new(char, bytes);
+        memcpy(data, s->p, kept);
+        free(s->data);
+        s->data = data;
+        s->size = bytes;
     }
-
-    if (rv != 0)
+    else if (s->p != s->data)
     {
-        LLOGLN(0, ("rdpClientConRecvMsg: error"));
+        memmove(s->data, s->p, kept);
     }
-
-    return rv;
+    s->p = s->data;
+    s->end = s->data + kept;
 }
 
 /******************************************************************************/
@@ -690,12 +850,47 @@ rdpClientConProcessMsgVersion(rdpPtr dev, rdpClientCon *clientCon,
     return 0;
 }
 
+/******************************************************************************/
+static void
+rdpClientConFreeSharedMemory(rdpClientCon *clientCon)
+{
+    int index;
+
+    for (index = 0; index < XRDP_MAX_SHM_SLOTS; index++)
+    {
+        if (clientCon->shm_slot_ptr[index] != NULL)
+        {
+            g_free_unmap_fd(clientCon->shm_slot_ptr[index],
+                            clientCon->shm_slot_fd[index],
+                            clientCon->shmem_bytes);
+            clientCon->shm_slot_ptr[index] = NULL;
+        }
+        clientCon->shm_slot_fd[index] = -1;
+        clientCon->shm_slot_frame_id[index] = 0;
+        if (clientCon->shm_slot_stale[index] != NULL)
+        {
+            rdpRegionDestroy(clientCon->shm_slot_stale[index]);
+            clientCon->shm_slot_stale[index] = NULL;
+        }
+    }
+    clientCon->shmemptr = NULL;
+    clientCon->shmemfd = -1;
+    clientCon->shmem_bytes = 0;
+    clientCon->shm_slot = 0;
+    clientCon->shm_registered = 0;
+}
+
 /**************************************************************************//**
  * Allocate shared memory
  *
  * This memory is shared with the xup driver in xrdp which avoids a lot
  * of unnecessary copying
  *
+ * One area of the given size is allocated for each slot in the frame
+ * ring so captures can continue while xrdp still encodes earlier frames
+ *
+ * With "HugePages" the areas are rounded up to whole huge pages
+ *
  * @param clientCon Client connection
  * @param bytes Size of area to attach
  */
@@ -704,34 +899,125 @@ rdpClientConAllocateSharedMemory(rdpClientCon *clientCon, int bytes)
 {
     void *shmemptr;
     int shmemfd;
+    int index;
+    int count;
+    int rv;
 
-    if (clientCon->shmemptr != NULL && clientCon->shmem_bytes == bytes)
+    count = RDPCLAMP(clientCon->dev->shm_slots, 1, XRDP_MAX_SHM_SLOTS);
+    if (clientCon->dev->huge_pages)
+    {
+        bytes = g_huge_page_round(bytes);
+    }
+    if (clientCon->shmemptr != NULL && clientCon->shmem_bytes == bytes &&
+        clientCon->shm_slot_count == count)
     {
         LLOGLN(0, ("rdpClientConAllocateSharedMemory: reusing shmemfd %d",
                clientCon->shmemfd));
         return;
     }
-    if (clientCon->shmemptr != NULL)
+    rdpClientConFreeSharedMemory(clientCon);
+    clientCon->shmem_bytes = bytes;
+    for (index = 0; index < count; index++)
+    {
+        if (clientCon->dev->huge_pages)
+        {
+            rv = g_alloc_huge_map_fd(&shmemptr, &shmemfd, bytes);
+        }
+        else
+        {
+            rv = g_alloc_shm_map_fd(&shmemptr, &shmemfd, bytes);
+        }
+        if (rv != 0)
+        {
+            LLOGLN(0, ("rdpClientConAllocateSharedMemory: allocation "
+                   "failed for slot %d", index));
+            break;
+        }
+        clientCon->shm_slot_ptr[index] = (uint8_t *)shmemptr;
+        clientCon->shm_slot_fd[index] = shmemfd;
+        clientCon->shm_slot_stale[index] = rdpRegionCreate(NullBox, 0);
+        LLOGLN(0, ("rdpClientConAllocateSharedMemory: slot %d shmemfd %d "
+               "shmemptr %p bytes %d", index, shmemfd, shmemptr, bytes));
+    }
+    if (index < 1)
     {
-        g_free_unmap_fd(clientCon->shmemptr,
-                        clientCon->shmemfd,
-                        clientCon->shmem_bytes);
-        clientCon->shmemptr = NULL;
-        clientCon->shmemfd = -1;
         clientCon->shmem_bytes = 0;
+        return;
     }
-    if (g_alloc_shm_map_fd(&shmemptr, &shmemfd, bytes) != 0)
+    /* run with the slots we got */
+    clientCon->shm_slot_count = index;
+    clientCon->shmemptr = clientCon->shm_slot_ptr[0];
+    clientCon->shmemfd = clientCon->shm_slot_fd[0];
+}
+
+/******************************************************************************/
+/* returns boolean, true when every slot of the shm frame ring holds a
+   frame xrdp has not acked yet */
+static int
+rdpClientConShmRingFull(rdpClientCon *clientCon)
+{
+    return (clientCon->rect_id - clientCon->rect_id_ack) >=
+           clientCon->shm_slot_count;
+}
+
+/******************************************************************************/
+/* returns boolean, true if the encoder reads whole frames from the slot,
+   so areas captured into the other slots have to be copied in too */
+static int
+rdpClientConShmRingTracksStale(rdpClientCon *clientCon)
+{
+    int capture_code;
+
+    capture_code = clientCon->client_info.capture_code;
+    return (clientCon->shm_slot_count > 1) &&
+           ((capture_code == 3) || (capture_code == 5));
+}
+
+/******************************************************************************/
+/* point clientCon and id at the slot the next frame will be captured into,
+   xrdp acks in order so it holds an acked frame if the ring is not full */
+static void
+rdpClientConSelectShmSlot(rdpClientCon *clientCon, struct image_data *id)
+{
+    int slot;
+
+    slot = (clientCon->rect_id + 1) % clientCon->shm_slot_count;
+    if (clientCon->shm_slot_ptr[slot] == NULL)
     {
-        LLOGLN(0, ("rdpClientConAllocateSharedMemory: g_alloc_shm_map_fd "
-               "failed"));
+        return;
     }
-    clientCon->shmemptr = shmemptr;
-    clientCon->shmemfd = shmemfd;
-    clientCon->shmem_bytes = bytes;
-    LLOGLN(0, ("rdpClientConAllocateSharedMemory: shmemfd %d shmemptr %p "
-            "bytes %d",
-            clientCon->shmemfd, clientCon->shmemptr,
-            clientCon->shmem_bytes));
+    LLOGLN(10, ("rdpClientConSelectShmSlot: slot %d last frame_id %d "
+           "rect_id_ack %d", slot, clientCon->shm_slot_frame_id[slot],
+           clientCon->rect_id_ack));
+    clientCon->shm_slot = slot;
+    clientCon->shmemptr = clientCon->shm_slot_ptr[slot];
+    clientCon->shmemfd = clientCon->shm_slot_fd[slot];
+    id->shmem_pixels = clientCon->shmemptr + id->shmem_offset;
+    id->shmem_fd = clientCon->shmemfd;
+}
+
+/******************************************************************************/
+/* returns boolean, true if xrdp can read the capture straight out of the
+   shared frame buffer, see "ZeroCopy" */
+static int
+rdpClientConZeroCopy(rdpPtr dev, rdpClientCon *clientCon)
+{
+    return (dev->fb_fd != -1) &&
+           (clientCon->client_info.capture_code == 0) &&
+           (clientCon->rdp_format == XRDP_a8r8g8b8) &&
+           (clientCon->cap_width == dev->width) &&
+           (clientCon->cap_height == dev->height) &&
+           (clientCon->cap_stride_bytes == dev->paddedWidthInBytes);
+}
+
+/******************************************************************************/
+/* returns the bytes a monitor takes in the shm slot with rfx, the tiles
+   are packed one after the other */
+static int
+rdpClientConRfxSurfaceBytes(int width, int height)
+{
+    return RDPALIGN(width, XRDP_RFX_ALIGN) *
+           RDPALIGN(height, XRDP_RFX_ALIGN) * 4;
 }
 
 /******************************************************************************/
@@ -766,6 +1052,9 @@ static void
 rdpClientConResizeAllMemoryAreas(rdpPtr dev, rdpClientCon *clientCon)
 {
     int bytes;
+    int index;
+    int monitor_bytes;
+    struct monitor_info *minfo;
     int width = clientCon->client_info.display_sizes.session_width;
     int height = clientCon->client_info.display_sizes.session_height;
 
@@ -788,6 +1077,23 @@ rdpClientConResizeAllMemoryAreas(rdpPtr dev, rdpClientCon *clientCon)
 
         bytes = clientCon->cap_width * clientCon->cap_height *
                 clientCon->rdp_Bpp;
+        if ((clientCon->client_info.capture_code == 4) &&
+            clientCon->dev->monitor_frames)
+        {
+            /* a gfx frame holds the tiles of every monitor, each
+               aligned on its own, see rdpCapMonitors */
+            monitor_bytes = 0;
+            minfo = clientCon->client_info.display_sizes.minfo;
+            for (index = 0;
+                 index < clientCon->client_info.display_sizes.monitorCount;
+                 index++)
+            {
+                monitor_bytes += rdpClientConRfxSurfaceBytes(
+                    minfo[index].right - minfo[index].left + 1,
+                    minfo[index].bottom - minfo[index].top + 1);
+            }
+            bytes = RDPMAX(bytes, monitor_bytes);
+        }
 
         clientCon->shmem_lineBytes = clientCon->rdp_Bpp * clientCon->cap_width;
         clientCon->cap_stride_bytes = clientCon->cap_width * 4;
@@ -817,7 +1123,6 @@ rdpClientConResizeAllMemoryAreas(rdpPtr dev, rdpClientCon *clientCon)
         clientCon->cap_stride_bytes = clientCon->cap_width * clientCon->rdp_Bpp;
         shmemstatus = SHM_ACTIVE_PENDING;
     }
-    rdpClientConAllocateSharedMemory(clientCon, bytes);
 
     if (clientCon->client_info.capture_format != 0)
     {
@@ -878,6 +1183,25 @@ rdpClientConResizeAllMemoryAreas(rdpPtr dev, rdpClientCon *clientCon)
         LLOGLN(0, ("rdpClientConProcessScreenSizeMsg: RRScreenSizeSet ok=[%d]", ok));
     }
 
+    /* the frame buffer can only be shared once the screen has the
+       client size */
+    if (rdpClientConZeroCopy(dev, clientCon))
+    {
+        LLOGLN(0, ("rdpClientConResizeAllMemoryAreas: zero copy, fb_fd %d "
+               "fb_bytes %d", dev->fb_fd, dev->fb_bytes));
+        rdpClientConFreeSharedMemory(clientCon);
+        /* xrdp reads the live frame buffer, one frame in flight */
+        clientCon->shm_slot_count = 1;
+        clientCon->zero_copy = 1;
+        clientCon->fb_gen_sent = 0;
+    }
+    else
+    {
+        clientCon->zero_copy = 0;
+        rdpClientConAllocateSharedMemory(clientCon, bytes);
+    }
+    clientCon->pacing.slots = RDPMAX(clientCon->shm_slot_count, 1);
+
     rdpCaptureResetState(clientCon);
 
     if (clientCon->shmemstatus == SHM_UNINITIALIZED
@@ -920,14 +1244,105 @@ rdpClientConProcessMonitorUpdateMsg(rdpPtr dev, rdpClientCon *clientCon,
 }
 
 /******************************************************************************/
-static int
-rdpClientConProcessMsgClientInput(rdpPtr dev, rdpClientCon *clientCon)
+/* post the motion held back by rdpClientConInputEvent */
+static void
+rdpClientConFlushMotion(rdpPtr dev, rdpClientCon *clientCon)
 {
-    struct stream *s;
-    int msg;
-    int param1;
-    int param2;
-    int param3;
+    if (clientCon->motion_pending)
+    {
+        clientCon->motion_pending = 0;
+        rdpInputMouseEvent(dev, 100, clientCon->motion_x, clientCon->motion_y,
+                           0, 0);
+    }
+}
+
+/******************************************************************************/
+/* a keyboard or mouse event, only the last of a run of motions is posted,
+   at the next other event or the end of the wakeup, so buttons and keys
+   keep their order and position */
+static void
+rdpClientConInputEvent(rdpPtr dev, rdpClientCon *clientCon, int msg,
+                       int param1, int param2, int param3, int param4)
+{
+    rdpLatencyInput(&(clientCon->latency));
+    if (msg == 100) /* WM_MOUSEMOVE */
+    {
+        if (clientCon->motion_pending)
+        {
+            clientCon->motion_coalesced++;
+        }
+        clientCon->motion_pending = 1;
+        clientCon->motion_x = param1;
+        clientCon->motion_y = param2;
+        return;
+    }
+    rdpClientConFlushMotion(dev, clientCon);
+    if (msg < 100)
+    {
+        rdpInputKeyboardEvent(dev, msg, param1, param2, param3, param4);
+    }
+    else
+    {
+        rdpInputMouseEvent(dev, msg, param1, param2, param3, param4);
+    }
+}
+
+/******************************************************************************/
+/* many keyboard and mouse events in one message, a count then msg and
+   four params each, as in msg 103, msg_end is the end of this message,
+   in_s can hold more messages after it */
+static int
+rdpClientConProcessMsgClientInputBatch(rdpPtr dev, rdpClientCon *clientCon,
+                                       const char *msg_end)
+{
+    struct stream *s;
+    int count;
+    int index;
+    int msg;
+    int param1;
+    int param2;
+    int param3;
+    int param4;
+
+    s = clientCon->in_s;
+    in_uint32_le(s, count);
+    LLOGLN(10, ("rdpClientConProcessMsgClientInputBatch: count %d", count));
+    if ((count < 0) || (count > (int) ((msg_end - s->p) / 20)))
+    {
+        LLOGLN(0, ("rdpClientConProcessMsgClientInputBatch: bad count %d",
+               count));
+        return 1;
+    }
+    for (index = 0; index < count; index++)
+    {
+        in_uint32_le(s, msg);
+        in_uint32_le(s, param1);
+        in_uint32_le(s, param2);
+        in_uint32_le(s, param3);
+        in_uint32_le(s, param4);
+        if (msg < 200)
+        {
+            rdpClientConInputEvent(dev, clientCon, msg,
+                                   param1, param2, param3, param4);
+        }
+        else
+        {
+            LLOGLN(0, ("rdpClientConProcessMsgClientInputBatch: msg %d "
+                   "not input", msg));
+        }
+    }
+    return 0;
+}
+
+/******************************************************************************/
+static int
+rdpClientConProcessMsgClientInput(rdpPtr dev, rdpClientCon *clientCon)
+{
+    struct stream *s;
+    int msg;
+    int param1;
+    int param2;
+    int param3;
     int param4;
     int x;
     int y;
@@ -944,15 +1359,14 @@ rdpClientConProcessMsgClientInput(rdpPtr dev, rdpClientCon *clientCon)
     LLOGLN(10, ("rdpClientConProcessMsgClientInput: msg %d param1 %d param2 %d "
            "param3 %d param4 %d", msg, param1, param2, param3, param4));
 
-    if (msg < 100)
-    {
-        rdpInputKeyboardEvent(dev, msg, param1, param2, param3, param4);
-    }
-    else if (msg < 200)
+    if (msg < 200)
     {
-        rdpInputMouseEvent(dev, msg, param1, param2, param3, param4);
+        rdpClientConInputEvent(dev, clientCon, msg,
+                               param1, param2, param3, param4);
+        return 0;
     }
-    else if (msg == 200) /* invalidate */
+    rdpClientConFlushMotion(dev, clientCon);
+    if (msg == 200) /* invalidate */
     {
         x = (param1 >> 16) & 0xffff;
         y = param1 & 0xffff;
@@ -998,6 +1412,42 @@ rdpClientConProcessMsgClientInput(rdpPtr dev, rdpClientCon *clientCon)
 int
 rdpClientConPreCheck(rdpPtr dev, rdpClientCon *clientCon, int in_size);
 
+/******************************************************************************/
+/* pass xrdp the fd of each shm slot once, paints then name the slot, see
+   "ShmRegister", done again only when the slots are reallocated
+   returns error */
+static int
+rdpClientConRegisterSharedMemory(rdpPtr dev, rdpClientCon *clientCon)
+{
+    int index;
+    int rv;
+
+    if (!dev->shm_register || clientCon->zero_copy ||
+        clientCon->shm_registered || (clientCon->shmem_bytes < 1))
+    {
+        return 0;
+    }
+    for (index = 0; index < clientCon->shm_slot_count; index++)
+    {
+        rdpClientConPreCheck(dev, clientCon, 12);
+        out_uint16_le(clientCon->out_s, 65); /* register shm buffer */
+        out_uint16_le(clientCon->out_s, 12); /* size */
+        clientCon->count++;
+        out_uint32_le(clientCon->out_s, index); /* buffer id */
+        out_uint32_le(clientCon->out_s, clientCon->shmem_bytes);
+        rv = rdpClientConSendPendingFd(dev, clientCon,
+                                       clientCon->shm_slot_fd[index]);
+        if (rv != 0)
+        {
+            return rv;
+        }
+    }
+    LLOGLN(0, ("rdpClientConRegisterSharedMemory: %d buffers of %d bytes",
+           clientCon->shm_slot_count, clientCon->shmem_bytes));
+    clientCon->shm_registered = 1;
+    return 0;
+}
+
 /******************************************************************************/
 static int
 rdpSendMemoryAllocationComplete(rdpPtr dev, rdpClientCon *clientCon)
@@ -1043,9 +1493,48 @@ rdpSendMemoryAllocationComplete(rdpPtr dev, rdpClientCon *clientCon)
     out_uint16_le(clientCon->out_s, clientCon->count);
     out_uint32_le(clientCon->out_s, len - layer_size);
     rv = rdpClientConSend(dev, clientCon, clientCon->out_s->data, len);
+    if (rv == 0)
+    {
+        rv = rdpClientConRegisterSharedMemory(dev, clientCon);
+    }
     return rv;
 }
 
+/******************************************************************************/
+/* per monitor flow control starts over, the monitors or the shm slots
+   changed */
+static void
+rdpClientConMonitorFlowInit(rdpPtr dev, rdpClientCon *clientCon)
+{
+    int index;
+
+    memset(clientCon->monitors, 0, sizeof(clientCon->monitors));
+    for (index = 0; index < dev->monitorCount; index++)
+    {
+        rdpPacingInit(&(clientCon->monitors[index].pacing),
+                      dev->min_fps, dev->max_fps,
+                      clientCon->shm_slot_count);
+    }
+}
+
+/******************************************************************************/
+/* xrdp acked clientCon->rect_id_ack, and all frames before it */
+static void
+rdpClientConMonitorFlowAcked(rdpPtr dev, rdpClientCon *clientCon)
+{
+    int index;
+
+    if (!dev->monitor_frames)
+    {
+        return;
+    }
+    for (index = 0; index < dev->monitorCount; index++)
+    {
+        rdpPacingFrameAcked(&(clientCon->monitors[index].pacing),
+                            clientCon->rect_id_ack);
+    }
+}
+
 /******************************************************************************/
 /**
  * Process the monitors in the client_info
@@ -1098,6 +1587,7 @@ rdpClientConProcessClientInfoMonitors(rdpPtr dev, rdpClientCon *clientCon)
         dev->doMultimon = 0;
         dev->monitorCount = 0;
     }
+    rdpClientConMonitorFlowInit(dev, clientCon);
 
     rdpRRSetRdpOutputs(dev);
     RRTellChanged(dev->pScreen);
@@ -1241,6 +1731,11 @@ rdpClientConProcessMsgClientRegion(rdpPtr dev, rdpClientCon *clientCon)
 
     in_uint32_le(s, flags);
     in_uint32_le(s, clientCon->rect_id_ack);
+    rdpPacingFrameAcked(&(clientCon->pacing), clientCon->rect_id_ack);
+    rdpClientConMonitorFlowAcked(dev, clientCon);
+    rdpLatencyFrameAcked(&(clientCon->latency), clientCon->rect_id_ack);
+    RDP_TRACE(&(dev->trace), ack, 'i', clientCon->conNumber,
+              clientCon->rect_id_ack, clientCon->rect_id);
     in_uint32_le(s, x);
     in_uint32_le(s, y);
     in_uint32_le(s, cx);
@@ -1281,6 +1776,11 @@ rdpClientConProcessMsgClientRegionEx(rdpPtr dev, rdpClientCon *clientCon)
         // Client just wishes to ack all in-flight frames
         clientCon->rect_id_ack = clientCon->rect_id;
     }
+    rdpPacingFrameAcked(&(clientCon->pacing), clientCon->rect_id_ack);
+    rdpClientConMonitorFlowAcked(dev, clientCon);
+    rdpLatencyFrameAcked(&(clientCon->latency), clientCon->rect_id_ack);
+    RDP_TRACE(&(dev->trace), ack, 'i', clientCon->conNumber,
+              clientCon->rect_id_ack, clientCon->rect_id);
     LLOGLN(10, ("rdpClientConProcessMsgClientRegionEx: flags 0x%8.8x", flags));
     LLOGLN(10, ("rdpClientConProcessMsgClientRegionEx: rect_id %d "
            "rect_id_ack %d", clientCon->rect_id, clientCon->rect_id_ack));
@@ -1319,7 +1819,8 @@ rdpClientConProcessMsgClientSuppressOutput(rdpPtr dev, rdpClientCon *clientCon)
 
 /******************************************************************************/
 static int
-rdpClientConProcessMsg(rdpPtr dev, rdpClientCon *clientCon)
+rdpClientConProcessMsg(rdpPtr dev, rdpClientCon *clientCon,
+                       const char *msg_end)
 {
     int msg_type;
     struct stream *s;
@@ -1342,6 +1843,9 @@ rdpClientConProcessMsg(rdpPtr dev, rdpClientCon *clientCon)
         case 106: /* client region ex */
             rdpClientConProcessMsgClientRegionEx(dev, clientCon);
             break;
+        case 107: /* client input batch */
+            rdpClientConProcessMsgClientInputBatch(dev, clientCon, msg_end);
+            break;
         case 108: /* client suppress output */
             rdpClientConProcessMsgClientSuppressOutput(dev, clientCon);
             break;
@@ -1355,47 +1859,306 @@ rdpClientConProcessMsg(rdpPtr dev, rdpClientCon *clientCon)
 }
 
 /******************************************************************************/
+/* in_s holds what was read and not processed yet, from p to end, a message
+   is only processed once all of it is there so a slow xrdp never makes
+   the X server wait
+   returns error */
 static int
 rdpClientConGotData(ScreenPtr pScreen, rdpPtr dev, rdpClientCon *clientCon)
 {
-    int rv;
+    struct stream *s;
+    char *msg;
+    int len;
+    int need;
 
     LLOGLN(10, ("rdpClientConGotData:"));
 
-    rv = rdpClientConRecvMsg(dev, clientCon);
-    if (rv == 0)
+    s = clientCon->in_s;
+    for (;;)
+    {
+        /* every complete message in the buffer */
+        need = 4;
+        while (clientCon->connected && ((s->end - s->p) >= 4))
+        {
+            msg = s->p;
+            in_uint32_le(s, len);
+            if ((len < 4) || (len > XRDP_MAX_IN_MSG_BYTES))
+            {
+                LLOGLN(0, ("rdpClientConGotData: bad message length %d",
+                       len));
+                rdpClientConLost(dev, clientCon);
+                return 1;
+            }
+            if ((s->end - msg) < len)
+            {
+                /* the rest comes with a later read */
+                s->p = msg;
+                need = len;
+                break;
+            }
+            if (len >= 6)
+            {
+                rdpClientConProcessMsg(dev, clientCon, msg + len);
+            }
+            s->p = msg + len;
+        }
+        if (!clientCon->connected)
+        {
+            return 1;
+        }
+        rdpClientConRecvMakeRoom(clientCon, need);
+        len = rdpClientConRecv(dev, clientCon);
+        if (len < 1)
+        {
+            /* the last position of the wakeup */
+            rdpClientConFlushMotion(dev, clientCon);
+            return (len < 0) ? 1 : 0;
+        }
+    }
+}
+
+/******************************************************************************/
+/* the counters of clientCon as text, a name and a value to a line
+   returns the length written */
+static int
+rdpClientConStatsText(rdpClientCon *clientCon, char *text, int bytes)
+{
+    const struct rdp_con_stats *stats;
+    const struct rdp_out_queue *queue;
+    const struct rdp_latency_hist *capture;
+    const struct rdp_monitor_flow *flow;
+    int len;
+    int index;
+
+    stats = &(clientCon->stats);
+    queue = &(clientCon->out_queue);
+    capture = &(clientCon->latency.capture);
+    len = snprintf(text, bytes,
+                   "con %d\n"
+                   "frames_captured %d\n"
+                   "ack_waits %d\n"
+                   "dirty_pixels %llu\n"
+                   "converted_pixels %llu\n"
+                   "crc_tiles %d\n"
+                   "crc_skips %d\n"
+                   "crc_skip_percent %d\n"
+                   "bytes_sent %llu\n"
+                   "fds_sent %d\n"
+                   "send_calls %d\n"
+                   "send_stalls %d\n"
+                   "queued_bytes %d\n"
+                   "capture_us_p50 %d\n"
+                   "capture_us_p90 %d\n"
+                   "capture_us_p99 %d\n"
+                   "capture_us_max %d\n",
+                   clientCon->conNumber,
+                   stats->frames_captured,
+                   stats->ack_waits,
+                   (unsigned long long) stats->dirty_pixels,
+                   (unsigned long long) stats->converted_pixels,
+                   stats->crc_tiles,
+                   stats->crc_skips,
+                   (stats->crc_tiles > 0) ?
+                   (int) ((int64_t) stats->crc_skips * 100 /
+                          stats->crc_tiles) : 0,
+                   (unsigned long long) queue->bytes_sent,
+                   queue->fds_sent,
+                   queue->syscalls,
+                   queue->stalls,
+                   queue->bytes,
+                   rdpLatencyHistPercentile(capture, 50),
+                   rdpLatencyHistPercentile(capture, 90),
+                   rdpLatencyHistPercentile(capture, 99),
+                   capture->max_us);
+    len = RDPCLAMP(len, 0, bytes - 1);
+    if (rdpClientConMonitorsFit(clientCon))
+    {
+        for (index = 0; index < clientCon->dev->monitorCount; index++)
+        {
+            flow = clientCon->monitors + index;
+            len += snprintf(text + len, bytes - len,
+                            "mon%d_frames %d\n"
+                            "mon%d_ack_waits %d\n"
+                            "mon%d_interval_ms %d\n",
+                            index, flow->frames,
+                            index, flow->ack_waits,
+                            index, flow->pacing.interval_ms);
+            len = RDPCLAMP(len, 0, bytes - 1);
+        }
+    }
+    return len;
+}
+
+/******************************************************************************/
+/* log the counters of every connection */
+static void
+rdpClientConDumpStats(rdpPtr dev)
+{
+    rdpClientCon *clientCon;
+    char text[2048];
+
+    for (clientCon = dev->clientConHead;
+            clientCon != NULL;
+            clientCon = clientCon->next)
     {
-        rv = rdpClientConProcessMsg(dev, clientCon);
+        rdpClientConStatsText(clientCon, text, sizeof(text));
+        LLOGLN(0, ("rdpClientConDumpStats:\n%s", text));
     }
+}
 
-    return rv;
+/******************************************************************************/
+/* write the trace ring next to the display socket, see "TraceEvents" */
+static void
+rdpClientConDumpTrace(rdpPtr dev)
+{
+    char filename[256];
+
+    if (dev->trace.events == NULL)
+    {
+        return;
+    }
+    snprintf(filename, sizeof(filename), "%s/xrdp_display_%s_trace.json",
+             g_socket_dir(), display);
+    rdpTraceDump(&(dev->trace), filename);
 }
 
 /******************************************************************************/
+/* one reader at a time, a new one replaces the last */
 static int
 rdpClientConGotControlConnection(ScreenPtr pScreen, rdpPtr dev,
                                  rdpClientCon *clientCon)
 {
+    int sck;
+
     LLOGLN(0, ("rdpClientConGotControlConnection:"));
+    sck = g_sck_accept(clientCon->sckControlListener);
+    if (sck == -1)
+    {
+        LLOGLN(0, ("rdpClientConGotControlConnection: g_sck_accept failed"));
+        return 1;
+    }
+    rdpClientConControlCloseCon(clientCon);
+    g_sck_set_non_blocking(sck);
+    clientCon->sckControl = sck;
+    rdpClientConAddEnabledDevice(sck, rdpClientConNotifyControl, clientCon);
     return 0;
 }
 
 /******************************************************************************/
+/* any request gets the counters, "trace" also writes the trace ring */
 static int
 rdpClientConGotControlData(ScreenPtr pScreen, rdpPtr dev,
                            rdpClientCon *clientCon)
 {
-    LLOGLN(0, ("rdpClientConGotControlData:"));
+    char text[2048];
+    int len;
+
+    LLOGLN(10, ("rdpClientConGotControlData:"));
+    len = g_sck_recv(clientCon->sckControl, text, sizeof(text), 0);
+    if ((len == -1) && g_sck_last_error_would_block(clientCon->sckControl))
+    {
+        return 0;
+    }
+    if (len < 1)
+    {
+        rdpClientConControlCloseCon(clientCon);
+        return 0;
+    }
+    if ((len >= 5) && (strncmp(text, "trace", 5) == 0))
+    {
+        rdpClientConDumpTrace(dev);
+    }
+    len = rdpClientConStatsText(clientCon, text, sizeof(text));
+    if (g_sck_send(clientCon->sckControl, text, len, 0) != len)
+    {
+        LLOGLN(0, ("rdpClientConGotControlData: reply not sent"));
+        rdpClientConControlCloseCon(clientCon);
+    }
+    return 0;
+}
+
+/******************************************************************************/
+static void
+rdpClientConSigUsr1(int sig)
+{
+    int save_errno;
+
+    save_errno = errno;
+    if (write(g_stats_pipe_write, "s", 1) < 0)
+    {
+        /* full, a dump is pending already */
+    }
+    errno = save_errno;
+}
+
+/******************************************************************************/
+/* log the counters of every connection on SIGUSR1, from the main loop by
+   way of a pipe, only with "StatsSignal", SIGUSR1 is left alone
+   otherwise
+   returns error */
+static int
+rdpClientConStatsSignalInit(rdpPtr dev)
+{
+    struct sigaction sa;
+    int fds[2];
+
+    if (pipe(fds) != 0)
+    {
+        LLOGLN(0, ("rdpClientConStatsSignalInit: pipe failed"));
+        return 1;
+    }
+    g_sck_set_non_blocking(fds[0]);
+    g_sck_set_non_blocking(fds[1]);
+    dev->stats_fd = fds[0];
+    g_stats_pipe_write = fds[1];
+    rdpClientConAddEnabledDevice(dev->stats_fd, rdpClientConNotifyStats, dev);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = rdpClientConSigUsr1;
+    sigemptyset(&(sa.sa_mask));
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, &g_old_sigusr1);
     return 0;
 }
 
 /******************************************************************************/
+static void
+rdpClientConStatsSignalDeinit(rdpPtr dev)
+{
+    if (dev->stats_fd == 0)
+    {
+        return;
+    }
+    sigaction(SIGUSR1, &g_old_sigusr1, NULL);
+    rdpClientConRemoveEnabledDevice(dev->stats_fd);
+    close(dev->stats_fd);
+    close(g_stats_pipe_write);
+    dev->stats_fd = 0;
+    g_stats_pipe_write = -1;
+}
+
+/******************************************************************************/
+/* log the counters and write out the trace ring, see "TraceEvents" */
+static void
+rdpClientConGotStatsSignal(rdpPtr dev)
+{
+    char buf[256];
+
+    while (read(dev->stats_fd, buf, sizeof(buf)) > 0)
+    {
+    }
+    rdpClientConDumpStats(dev);
+    rdpClientConDumpTrace(dev);
+}
+
+#if XORG_VERSION_CURRENT < XORG_VERSION_NUMERIC(1, 18, 5, 0, 0)
+
+/******************************************************************************/
+/* servers without SetNotifyFd, poll all the fds from the wakeup handler */
 int
 rdpClientConCheck(ScreenPtr pScreen)
 {
     rdpPtr dev;
     rdpClientCon *clientCon;
-    rdpClientCon *nextCon;
     fd_set rfds;
     struct timeval time;
     int max;
@@ -1424,18 +2187,23 @@ rdpClientConCheck(ScreenPtr pScreen)
         FD_SET(LTOUI32(dev->listen_sck), &rfds);
         max = RDPMAX(dev->listen_sck, max);
     }
+
+    if (dev->stats_fd > 0)
+    {
+        count++;
+        FD_SET(LTOUI32(dev->stats_fd), &rfds);
+        max = RDPMAX(dev->stats_fd, max);
+    }
+    for (clientCon = dev->clientConHead;
+            clientCon != NULL;
+            clientCon = clientCon->next)
+    {
+        rdpClientConFlush(dev, clientCon);
+    }
+    rdpClientConReap(dev);
     clientCon = dev->clientConHead;
     while (clientCon != NULL)
     {
-        if (!clientCon->connected)
-        {
-            /* I/O error on this client - remove it */
-            nextCon = clientCon->next;
-            rdpClientConDisconnect(dev, clientCon);
-            clientCon = nextCon;
-            continue;
-        }
-
         if (clientCon->sck > 0)
         {
             count++;
@@ -1478,6 +2246,14 @@ rdpClientConCheck(ScreenPtr pScreen)
         }
     }
 
+    if (dev->stats_fd > 0)
+    {
+        if (FD_ISSET(LTOUI32(dev->stats_fd), &rfds))
+        {
+            rdpClientConGotStatsSignal(dev);
+        }
+    }
+
     if (dev->disconnect_sck > 0)
     {
         if (FD_ISSET(LTOUI32(dev->disconnect_sck), &rfds))
@@ -1537,23 +2313,141 @@ rdpClientConCheck(ScreenPtr pScreen)
     return 0;
 }
 
+#endif
+
 /******************************************************************************/
-int
-rdpClientConInit(rdpPtr dev)
+static void
+rdpClientConNotifyListen(int fd, int ready, void *data)
 {
-    int i;
-    char *ptext;
-    char *endptr = NULL;
-    const char *socket_dir;
+    rdpPtr dev;
 
-    socket_dir = g_socket_dir();
-    if (!g_directory_exist(socket_dir))
-    {
-        if (!g_create_dir(socket_dir))
-        {
-            if (!g_directory_exist(socket_dir))
-            {
-                LLOGLN(0, ("rdpClientConInit: g_create_dir(%s) failed", socket_dir));
+    dev = (rdpPtr) data;
+    LLOGLN(10, ("rdpClientConNotifyListen:"));
+    rdpClientConGotConnection(dev->pScreen, dev);
+    /* the client it replaces */
+    rdpClientConReap(dev);
+}
+
+/******************************************************************************/
+static void
+rdpClientConNotifyDisconnect(int fd, int ready, void *data)
+{
+    rdpPtr dev;
+    char buf[8];
+
+    dev = (rdpPtr) data;
+    LLOGLN(10, ("rdpClientConNotifyDisconnect:"));
+    if (g_sck_recv(dev->disconnect_sck, buf, sizeof(buf), 0))
+    {
+        LLOGLN(0, ("rdpClientConNotifyDisconnect: got disconnection request"));
+
+        /* disconnect all clients */
+        while (dev->clientConHead != NULL)
+        {
+            rdpClientConDisconnect(dev, dev->clientConHead);
+        }
+    }
+}
+
+/******************************************************************************/
+static void
+rdpClientConNotifyControlListen(int fd, int ready, void *data)
+{
+    rdpClientCon *clientCon;
+
+    clientCon = (rdpClientCon *) data;
+    rdpClientConGotControlConnection(clientCon->dev->pScreen, clientCon->dev,
+                                     clientCon);
+}
+
+/******************************************************************************/
+static void
+rdpClientConNotifyControl(int fd, int ready, void *data)
+{
+    rdpClientCon *clientCon;
+
+    clientCon = (rdpClientCon *) data;
+    rdpClientConGotControlData(clientCon->dev->pScreen, clientCon->dev,
+                               clientCon);
+}
+
+/******************************************************************************/
+static void
+rdpClientConNotifyStats(int fd, int ready, void *data)
+{
+    rdpClientConGotStatsSignal((rdpPtr) data);
+}
+
+/******************************************************************************/
+/* send what is in the out queue, captures held back by it can go again
+   once it is empty */
+static void
+rdpClientConFlush(rdpPtr dev, rdpClientCon *clientCon)
+{
+    if (clientCon->out_queue.head == NULL)
+    {
+        return;
+    }
+    if (rdpOutQueueFlush(&(clientCon->out_queue), clientCon->sck) != 0)
+    {
+        LLOGLN(0, ("rdpClientConFlush: rdpOutQueueFlush failed"));
+        rdpClientConLost(dev, clientCon);
+        return;
+    }
+    if (clientCon->out_queue.head == NULL)
+    {
+        rdpClientConWantWrite(clientCon, 0);
+        if (rdpClientConDirtyNotEmpty(clientCon))
+        {
+            rdpScheduleDeferredUpdate(clientCon);
+        }
+    }
+}
+
+/******************************************************************************/
+static void
+rdpClientConNotifyData(int fd, int ready, void *data)
+{
+    rdpClientCon *clientCon;
+    rdpPtr dev;
+
+    clientCon = (rdpClientCon *) data;
+    dev = clientCon->dev;
+    LLOGLN(10, ("rdpClientConNotifyData: ready 0x%x", ready));
+    if (ready & X_NOTIFY_WRITE)
+    {
+        rdpClientConFlush(dev, clientCon);
+    }
+    if ((ready & X_NOTIFY_READ) && clientCon->connected)
+    {
+        if (rdpClientConGotData(dev->pScreen, dev, clientCon) != 0)
+        {
+            LLOGLN(0, ("rdpClientConNotifyData: rdpClientConGotData failed"));
+        }
+    }
+    if (!clientCon->connected)
+    {
+        rdpClientConDisconnect(dev, clientCon);
+    }
+}
+
+/******************************************************************************/
+int
+rdpClientConInit(rdpPtr dev)
+{
+    int i;
+    char *ptext;
+    char *endptr = NULL;
+    const char *socket_dir;
+
+    socket_dir = g_socket_dir();
+    if (!g_directory_exist(socket_dir))
+    {
+        if (!g_create_dir(socket_dir))
+        {
+            if (!g_directory_exist(socket_dir))
+            {
+                LLOGLN(0, ("rdpClientConInit: g_create_dir(%s) failed", socket_dir));
                 return 0;
             }
         }
@@ -1581,7 +2475,8 @@ rdpClientConInit(rdpPtr dev)
         }
         g_sck_listen(dev->listen_sck);
         g_chmod_hex(dev->uds_data, 0x0660);
-        rdpClientConAddEnabledDevice(dev->pScreen, dev->listen_sck);
+        rdpClientConAddEnabledDevice(dev->listen_sck,
+                                     rdpClientConNotifyListen, dev);
     }
 
     /* disconnect socket */ /* TODO: don't hardcode socket name */
@@ -1597,7 +2492,17 @@ rdpClientConInit(rdpPtr dev)
         }
         g_sck_listen(dev->disconnect_sck);
         g_chmod_hex(dev->disconnect_uds, 0x0660);
-        rdpClientConAddEnabledDevice(dev->pScreen, dev->disconnect_sck);
+        rdpClientConAddEnabledDevice(dev->disconnect_sck,
+                                     rdpClientConNotifyDisconnect, dev);
+    }
+
+    if (dev->stats_signal && (dev->stats_fd == 0))
+    {
+        rdpClientConStatsSignalInit(dev);
+    }
+    if (dev->trace.events == NULL)
+    {
+        rdpTraceInit(&(dev->trace), dev->trace_events);
     }
 
     /* disconnect idle */
@@ -1646,6 +2551,14 @@ rdpClientConInit(rdpPtr dev)
     LLOGLN(0, ("rdpClientConInit: kill disconnected [%d] timeout [%d] sec",
                dev->do_kill_disconnected, dev->disconnect_timeout_s));
 
+    i = dev->capture_threads;
+    if (i < 1)
+    {
+        i = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    dev->capture_pool = rdpThreadPoolCreate(i);
+    LLOGLN(0, ("rdpClientConInit: capture threads [%d]",
+               rdpThreadPoolGetNumThreads(dev->capture_pool)));
 
     return 0;
 }
@@ -1686,6 +2599,18 @@ rdpClientConDeinit(rdpPtr dev)
         }
     }
 
+    rdpClientConStatsSignalDeinit(dev);
+    rdpTraceDeinit(&(dev->trace));
+
+    rdpThreadPoolDestroy(dev->capture_pool);
+    dev->capture_pool = NULL;
+
+    if (dev->reapTimer != NULL)
+    {
+        TimerFree(dev->reapTimer);
+        dev->reapTimer = NULL;
+    }
+
     return 0;
 }
 
@@ -1747,7 +2672,7 @@ rdpClientConPreCheck(rdpPtr dev, rdpClientCon *clientCon, int in_size)
         (clientCon->out_s->size - (in_size + 20)))
     {
         s_mark_end(clientCon->out_s);
-        if (rdpClientConSendMsg(dev, clientCon) != 0)
+        if (rdpClientConSendMsg(dev, clientCon, -1) != 0)
         {
             LLOGLN(0, ("rdpClientConPreCheck: rdpup_send_msg failed"));
             rv = 1;
@@ -2149,31 +3074,19 @@ rdpClientConSetCursorEx(rdpPtr dev, rdpClientCon *clientCon,
 }
 
 /******************************************************************************/
+/* fd holds the pixels then the mask, it is not written again once sent,
+   see rdpCursor.c */
 int
 rdpClientConSetCursorShmFd(rdpPtr dev, rdpClientCon *clientCon,
-                           short x, short y,
-                           uint8_t *cur_data, uint8_t *cur_mask, int bpp,
+                           short x, short y, int fd, int bpp,
                            int width, int height)
 {
     int size;
-    int Bpp;
-    int fd = -1;
     int rv = 0;
-    void *addr = NULL;
-    uint8_t *shmemptr;
-    size_t shmsize;
 
     if (clientCon->connected)
     {
         LLOGLN(10, ("rdpClientConSetCursorShm:"));
-        Bpp = (bpp == 0) ? 3 : (bpp + 7) / 8;
-        shmsize = width * height * Bpp + width * height / 8;
-        if (g_alloc_shm_map_fd(&addr, &fd, shmsize) != 0)
-        {
-            LLOGLN(0, ("rdpClientConSetCursorShmFd: rdpGetShmFd failed"));
-            return 0;
-        }
-        shmemptr = (uint8_t *)addr;
         size = 14;
         rdpClientConPreCheck(dev, clientCon, size);
         out_uint16_le(clientCon->out_s, 63); /* set cursor shmfd */
@@ -2188,12 +3101,9 @@ rdpClientConSetCursorShmFd(rdpPtr dev, rdpClientCon *clientCon,
         out_uint16_le(clientCon->out_s, bpp);
         out_uint16_le(clientCon->out_s, width);
         out_uint16_le(clientCon->out_s, height);
-        memcpy(shmemptr, cur_data, width * height * Bpp);
-        memcpy(shmemptr + width * height * Bpp, cur_mask, width * height / 8);
-        rdpClientConSendPending(clientCon->dev, clientCon);
-        rv = g_sck_send_fd_set(clientCon->sck, "int", 4, &fd, 1);
-        LLOGLN(10, ("rdpClientConSetCursorShmFd: g_sck_send_fd_set rv %d", rv));
-        g_free_unmap_fd(shmemptr, fd, shmsize);
+        rv = rdpClientConSendPendingFd(dev, clientCon, fd);
+        LLOGLN(10, ("rdpClientConSetCursorShmFd: "
+               "rdpClientConSendPendingFd rv %d", rv));
     }
     return rv;
 }
@@ -2598,285 +3508,1457 @@ out_rects_dr(struct stream *s,
 }
 
 /******************************************************************************/
+/* copy the dst rects of a move into rects, in an order that never
+   overwrites the source of a later rect, bands bottom up when moving down,
+   right to left in a band when moving right
+   returns the number of rects */
 static int
-rdpClientConSendPaintRectShmFd(rdpPtr dev, rdpClientCon *clientCon,
-                               struct image_data *id,
-                               RegionPtr dirtyReg,
-                               BoxPtr copyRects, int numCopyRects)
+rdpScreenMoveRects(const struct rdp_screen_move *move, BoxPtr rects)
 {
-    int size;
-    int num_rects_d;
-    int num_rects_c;
-    struct stream *s;
-    int capture_code;
-    int start_frame_bytes;
-    int wiretosurface1_bytes;
-    int wiretosurface2_bytes;
-    int end_frame_bytes;
-    int surface_id;
-
-    LLOGLN(10, ("rdpClientConSendPaintRectShmFd:"));
-    LLOGLN(10, ("rdpClientConSendPaintRectShmFd: cap_left %d cap_top %d "
-           "cap_width %d cap_height %d",
-           clientCon->cap_left, clientCon->cap_top,
-           clientCon->cap_width, clientCon->cap_height));
-    LLOGLN(10, ("rdpClientConSendPaintRectShmFd: id->flags 0x%8.8X "
-           "id->left %d id->top %d id->width %d id->height %d",
-           id->flags, id->left, id->top, id->width, id->height));
+    BoxPtr src;
+    int count;
+    int out;
+    int jndex;
+    int band_start;
+    int band_end;
+
+    src = REGION_RECTS(move->dst);
+    count = RDPMIN(REGION_NUM_RECTS(move->dst), XRDP_MAX_SCREEN_MOVE_RECTS);
+    band_start = 0;
+    while (band_start < count)
+    {
+        band_end = band_start + 1;
+        while ((band_end < count) && (src[band_end].y1 == src[band_start].y1))
+        {
+            band_end++;
+        }
+        out = (move->dy > 0) ? count - band_end : band_start;
+        for (jndex = band_start; jndex < band_end; jndex++)
+        {
+            rects[out++] = src[(move->dx > 0) ?
+                               band_start + band_end - 1 - jndex : jndex];
+        }
+        band_start = band_end;
+    }
+    return count;
+}
 
-    capture_code = clientCon->client_info.capture_code;
+/******************************************************************************/
+static void
+rdpClientConMovesFree(rdpClientCon *clientCon)
+{
+    int index;
 
-    num_rects_d = REGION_NUM_RECTS(dirtyReg);
-    num_rects_c = numCopyRects;
-    if ((num_rects_c < 1) || (num_rects_d < 1))
+    for (index = 0; index < clientCon->num_moves; index++)
     {
-        LLOGLN(10, ("rdpClientConSendPaintRectShmFd: nothing to send"));
-        return 0;
+        rdpRegionDestroy(clientCon->moves[index].dst);
     }
+    clientCon->num_moves = 0;
+}
 
-    rdpClientConBeginUpdate(dev, clientCon);
+/******************************************************************************/
+/* returns the bytes out_screen_moves_gfx will write */
+static int
+rdpClientConMovesGfxBytes(rdpClientCon *clientCon)
+{
+    int index;
+    int bytes;
 
-    if (capture_code < 4)
+    bytes = 0;
+    for (index = 0; index < clientCon->num_moves; index++)
     {
-        /* non gfx */
-        size = 2 + 2 + 2 + num_rects_d * 8 + 2 + num_rects_c * 8;
-        size += 4 + 4 + 4 + 4 + 2 + 2 + 2 + 2;
-        rdpClientConPreCheck(dev, clientCon, size);
+        bytes += (8 + 18) *
+                 RDPMIN(REGION_NUM_RECTS(clientCon->moves[index].dst),
+                        XRDP_MAX_SCREEN_MOVE_RECTS);
+    }
+    return bytes;
+}
 
-        s = clientCon->out_s;
-        out_uint16_le(s, 64);
-        out_uint16_le(s, size);
-        clientCon->count++;
+/******************************************************************************/
+/* one XR_RDPGFX_CMDID_SURFACETOSURFACE per move rect, surface relative */
+static int
+out_screen_moves_gfx(struct stream *s, rdpClientCon *clientCon)
+{
+    struct rdp_screen_move *move;
+    BoxRec rects[XRDP_MAX_SCREEN_MOVE_RECTS];
+    int num_rects;
+    int index;
+    int jndex;
+    int left;
+    int top;
 
-        out_rects_dr(s, REGION_RECTS(dirtyReg), num_rects_d,
-                     copyRects, num_rects_c);
-
-        out_uint32_le(s, id->flags);
-        ++clientCon->rect_id;
-        out_uint32_le(s, clientCon->rect_id);
-        out_uint32_le(s, id->shmem_bytes);
-        out_uint32_le(s, id->shmem_offset);
-		if (capture_code == 2) /* rfx */
-		{
-            out_uint16_le(s, id->left);
-            out_uint16_le(s, id->top);
-            out_uint16_le(s, id->width);
-            out_uint16_le(s, id->height);
-		}
-		else
-		{
-            out_uint16_le(s, 0);
-            out_uint16_le(s, 0);
-            out_uint16_le(s, clientCon->cap_width);
-            out_uint16_le(s, clientCon->cap_height);
-        }
-        rdpClientConSendPending(clientCon->dev, clientCon);
-        g_sck_send_fd_set(clientCon->sck, "int", 4, &(id->shmem_fd), 1);
-    }
-    else if (capture_code == 4) /* gfx pro rfx */
-    {
-        start_frame_bytes = 8 + 8;
-        wiretosurface2_bytes = 8 + 13 +
-                               2 + num_rects_d * 8 +
-                               2 + num_rects_c * 8 +
-                               8;
-        end_frame_bytes = 8 + 4;
-
-        size = 2 + 2;                   /* header */
-        size += 4;                      /* message 62 cmd_bytes */
-        size += start_frame_bytes;      /* start frame message */
-        size += wiretosurface2_bytes;   /* frame message */
-        size += end_frame_bytes;        /* end frame message */
-        size += 4;                      /* message 62 data_bytes */
+    for (index = 0; index < clientCon->num_moves; index++)
+    {
+        move = clientCon->moves + index;
+        left = 0;
+        top = 0;
+        if (clientCon->dev->monitorCount > 0)
+        {
+            left = clientCon->dev->minfo[move->mon].left;
+            top = clientCon->dev->minfo[move->mon].top;
+        }
+        num_rects = rdpScreenMoveRects(move, rects);
+        for (jndex = 0; jndex < num_rects; jndex++)
+        {
+            /* XR_RDPGFX_CMDID_SURFACETOSURFACE */
+            out_uint16_le(s, 0x0005);
+            out_uint16_le(s, 0);                /* flags */
+            out_uint32_le(s, 8 + 18);           /* cmd_bytes */
+            out_uint16_le(s, move->mon);        /* surface_id_src */
+            out_uint16_le(s, move->mon);        /* surface_id_dst */
+            out_uint16_le(s, rects[jndex].x1 - move->dx - left);
+            out_uint16_le(s, rects[jndex].y1 - move->dy - top);
+            out_uint16_le(s, rects[jndex].x2 - move->dx - left);
+            out_uint16_le(s, rects[jndex].y2 - move->dy - top);
+            out_uint16_le(s, 1);                /* num_dst_points */
+            out_uint16_le(s, rects[jndex].x1 - left);
+            out_uint16_le(s, rects[jndex].y1 - top);
+        }
+    }
+    return 0;
+}
 
-        rdpClientConPreCheck(dev, clientCon, size);
-        s = clientCon->out_s;
-        out_uint16_le(s, 62);
-        out_uint16_le(s, size);
-        clientCon->count++;
+/******************************************************************************/
+/* bookkeeping once a frame is on its way to xrdp */
+static void
+rdpClientConFrameSent(rdpClientCon *clientCon)
+{
+    /* slot is busy until xrdp acks this frame */
+    clientCon->shm_slot_frame_id[clientCon->shm_slot] = clientCon->rect_id;
+    rdpPacingFrameSent(&(clientCon->pacing), clientCon->rect_id);
+    rdpLatencyFrameSent(&(clientCon->latency), clientCon->rect_id);
+}
 
-        out_uint32_le(s, start_frame_bytes +
-                        wiretosurface2_bytes +
-                        end_frame_bytes); /* total of cmd_bytes */
+/******************************************************************************/
+/* returns the bytes of the wire to surface command out_surface_gfx will
+   write, 0 when the surface has nothing to send */
+static int
+rdpClientConSurfaceGfxBytes(rdpClientCon *clientCon,
+                            struct rdp_cap_surface *surface)
+{
+    int num_rects_d;
+    int bytes;
 
-        ++clientCon->rect_id;
+    if (surface->num_rects < 1)
+    {
+        /* not captured, dirty can be NULL */
+        return 0;
+    }
+    num_rects_d = REGION_NUM_RECTS(surface->dirty);
+    if (num_rects_d < 1)
+    {
+        return 0;
+    }
+    if (clientCon->client_info.capture_code == 4)
+    {
+        bytes = 8 + 13;  /* XR_RDPGFX_CMDID_WIRETOSURFACE_2 */
+    }
+    else
+    {
+        bytes = 8 + 9;   /* XR_RDPGFX_CMDID_WIRETOSURFACE_1 */
+    }
+    bytes += 2 + num_rects_d * 8 + 2 + surface->num_rects * 8 + 8;
+    if (surface->id.shmem_offset != 0)
+    {
+        bytes += 4;
+    }
+    return bytes;
+}
 
-        /* XR_RDPGFX_CMDID_STARTFRAME */
-        out_uint16_le(s, 0x000B);
-        out_uint16_le(s, 0);                    /* flags */
-        out_uint32_le(s, start_frame_bytes);    /* cmd_bytes */
-        out_uint32_le(s, clientCon->rect_id);   /* frame_id */
-        out_uint32_le(s, 0);                    /* time_stamp */
+/******************************************************************************/
+/* one wire to surface command, rfx for capture code 4, h264 for 5 */
+static int
+out_surface_gfx(struct stream *s, rdpClientCon *clientCon,
+                struct rdp_cap_surface *surface, int cmd_bytes)
+{
+    struct image_data *id;
+    int flags;
 
-        surface_id = (id->flags >> 28) & 0xF;
+    id = &(surface->id);
+    flags = id->flags;
+    if (clientCon->shm_registered)
+    {
+        flags |= XRDP_PAINT_SHM_REGISTERED;
+    }
+    if (id->shmem_offset != 0)
+    {
+        flags |= XRDP_PAINT_SHM_OFFSET;
+    }
+    if (clientCon->client_info.capture_code == 4)
+    {
         /* XR_RDPGFX_CMDID_WIRETOSURFACE_2 */
         out_uint16_le(s, 0x0002);
         out_uint16_le(s, 0);                    /* flags */
-        out_uint32_le(s, wiretosurface2_bytes); /* cmd_bytes */
-        out_uint16_le(s, surface_id);           /* surface_id */
+        out_uint32_le(s, cmd_bytes);            /* cmd_bytes */
+        out_uint16_le(s, (id->flags >> 28) & 0xF); /* surface_id */
         out_uint16_le(s, 0x0009);               /* codec_id */
         out_uint32_le(s, 0);                    /* codec_context_id */
         out_uint8(s, 0x20);                     /* pixel_format */
+    }
+    else
+    {
+        /* XR_RDPGFX_CMDID_WIRETOSURFACE_1 */
+        out_uint16_le(s, 0x0001);
+        out_uint16_le(s, 0);                    /* flags */
+        out_uint32_le(s, cmd_bytes);            /* cmd_bytes */
+        out_uint16_le(s, (id->flags >> 28) & 0xF); /* surface_id */
+        out_uint16_le(s, 0x000B);               /* codec_id */
+        out_uint8(s, 0x20);                     /* pixel_format */
+    }
 
-        out_uint32_le(s, id->flags);            /* flags */
+    out_uint32_le(s, flags);                    /* flags */
 
-        out_rects_dr(s, REGION_RECTS(dirtyReg), num_rects_d,
-                     copyRects, num_rects_c);
+    out_rects_dr(s, REGION_RECTS(surface->dirty),
+                 REGION_NUM_RECTS(surface->dirty),
+                 surface->rects, surface->num_rects);
 
-        out_uint16_le(s, id->left);
-        out_uint16_le(s, id->top);
-        out_uint16_le(s, id->width);
-        out_uint16_le(s, id->height);
+    out_uint16_le(s, id->left);
+    out_uint16_le(s, id->top);
+    out_uint16_le(s, id->width);
+    out_uint16_le(s, id->height);
+    if (id->shmem_offset != 0)
+    {
+        out_uint32_le(s, id->shmem_offset);     /* where in the slot */
+    }
+    return 0;
+}
 
-        /* XR_RDPGFX_CMDID_ENDFRAME */
-        out_uint16_le(s, 0x000C);
-        out_uint16_le(s, 0);                    /* flags */
-        out_uint32_le(s, end_frame_bytes);      /* cmd_bytes */
-        out_uint32_le(s, clientCon->rect_id);   /* frame_id */
+/******************************************************************************/
+/* one gfx frame, the surface to surface copies then a wire to surface
+   command for each surface with something in it, all in one shm slot */
+static int
+rdpClientConSendPaintGfx(rdpPtr dev, rdpClientCon *clientCon,
+                         struct rdp_cap_surface *surfaces, int num_surfaces)
+{
+    struct stream *s;
+    int size;
+    int start_frame_bytes;
+    int end_frame_bytes;
+    int surfaces_bytes;
+    int surface_bytes;
+    int moves_bytes;
+    int slot_bytes;
+    int index;
+    struct image_data *id;
 
-        if ((id->shmem_bytes > 0) && ((id->flags & 1) == 0))
-        {
-            out_uint32_le(s, id->shmem_bytes);  /* shmem_bytes */
-            rdpClientConSendPending(clientCon->dev, clientCon);
-            g_sck_send_fd_set(clientCon->sck, "int", 4, &(id->shmem_fd), 1);
-        }
-        else
+    LLOGLN(10, ("rdpClientConSendPaintGfx: num_surfaces %d", num_surfaces));
+
+    moves_bytes = rdpClientConMovesGfxBytes(clientCon);
+    surfaces_bytes = 0;
+    id = NULL;
+    for (index = 0; index < num_surfaces; index++)
+    {
+        surface_bytes = rdpClientConSurfaceGfxBytes(clientCon,
+                                                    surfaces + index);
+        if ((surface_bytes > 0) && (surfaces[index].id.shmem_bytes > 0) &&
+            ((surfaces[index].id.flags & 1) == 0))
         {
-            out_uint32_le(s, 0);                /* shmem_bytes */
+            if (id == NULL)
+            {
+                /* captured, so it has the slot of this frame */
+                id = &(surfaces[index].id);
+            }
         }
+        surfaces_bytes += surface_bytes;
     }
-    else if (capture_code == 5) /* gfx h264 */
+    if ((surfaces_bytes < 1) && (moves_bytes < 1))
     {
-        start_frame_bytes = 8 + 8;
-        wiretosurface1_bytes = 8 + 9 +
-                               2 + num_rects_d * 8 +
-                               2 + num_rects_c * 8 +
-                               8;
-        end_frame_bytes = 8 + 4;
-
-        size = 2 + 2;                   /* header */
-        size += 4;                      /* message 62 cmd_bytes */
-        size += start_frame_bytes;      /* start frame message */
-        size += wiretosurface1_bytes;   /* frame message */
-        size += end_frame_bytes;        /* end frame message */
-        size += 4;                      /* message 62 data_bytes */
-
-        rdpClientConPreCheck(dev, clientCon, size);
-        s = clientCon->out_s;
-        out_uint16_le(s, 62);
-        out_uint16_le(s, size);
-        clientCon->count++;
+        LLOGLN(10, ("rdpClientConSendPaintGfx: nothing to send"));
+        return 0;
+    }
 
-        out_uint32_le(s, start_frame_bytes +
-                        wiretosurface1_bytes +
-                        end_frame_bytes); /* total of cmd_bytes */
+    /* the shm slot index trails the message when running a frame ring or
+       when the slots are registered, older xrdp skips it */
+    slot_bytes = ((clientCon->shm_slot_count > 1) ||
+                  clientCon->shm_registered) ? 4 : 0;
+    start_frame_bytes = 8 + 8;
+    end_frame_bytes = 8 + 4;
 
-        ++clientCon->rect_id;
+    rdpClientConBeginUpdate(dev, clientCon);
 
-        /* XR_RDPGFX_CMDID_STARTFRAME */
-        out_uint16_le(s, 0x000B);
-        out_uint16_le(s, 0);                    /* flags */
-        out_uint32_le(s, start_frame_bytes);    /* cmd_bytes */
-        out_uint32_le(s, clientCon->rect_id);   /* frame_id */
-        out_uint32_le(s, 0);                    /* time_stamp */
+    size = 2 + 2;                   /* header */
+    size += 4;                      /* message 62 cmd_bytes */
+    size += start_frame_bytes;      /* start frame message */
+    size += moves_bytes;            /* surface to surface messages */
+    size += surfaces_bytes;         /* frame messages */
+    size += end_frame_bytes;        /* end frame message */
+    size += 4;                      /* message 62 data_bytes */
+    size += slot_bytes;             /* shm slot */
 
-        surface_id = (id->flags >> 28) & 0xF;
-        /* XR_RDPGFX_CMDID_WIRETOSURFACE_1 */
-        out_uint16_le(s, 0x0001);
-        out_uint16_le(s, 0);                    /* flags */
-        out_uint32_le(s, wiretosurface1_bytes); /* cmd_bytes */
-        out_uint16_le(s, surface_id);           /* surface_id */
-        out_uint16_le(s, 0x000B);               /* codec_id */
-        out_uint8(s, 0x20);                     /* pixel_format */
+    rdpClientConPreCheck(dev, clientCon, size);
+    s = clientCon->out_s;
+    out_uint16_le(s, 62);
+    out_uint16_le(s, size);
+    clientCon->count++;
 
-        out_uint32_le(s, id->flags);            /* flags */
+    out_uint32_le(s, start_frame_bytes +
+                    moves_bytes +
+                    surfaces_bytes +
+                    end_frame_bytes); /* total of cmd_bytes */
 
-        out_rects_dr(s, REGION_RECTS(dirtyReg), num_rects_d,
-                     copyRects, num_rects_c);
+    ++clientCon->rect_id;
 
-        out_uint16_le(s, id->left);
-        out_uint16_le(s, id->top);
-        out_uint16_le(s, id->width);
-        out_uint16_le(s, id->height);
+    /* XR_RDPGFX_CMDID_STARTFRAME */
+    out_uint16_le(s, 0x000B);
+    out_uint16_le(s, 0);                    /* flags */
+    out_uint32_le(s, start_frame_bytes);    /* cmd_bytes */
+    out_uint32_le(s, clientCon->rect_id);   /* frame_id */
+    out_uint32_le(s, rdpLatencyGfxTimestamp()); /* time_stamp */
 
-        /* XR_RDPGFX_CMDID_ENDFRAME */
-        out_uint16_le(s, 0x000C);
-        out_uint16_le(s, 0);                    /* flags */
-        out_uint32_le(s, end_frame_bytes);      /* cmd_bytes */
-        out_uint32_le(s, clientCon->rect_id);   /* frame_id */
+    out_screen_moves_gfx(s, clientCon);
+    rdpClientConMovesFree(clientCon);
 
-        if ((id->shmem_bytes > 0) && ((id->flags & 1) == 0))
+    for (index = 0; index < num_surfaces; index++)
+    {
+        surface_bytes = rdpClientConSurfaceGfxBytes(clientCon,
+                                                    surfaces + index);
+        if (surface_bytes > 0)
         {
-            out_uint32_le(s, id->shmem_bytes);  /* shmem_bytes */
-            rdpClientConSendPending(clientCon->dev, clientCon);
-            g_sck_send_fd_set(clientCon->sck, "int", 4, &(id->shmem_fd), 1);
+            out_surface_gfx(s, clientCon, surfaces + index, surface_bytes);
         }
-        else
+    }
+
+    /* XR_RDPGFX_CMDID_ENDFRAME */
+    out_uint16_le(s, 0x000C);
+    out_uint16_le(s, 0);                    /* flags */
+    out_uint32_le(s, end_frame_bytes);      /* cmd_bytes */
+    out_uint32_le(s, clientCon->rect_id);   /* frame_id */
+
+    if (id != NULL)
+    {
+        out_uint32_le(s, id->shmem_bytes);  /* shmem_bytes */
+        if (slot_bytes > 0)
+        {
+            out_uint32_le(s, clientCon->shm_slot);
+        }
+        rdpClientConSendPaint(dev, clientCon,
+                              clientCon->shm_registered ?
+                              -1 : id->shmem_fd);
+    }
+    else
+    {
+        out_uint32_le(s, 0);                /* shmem_bytes */
+        if (slot_bytes > 0)
+        {
+            out_uint32_le(s, clientCon->shm_slot);
+        }
+    }
+
+    rdpClientConFrameSent(clientCon);
+
+    rdpClientConEndUpdate(dev, clientCon);
+
+    return 0;
+}
+
+/******************************************************************************/
+static int
+rdpClientConSendPaintRectShmFd(rdpPtr dev, rdpClientCon *clientCon,
+                               struct image_data *id,
+                               RegionPtr dirtyReg,
+                               BoxPtr copyRects, int numCopyRects)
+{
+    int size;
+    int num_rects_d;
+    int num_rects_c;
+    struct stream *s;
+    int capture_code;
+    int slot_bytes;
+    int flags;
+    struct rdp_cap_surface surface;
+
+    LLOGLN(10, ("rdpClientConSendPaintRectShmFd:"));
+    LLOGLN(10, ("rdpClientConSendPaintRectShmFd: cap_left %d cap_top %d "
+           "cap_width %d cap_height %d",
+           clientCon->cap_left, clientCon->cap_top,
+           clientCon->cap_width, clientCon->cap_height));
+    LLOGLN(10, ("rdpClientConSendPaintRectShmFd: id->flags 0x%8.8X "
+           "id->left %d id->top %d id->width %d id->height %d",
+           id->flags, id->left, id->top, id->width, id->height));
+
+    capture_code = clientCon->client_info.capture_code;
+    if (capture_code >= 4)
+    {
+        /* gfx, a frame with the one surface */
+        surface.id = *id;
+        surface.dirty = dirtyReg;
+        surface.rects = copyRects;
+        surface.num_rects = numCopyRects;
+        return rdpClientConSendPaintGfx(dev, clientCon, &surface, 1);
+    }
+
+    num_rects_d = REGION_NUM_RECTS(dirtyReg);
+    num_rects_c = numCopyRects;
+    if ((num_rects_c < 1) || (num_rects_d < 1))
+    {
+        LLOGLN(10, ("rdpClientConSendPaintRectShmFd: nothing to send"));
+        return 0;
+    }
+
+    /* the shm slot index trails the message when running a frame ring or
+       when the slots are registered, older xrdp skips it */
+    slot_bytes = ((clientCon->shm_slot_count > 1) ||
+                  clientCon->shm_registered) ? 4 : 0;
+    flags = id->flags;
+    if (clientCon->shm_registered)
+    {
+        flags |= XRDP_PAINT_SHM_REGISTERED;
+    }
+
+    rdpClientConBeginUpdate(dev, clientCon);
+
+    size = 2 + 2 + 2 + num_rects_d * 8 + 2 + num_rects_c * 8;
+    size += 4 + 4 + 4 + 4 + 2 + 2 + 2 + 2;
+    size += slot_bytes;
+    if (clientCon->zero_copy)
+    {
+        size += 4; /* fb_gen */
+    }
+    rdpClientConPreCheck(dev, clientCon, size);
+
+    s = clientCon->out_s;
+    out_uint16_le(s, 64);
+    out_uint16_le(s, size);
+    clientCon->count++;
+
+    out_rects_dr(s, REGION_RECTS(dirtyReg), num_rects_d,
+                 copyRects, num_rects_c);
+
+    if (clientCon->zero_copy)
+    {
+        flags |= XRDP_PAINT_SHARED_FB;
+    }
+    out_uint32_le(s, flags);
+    ++clientCon->rect_id;
+    out_uint32_le(s, clientCon->rect_id);
+    out_uint32_le(s, id->shmem_bytes);
+    out_uint32_le(s, id->shmem_offset);
+    if (capture_code == 2) /* rfx */
+    {
+        out_uint16_le(s, id->left);
+        out_uint16_le(s, id->top);
+        out_uint16_le(s, id->width);
+        out_uint16_le(s, id->height);
+    }
+    else
+    {
+        out_uint16_le(s, 0);
+        out_uint16_le(s, 0);
+        out_uint16_le(s, clientCon->cap_width);
+        out_uint16_le(s, clientCon->cap_height);
+    }
+    if (slot_bytes > 0)
+    {
+        out_uint32_le(s, clientCon->shm_slot);
+    }
+    if (clientCon->zero_copy)
+    {
+        out_uint32_le(s, dev->fb_gen);
+    }
+    /* xrdp keeps the shared frame buffer and registered slots
+       mapped until they are reallocated */
+    if (clientCon->zero_copy ?
+        (clientCon->fb_gen_sent != dev->fb_gen) :
+        !clientCon->shm_registered)
+    {
+        rdpClientConSendPaint(dev, clientCon, id->shmem_fd);
+        if (clientCon->zero_copy)
+        {
+            clientCon->fb_gen_sent = dev->fb_gen;
+        }
+    }
+    else
+    {
+        rdpClientConSendPaint(dev, clientCon, -1);
+    }
+
+    rdpClientConFrameSent(clientCon);
+
+    rdpClientConEndUpdate(dev, clientCon);
+
+    return 0;
+}
+
+/******************************************************************************/
+/* set bits first to last, inclusive */
+static void
+rdpDirtyBitsSet(uint64_t *bits, int first, int last)
+{
+    uint64_t mask;
+    int index;
+    int first_word;
+    int last_word;
+
+    first_word = first >> 6;
+    last_word = last >> 6;
+    for (index = first_word; index <= last_word; index++)
+    {
+        mask = ~((uint64_t) 0);
+        if (index == first_word)
+        {
+            mask &= mask << (first & 63);
+        }
+        if (index == last_word)
+        {
+            mask &= ~((uint64_t) 0) >> (63 - (last & 63));
+        }
+        bits[index] |= mask;
+    }
+}
+
+/******************************************************************************/
+/* size the tile bitmap to the screen, returns error */
+static int
+rdpClientConDirtyTilesCheck(rdpClientCon *clientCon)
+{
+    rdpPtr dev;
+    int shift;
+    int tiles_x;
+    int tiles_y;
+    int words;
+    int rows_words;
+    int was_dirty;
+    int index;
+
+    dev = clientCon->dev;
+    if ((clientCon->dirty_tiles != NULL) &&
+        (clientCon->dirty_tiles_width == dev->width) &&
+        (clientCon->dirty_tiles_height == dev->height))
+    {
+        return 0;
+    }
+    shift = clientCon->dirty_tile_shift;
+    was_dirty = 0;
+    if (clientCon->dirty_tile_rows != NULL)
+    {
+        rows_words = ((clientCon->dirty_tiles_height - 1) >> shift) / 64 + 1;
+        for (index = 0; index < rows_words; index++)
+        {
+            was_dirty |= clientCon->dirty_tile_rows[index] != 0;
+        }
+    }
+    free(clientCon->dirty_tiles);
+    free(clientCon->dirty_tile_rows);
+    clientCon->dirty_tiles = NULL;
+    clientCon->dirty_tile_rows = NULL;
+    clientCon->dirty_tiles_width = 0;
+    clientCon->dirty_tiles_height = 0;
+    if ((dev->width < 1) || (dev->height < 1))
+    {
+        return 1;
+    }
+    tiles_x = ((dev->width - 1) >> shift) + 1;
+    tiles_y = ((dev->height - 1) >> shift) + 1;
+    words = tiles_x / 64 + 1;
+    rows_words = tiles_y / 64 + 1;
+    clientCon->dirty_tiles = g_new0(uint64_t, words * tiles_y);
+    clientCon->dirty_tile_rows = g_new0(uint64_t, rows_words);
+    if ((clientCon->dirty_tiles == NULL) ||
+        (clientCon->dirty_tile_rows == NULL))
+    {
+        free(clientCon->dirty_tiles);
+        free(clientCon->dirty_tile_rows);
+        clientCon->dirty_tiles = NULL;
+        clientCon->dirty_tile_rows = NULL;
+        return 1;
+    }
+    clientCon->dirty_tiles_width = dev->width;
+    clientCon->dirty_tiles_height = dev->height;
+    clientCon->dirty_tile_words = words;
+    LLOGLN(0, ("rdpClientConDirtyTilesCheck: %dx%d tiles of %d pixels",
+           tiles_x, tiles_y, 1 << shift));
+    if (was_dirty)
+    {
+        /* the old tiles do not map to the new screen, resend it all */
+        for (index = 0; index < tiles_y; index++)
+        {
+            rdpDirtyBitsSet(clientCon->dirty_tiles + index * words,
+                            0, tiles_x - 1);
+        }
+        rdpDirtyBitsSet(clientCon->dirty_tile_rows, 0, tiles_y - 1);
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* mark the tiles a box touches, returns error */
+static int
+rdpClientConDirtyTilesAddBox(rdpClientCon *clientCon, const BoxRec *box)
+{
+    int shift;
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+    int ty;
+    uint64_t *row;
+
+    if (rdpClientConDirtyTilesCheck(clientCon) != 0)
+    {
+        return 1;
+    }
+    x1 = RDPMAX(box->x1, 0);
+    y1 = RDPMAX(box->y1, 0);
+    x2 = RDPMIN(box->x2, clientCon->dirty_tiles_width);
+    y2 = RDPMIN(box->y2, clientCon->dirty_tiles_height);
+    if ((x2 <= x1) || (y2 <= y1))
+    {
+        return 0;
+    }
+    shift = clientCon->dirty_tile_shift;
+    x1 >>= shift;
+    y1 >>= shift;
+    x2 = (x2 - 1) >> shift;
+    y2 = (y2 - 1) >> shift;
+    row = clientCon->dirty_tiles + y1 * clientCon->dirty_tile_words;
+    for (ty = y1; ty <= y2; ty++)
+    {
+        rdpDirtyBitsSet(row, x1, x2);
+        row += clientCon->dirty_tile_words;
+    }
+    rdpDirtyBitsSet(clientCon->dirty_tile_rows, y1, y2);
+    return 0;
+}
+
+/******************************************************************************/
+/* extents of the dirty tiles, clipped to the screen
+   returns boolean, true if any tile is dirty */
+static int
+rdpClientConDirtyTilesExtents(rdpClientCon *clientCon, BoxPtr box)
+{
+    int shift;
+    int words;
+    int tiles_y;
+    int ty;
+    int index;
+    int bit;
+    int tx_min;
+    int tx_max;
+    int ty_min;
+    int ty_max;
+    uint64_t *row;
+
+    if (clientCon->dirty_tiles == NULL)
+    {
+        return 0;
+    }
+    shift = clientCon->dirty_tile_shift;
+    words = clientCon->dirty_tile_words;
+    tiles_y = ((clientCon->dirty_tiles_height - 1) >> shift) + 1;
+    tx_min = words * 64;
+    tx_max = -1;
+    ty_min = -1;
+    ty_max = -1;
+    for (ty = 0; ty < tiles_y; ty++)
+    {
+        if ((clientCon->dirty_tile_rows[ty >> 6] &
+             (((uint64_t) 1) << (ty & 63))) == 0)
+        {
+            continue;
+        }
+        if (ty_min < 0)
+        {
+            ty_min = ty;
+        }
+        ty_max = ty;
+        row = clientCon->dirty_tiles + ty * words;
+        for (index = 0; index < words; index++)
+        {
+            if (row[index] != 0)
+            {
+                for (bit = 0; (row[index] & (((uint64_t) 1) << bit)) == 0;
+                     bit++)
+                {
+                }
+                tx_min = RDPMIN(tx_min, index * 64 + bit);
+                break;
+            }
+        }
+        for (index = words - 1; index >= 0; index--)
+        {
+            if (row[index] != 0)
+            {
+                for (bit = 63; (row[index] & (((uint64_t) 1) << bit)) == 0;
+                     bit--)
+                {
+                }
+                tx_max = RDPMAX(tx_max, index * 64 + bit);
+                break;
+            }
+        }
+    }
+    if ((ty_min < 0) || (tx_max < 0))
+    {
+        return 0;
+    }
+    box->x1 = tx_min << shift;
+    box->y1 = ty_min << shift;
+    box->x2 = RDPMIN((tx_max + 1) << shift, clientCon->dirty_tiles_width);
+    box->y2 = RDPMIN((ty_max + 1) << shift, clientCon->dirty_tiles_height);
+    return 1;
+}
+
+/******************************************************************************/
+/* move the dirty tiles that touch cap_rect into cap_dirty, clipped to
+   cap_rect, and clear them
+   the part of a tile outside cap_rect goes to dirtyRegion
+   returns error */
+static int
+rdpClientConDirtyTilesTake(rdpClientCon *clientCon, const BoxRec *cap_rect,
+                           RegionPtr cap_dirty)
+{
+    RegionPtr reg;
+    xRectangle *rects;
+    BoxRec tile_box;
+    uint64_t *row;
+    uint64_t bit;
+    int shift;
+    int words;
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+    int tx;
+    int ty;
+    int tx1;
+    int tx2;
+    int ty1;
+    int ty2;
+    int start;
+    int ry1;
+    int ry2;
+    int index;
+    int row_dirty;
+    int num_rects;
+    int band_start;
+    int prev_start;
+    int prev_count;
+
+    if (clientCon->dirty_tiles == NULL)
+    {
+        return 0;
+    }
+    x1 = RDPMAX(cap_rect->x1, 0);
+    y1 = RDPMAX(cap_rect->y1, 0);
+    x2 = RDPMIN(cap_rect->x2, clientCon->dirty_tiles_width);
+    y2 = RDPMIN(cap_rect->y2, clientCon->dirty_tiles_height);
+    if ((x2 <= x1) || (y2 <= y1))
+    {
+        return 0;
+    }
+    shift = clientCon->dirty_tile_shift;
+    words = clientCon->dirty_tile_words;
+    tx1 = x1 >> shift;
+    ty1 = y1 >> shift;
+    tx2 = (x2 - 1) >> shift;
+    ty2 = (y2 - 1) >> shift;
+    rects = g_new(xRectangle, (ty2 - ty1 + 1) * ((tx2 - tx1 + 2) / 2));
+    if (rects == NULL)
+    {
+        return 1;
+    }
+    num_rects = 0;
+    prev_start = 0;
+    prev_count = 0;
+    for (ty = ty1; ty <= ty2; ty++)
+    {
+        if ((clientCon->dirty_tile_rows[ty >> 6] &
+             (((uint64_t) 1) << (ty & 63))) == 0)
+        {
+            prev_count = 0;
+            continue;
+        }
+        row = clientCon->dirty_tiles + ty * words;
+        ry1 = RDPMAX(ty << shift, y1);
+        ry2 = RDPMIN((ty + 1) << shift, y2);
+        band_start = num_rects;
+        tx = tx1;
+        while (tx <= tx2)
+        {
+            if ((row[tx >> 6] >> (tx & 63)) == 0)
+            {
+                /* rest of the word is clean */
+                tx = (tx | 63) + 1;
+                continue;
+            }
+            bit = ((uint64_t) 1) << (tx & 63);
+            if ((row[tx >> 6] & bit) == 0)
+            {
+                tx++;
+                continue;
+            }
+            start = tx;
+            while ((tx <= tx2) && (row[tx >> 6] & bit))
+            {
+                row[tx >> 6] &= ~bit;
+                tx++;
+                bit = ((uint64_t) 1) << (tx & 63);
+            }
+            tile_box.x1 = start << shift;
+            tile_box.y1 = ty << shift;
+            tile_box.x2 = RDPMIN(tx << shift, clientCon->dirty_tiles_width);
+            tile_box.y2 = RDPMIN((ty + 1) << shift,
+                                 clientCon->dirty_tiles_height);
+            if ((tile_box.x1 < x1) || (tile_box.y1 < y1) ||
+                (tile_box.x2 > x2) || (tile_box.y2 > y2))
+            {
+                /* the tile sticks out of cap_rect, keep the rest dirty */
+                rdpRegionUnionRect(clientCon->dirtyRegion, &tile_box);
+            }
+            rects[num_rects].x = RDPMAX(tile_box.x1, x1);
+            rects[num_rects].y = ry1;
+            rects[num_rects].width = RDPMIN(tile_box.x2, x2) -
+                                     rects[num_rects].x;
+            rects[num_rects].height = ry2 - ry1;
+            num_rects++;
+        }
+        row_dirty = 0;
+        for (index = 0; index < words; index++)
+        {
+            row_dirty |= row[index] != 0;
+        }
+        if (!row_dirty)
+        {
+            clientCon->dirty_tile_rows[ty >> 6] &=
+                ~(((uint64_t) 1) << (ty & 63));
+        }
+        /* same runs as the band above, grow that band instead */
+        if ((prev_count > 0) && (prev_count == num_rects - band_start))
+        {
+            for (index = 0; index < prev_count; index++)
+            {
+                if ((rects[prev_start + index].x !=
+                     rects[band_start + index].x) ||
+                    (rects[prev_start + index].width !=
+                     rects[band_start + index].width))
+                {
+                    break;
+                }
+            }
+            if (index == prev_count)
+            {
+                for (index = 0; index < prev_count; index++)
+                {
+                    rects[prev_start + index].height += ry2 - ry1;
+                }
+                num_rects = band_start;
+                continue;
+            }
+        }
+        prev_start = band_start;
+        prev_count = num_rects - band_start;
+    }
+    if (num_rects > 0)
+    {
+        /* rects are in y then x order, one band per tile row */
+        reg = rdpRegionFromRects(num_rects, rects, CT_YXBANDED);
+        rdpRegionUnion(cap_dirty, cap_dirty, reg);
+        rdpRegionDestroy(reg);
+    }
+    free(rects);
+    return 0;
+}
+
+/******************************************************************************/
+/* returns boolean, true if there is anything left to capture */
+static int
+rdpClientConDirtyNotEmpty(rdpClientCon *clientCon)
+{
+    int index;
+    int rows_words;
+
+    if (rdpRegionNotEmpty(clientCon->dirtyRegion) ||
+        (clientCon->num_moves > 0))
+    {
+        return 1;
+    }
+    if (clientCon->dirty_tile_rows != NULL)
+    {
+        rows_words = ((clientCon->dirty_tiles_height - 1) >>
+                      clientCon->dirty_tile_shift) / 64 + 1;
+        for (index = 0; index < rows_words; index++)
+        {
+            if (clientCon->dirty_tile_rows[index] != 0)
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/******************************************************************************/
+static void
+rdpClientConDirtyReset(rdpClientCon *clientCon)
+{
+    int tiles_y;
+
+    rdpRegionDestroy(clientCon->dirtyRegion);
+    clientCon->dirtyRegion = rdpRegionCreate(NullBox, 0);
+    if (clientCon->dirty_tiles != NULL)
+    {
+        tiles_y = ((clientCon->dirty_tiles_height - 1) >>
+                   clientCon->dirty_tile_shift) + 1;
+        memset(clientCon->dirty_tiles, 0,
+               sizeof(uint64_t) * clientCon->dirty_tile_words * tiles_y);
+        memset(clientCon->dirty_tile_rows, 0,
+               sizeof(uint64_t) * (tiles_y / 64 + 1));
+    }
+}
+
+/******************************************************************************/
+/* returns boolean, true if any tile the box touches is dirty */
+static int
+rdpClientConDirtyTilesIntersect(rdpClientCon *clientCon, const BoxRec *box)
+{
+    int shift;
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+    int tx;
+    int ty;
+    uint64_t *row;
+
+    if (clientCon->dirty_tiles == NULL)
+    {
+        return 0;
+    }
+    x1 = RDPMAX(box->x1, 0);
+    y1 = RDPMAX(box->y1, 0);
+    x2 = RDPMIN(box->x2, clientCon->dirty_tiles_width);
+    y2 = RDPMIN(box->y2, clientCon->dirty_tiles_height);
+    if ((x2 <= x1) || (y2 <= y1))
+    {
+        return 0;
+    }
+    shift = clientCon->dirty_tile_shift;
+    for (ty = y1 >> shift; ty <= (y2 - 1) >> shift; ty++)
+    {
+        if ((clientCon->dirty_tile_rows[ty >> 6] &
+             (((uint64_t) 1) << (ty & 63))) == 0)
+        {
+            continue;
+        }
+        row = clientCon->dirty_tiles + ty * clientCon->dirty_tile_words;
+        for (tx = x1 >> shift; tx <= (x2 - 1) >> shift; tx++)
+        {
+            if (row[tx >> 6] & (((uint64_t) 1) << (tx & 63)))
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* returns boolean, true if part of reg is not up to date on the client */
+static int
+rdpClientConDirtyIntersects(rdpClientCon *clientCon, RegionPtr reg)
+{
+    RegionRec inter;
+    BoxPtr rects;
+    int num_rects;
+    int index;
+    int rv;
+
+    rdpRegionInit(&inter, NullBox, 0);
+    rdpRegionIntersect(&inter, reg, clientCon->dirtyRegion);
+    rv = rdpRegionNotEmpty(&inter);
+    rdpRegionUninit(&inter);
+    if (!rv && (clientCon->dirty_tiles != NULL))
+    {
+        rects = REGION_RECTS(reg);
+        num_rects = REGION_NUM_RECTS(reg);
+        for (index = 0; index < num_rects; index++)
         {
-            out_uint32_le(s, 0);                /* shmem_bytes */
+            if (rdpClientConDirtyTilesIntersect(clientCon, rects + index))
+            {
+                return 1;
+            }
         }
     }
+    return rv;
+}
 
-    rdpClientConEndUpdate(dev, clientCon);
+/******************************************************************************/
+/* drop the moves from first on, their dst gets captured instead
+   the later moves can read from a dropped one so they all go */
+static void
+rdpClientConMovesToDirty(rdpClientCon *clientCon, int first)
+{
+    int index;
 
-    return 0;
+    for (index = first; index < clientCon->num_moves; index++)
+    {
+        rdpRegionUnion(clientCon->dirtyRegion, clientCon->dirtyRegion,
+                       clientCon->moves[index].dst);
+        rdpRegionDestroy(clientCon->moves[index].dst);
+    }
+    clientCon->num_moves = RDPMIN(clientCon->num_moves, first);
 }
 
 /******************************************************************************/
-/* this is called to capture a rect from the screen, if in a multi monitor
-   session, this will get called for each monitor, if no monitor info
-   from the client, the rect will be a band of less than MAX_CAPTURE_PIXELS
-   pixels
-   after the capture, it sends the info to xrdp
+/* the client content under dst is about to change without a paint,
+   forget the rfx tile crcs there so those tiles are not skipped later */
+static void
+rdpClientConMoveCrcsReset(rdpClientCon *clientCon, RegionPtr dst)
+{
+    rdpPtr dev;
+    BoxPtr rects;
+    BoxRec mon_box;
+    int num_rects;
+    int mon_index;
+    int mon_count;
+    int crc_stride;
+    int crc_offset;
+    int index;
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+    int tx;
+    int ty;
+
+    dev = clientCon->dev;
+    rects = REGION_RECTS(dst);
+    num_rects = REGION_NUM_RECTS(dst);
+    mon_count = RDPMAX(dev->monitorCount, 1);
+    for (mon_index = 0; mon_index < mon_count; mon_index++)
+    {
+        if (clientCon->num_rfx_crcs_alloc[mon_index] < 1)
+        {
+            continue;
+        }
+        if (dev->monitorCount < 1)
+        {
+            mon_box.x1 = 0;
+            mon_box.y1 = 0;
+            mon_box.x2 = dev->width;
+            mon_box.y2 = dev->height;
+        }
+        else
+        {
+            mon_box.x1 = dev->minfo[mon_index].left;
+            mon_box.y1 = dev->minfo[mon_index].top;
+            mon_box.x2 = dev->minfo[mon_index].right + 1;
+            mon_box.y2 = dev->minfo[mon_index].bottom + 1;
+        }
+        crc_stride = (mon_box.x2 - mon_box.x1 + 63) / 64;
+        for (index = 0; index < num_rects; index++)
+        {
+            x1 = RDPMAX(rects[index].x1, mon_box.x1) - mon_box.x1;
+            y1 = RDPMAX(rects[index].y1, mon_box.y1) - mon_box.y1;
+            x2 = RDPMIN(rects[index].x2, mon_box.x2) - mon_box.x1;
+            y2 = RDPMIN(rects[index].y2, mon_box.y2) - mon_box.y1;
+            for (ty = y1 / 64; (x2 > x1) && (ty < (y2 + 63) / 64); ty++)
+            {
+                for (tx = x1 / 64; tx < (x2 + 63) / 64; tx++)
+                {
+                    crc_offset = ty * crc_stride + tx;
+                    if (crc_offset >= clientCon->num_rfx_crcs_alloc[mon_index])
+                    {
+                        continue;
+                    }
+                    if (clientCon->rfx_crcs[mon_index] != NULL)
+                    {
+                        clientCon->rfx_crcs[mon_index][crc_offset] = 0;
+                    }
+                    if (clientCon->rfx_src_crcs[mon_index] != NULL)
+                    {
+                        clientCon->rfx_src_crcs[mon_index][crc_offset] = 0;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/******************************************************************************/
+/* check the recorded moves still apply before a capture, the ones that do
+   not become dirty
+   legacy clients get screen blts now, they are drawing orders that pass
+   the encoder so only safe with no frame in flight, gfx clients get
+   surface to surface commands in the next frame
    returns error */
 static int
-rdpCapRect(rdpClientCon *clientCon, BoxPtr cap_rect, int mon,
-           struct image_data *id)
+rdpClientConMovesCheck(rdpPtr dev, rdpClientCon *clientCon)
+{
+    struct rdp_screen_move *move;
+    BoxRec rects[XRDP_MAX_SCREEN_MOVE_RECTS];
+    BoxRec dst;
+    int capture_code;
+    int num_rects;
+    int index;
+    int jndex;
+    int mon_index;
+    int ok;
+
+    if (clientCon->num_moves < 1)
+    {
+        return 0;
+    }
+    capture_code = clientCon->client_info.capture_code;
+    for (index = 0; index < clientCon->num_moves; index++)
+    {
+        move = clientCon->moves + index;
+        dst = *rdpRegionExtents(move->dst);
+        ok = (dst.x1 >= 0) && (dst.y1 >= 0) &&
+             (dst.x2 <= dev->width) && (dst.y2 <= dev->height) &&
+             (dst.x1 - move->dx >= 0) && (dst.y1 - move->dy >= 0) &&
+             (dst.x2 - move->dx <= dev->width) &&
+             (dst.y2 - move->dy <= dev->height);
+        mon_index = 0;
+        if (capture_code < 4)
+        {
+            ok = ok && (clientCon->rect_id == clientCon->rect_id_ack);
+        }
+        else if (ok && (dev->monitorCount > 0))
+        {
+            /* source and dest have to be on the same surface */
+            for (mon_index = 0; mon_index < dev->monitorCount; mon_index++)
+            {
+                if ((RDPMIN(dst.x1, dst.x1 - move->dx) >=
+                     dev->minfo[mon_index].left) &&
+                    (RDPMIN(dst.y1, dst.y1 - move->dy) >=
+                     dev->minfo[mon_index].top) &&
+                    (RDPMAX(dst.x2, dst.x2 - move->dx) <=
+                     dev->minfo[mon_index].right + 1) &&
+                    (RDPMAX(dst.y2, dst.y2 - move->dy) <=
+                     dev->minfo[mon_index].bottom + 1))
+                {
+                    break;
+                }
+            }
+            ok = mon_index < dev->monitorCount;
+        }
+        if (!ok)
+        {
+            LLOGLN(10, ("rdpClientConMovesCheck: dropping %d moves",
+                   clientCon->num_moves - index));
+            rdpClientConMovesToDirty(clientCon, index);
+            break;
+        }
+        move->mon = mon_index;
+        rdpClientConMoveCrcsReset(clientCon, move->dst);
+    }
+    if ((capture_code < 4) && (clientCon->num_moves > 0))
+    {
+        rdpClientConBeginUpdate(dev, clientCon);
+        for (index = 0; index < clientCon->num_moves; index++)
+        {
+            move = clientCon->moves + index;
+            num_rects = rdpScreenMoveRects(move, rects);
+            for (jndex = 0; jndex < num_rects; jndex++)
+            {
+                rdpClientConScreenBlt(dev, clientCon,
+                                      rects[jndex].x1, rects[jndex].y1,
+                                      rects[jndex].x2 - rects[jndex].x1,
+                                      rects[jndex].y2 - rects[jndex].y1,
+                                      rects[jndex].x1 - move->dx,
+                                      rects[jndex].y1 - move->dy);
+            }
+        }
+        rdpClientConEndUpdate(dev, clientCon);
+        rdpClientConMovesFree(clientCon);
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* capture the dirty part of cap_rect into the shm slot for the next frame,
+   surface gets what to send, monitor relative, and owns surface->dirty
+   and surface->rects
+   returns boolean, true if the capture ran */
+static int
+rdpCapSurface(rdpClientCon *clientCon, BoxPtr cap_rect, int mon,
+              struct image_data *id, struct rdp_cap_surface *surface)
 {
     RegionPtr cap_dirty;
     RegionPtr cap_dirty_save;
+    RegionPtr stale;
     BoxPtr rects;
     int num_rects;
+    int track_stale;
+    int index;
+    int pixels;
+    int rv;
 
     cap_dirty = rdpRegionCreate(cap_rect, 0);
-    LLOGLN(10, ("rdpCapRect: cap_rect x1 %d y1 %d x2 %d y2 %d",
+    LLOGLN(10, ("rdpCapSurface: cap_rect x1 %d y1 %d x2 %d y2 %d",
                cap_rect->x1, cap_rect->y1, cap_rect->x2, cap_rect->y2));
     rdpRegionIntersect(cap_dirty, cap_dirty, clientCon->dirtyRegion);
+    if (clientCon->dirty_tile_shift != 0)
+    {
+        rdpClientConDirtyTilesTake(clientCon, cap_rect, cap_dirty);
+    }
+    num_rects = REGION_NUM_RECTS(cap_dirty);
+    if (num_rects > 0)
+    {
+        rdpClientConSelectShmSlot(clientCon, id);
+    }
+    track_stale = rdpClientConShmRingTracksStale(clientCon);
+    if ((num_rects > 0) && track_stale)
+    {
+        /* the encoder reads the whole slot, bring it up to date */
+        stale = rdpRegionCreate(cap_rect, 0);
+        rdpRegionIntersect(stale, stale,
+                           clientCon->shm_slot_stale[clientCon->shm_slot]);
+        rdpRegionUnion(cap_dirty, cap_dirty, stale);
+        rdpRegionDestroy(stale);
+    }
     /* make a copy of cap_dirty because it may get altered */
     cap_dirty_save = rdpRegionCreate(NullBox, 0);
     rdpRegionCopy(cap_dirty_save, cap_dirty);
-    num_rects = REGION_NUM_RECTS(cap_dirty);
+    pixels = rdpRegionPixelCount(cap_dirty_save);
+    clientCon->pacing.pixels += pixels;
+    clientCon->stats.dirty_pixels += pixels;
+    RDP_TRACE(&(clientCon->dev->trace), cap_rect, 'B',
+              clientCon->conNumber, num_rects, pixels);
+    surface->dirty = cap_dirty;
+    surface->rects = NULL;
+    surface->num_rects = 0;
+    rv = FALSE;
     if (num_rects > 0)
     {
         rects = 0;
         num_rects = 0;
-        LLOGLN(10, ("rdpCapRect: capture_code %d",
+        LLOGLN(10, ("rdpCapSurface: capture_code %d",
                     clientCon->client_info.capture_code));
+        rdpLatencyCaptureStart(&(clientCon->latency));
         if (rdpCapture(clientCon, cap_dirty, &rects, &num_rects, id))
         {
-            LLOGLN(10, ("rdpCapRect: num_rects %d", num_rects));
+            rdpLatencyCaptureEnd(&(clientCon->latency));
+            rv = TRUE;
+            clientCon->stats.frames_captured++;
+            for (index = 0; index < num_rects; index++)
+            {
+                clientCon->stats.converted_pixels +=
+                    (rects[index].x2 - rects[index].x1) *
+                    (rects[index].y2 - rects[index].y1);
+            }
+            LLOGLN(10, ("rdpCapSurface: num_rects %d", num_rects));
             if (clientCon->send_key_frame[mon])
             {
                 clientCon->send_key_frame[mon] = 0;
                 id->flags = (enum xrdp_encoder_flags)
                             ((int)id->flags | KEY_FRAME_REQUESTED);
             }
-            rdpClientConSendPaintRectShmFd(clientCon->dev, clientCon, id,
-                                           cap_dirty, rects, num_rects);
-            free(rects);
+            surface->rects = rects;
+            surface->num_rects = num_rects;
+            if (track_stale)
+            {
+                for (index = 0; index < clientCon->shm_slot_count; index++)
+                {
+                    if (index == clientCon->shm_slot)
+                    {
+                        rdpRegionSubtract(clientCon->shm_slot_stale[index],
+                                          clientCon->shm_slot_stale[index],
+                                          cap_dirty_save);
+                    }
+                    else
+                    {
+                        rdpRegionUnion(clientCon->shm_slot_stale[index],
+                                       clientCon->shm_slot_stale[index],
+                                       cap_dirty_save);
+                    }
+                }
+            }
         }
         else
         {
-            LLOGLN(0, ("rdpCapRect: rdpCapture failed"));
+            LLOGLN(0, ("rdpCapSurface: rdpCapture failed"));
         }
     }
+    surface->id = *id;
     rdpRegionSubtract(clientCon->dirtyRegion, clientCon->dirtyRegion,
                       cap_dirty_save);
-    rdpRegionDestroy(cap_dirty);
     rdpRegionDestroy(cap_dirty_save);
+    RDP_TRACE(&(clientCon->dev->trace), cap_rect, 'E',
+              clientCon->conNumber, num_rects, pixels);
+    return rv;
+}
+
+/******************************************************************************/
+/* this is called to capture a rect from the screen, if in a multi monitor
+   session without gfx, this will get called for each monitor, if no
+   monitor info from the client, the rect will be a band of less than
+   MAX_CAPTURE_PIXELS pixels
+   after the capture, it sends the info to xrdp
+   returns error */
+static int
+rdpCapRect(rdpClientCon *clientCon, BoxPtr cap_rect, int mon,
+           struct image_data *id)
+{
+    struct rdp_cap_surface surface;
+
+    if (rdpCapSurface(clientCon, cap_rect, mon, id, &surface))
+    {
+        rdpClientConSendPaintRectShmFd(clientCon->dev, clientCon, id,
+                                       surface.dirty, surface.rects,
+                                       surface.num_rects);
+        free(surface.rects);
+    }
+    rdpRegionDestroy(surface.dirty);
     return 0;
 }
 
+/******************************************************************************/
+/* returns boolean, true if every monitor fits in one shm slot so they can
+   all go in one gfx frame, see rdpCapMonitors, never without
+   "MonitorFrames", stock xrdp does not know XRDP_PAINT_SHM_OFFSET */
+static int
+rdpClientConMonitorsFit(rdpClientCon *clientCon)
+{
+    rdpPtr dev;
+    int index;
+    int bytes;
+
+    dev = clientCon->dev;
+    if (!dev->monitor_frames ||
+        (clientCon->client_info.capture_code < 4) || (dev->monitorCount < 1))
+    {
+        return 0;
+    }
+    if (clientCon->client_info.capture_code != 4)
+    {
+        /* h264 captures in screen coordinates, monitors share the slot */
+        return 1;
+    }
+    bytes = 0;
+    for (index = 0; index < dev->monitorCount; index++)
+    {
+        bytes += rdpClientConRfxSurfaceBytes(
+                     dev->minfo[index].right - dev->minfo[index].left + 1,
+                     dev->minfo[index].bottom - dev->minfo[index].top + 1);
+    }
+    return bytes <= clientCon->shmem_bytes;
+}
+
+/******************************************************************************/
+/* returns boolean, true if any of box is dirty */
+static int
+rdpClientConBoxDirty(rdpClientCon *clientCon, BoxPtr box)
+{
+    if (rdpRegionContainsRect(clientCon->dirtyRegion, box) != rgnOUT)
+    {
+        return 1;
+    }
+    return (clientCon->dirty_tile_shift != 0) &&
+           rdpClientConDirtyTilesIntersect(clientCon, box);
+}
+
+/******************************************************************************/
+/* gfx multi monitor, capture the monitors into the same shm slot and send
+   them as one frame so they update together instead of one per ack
+   with rfx each monitor gets its own part of the slot, in monitor order
+   each monitor has its own ack window and pacing, one whose part of the
+   slot is still in flight or that is not due yet sits the frame out and
+   stays dirty, so a busy monitor does not hold up the others
+   returns the monitors left dirty, *paced gets how many of them only wait
+   for their pacing */
+static int
+rdpCapMonitors(rdpClientCon *clientCon, CARD32 now, int *paced)
+{
+    rdpPtr dev;
+    struct rdp_monitor_flow *flow;
+    struct rdp_cap_surface surfaces[16];
+    struct image_data id;
+    BoxRec cap_rect;
+    uint64_t start_us;
+    int capture_us[16];
+    int sent[16];
+    int offset;
+    int index;
+    int slot;
+    int rect_id;
+    int pixels;
+    int waiting;
+
+    dev = clientCon->dev;
+    slot = (clientCon->rect_id + 1) % clientCon->shm_slot_count;
+    offset = 0;
+    waiting = 0;
+    *paced = 0;
+    for (index = 0; index < dev->monitorCount; index++)
+    {
+        flow = clientCon->monitors + index;
+        cap_rect.x1 = dev->minfo[index].left;
+        cap_rect.y1 = dev->minfo[index].top;
+        cap_rect.x2 = dev->minfo[index].right + 1;
+        cap_rect.y2 = dev->minfo[index].bottom + 1;
+        rdpClientConGetScreenImageRect(dev, clientCon, &id);
+        id.left = cap_rect.x1;
+        id.top = cap_rect.y1;
+        id.width = cap_rect.x2 - cap_rect.x1;
+        id.height = cap_rect.y2 - cap_rect.y1;
+        id.flags = (index & 0xF) << 28;
+        if (clientCon->client_info.capture_code == 4)
+        {
+            id.shmem_offset = offset;
+            offset += rdpClientConRfxSurfaceBytes(id.width, id.height);
+        }
+        surfaces[index].id = id;
+        surfaces[index].dirty = NULL;
+        surfaces[index].rects = NULL;
+        surfaces[index].num_rects = 0;
+        capture_us[index] = 0;
+        if (!rdpClientConBoxDirty(clientCon, &cap_rect))
+        {
+            continue;
+        }
+        if (flow->slot_frame_id[slot] - clientCon->rect_id_ack > 0)
+        {
+            LLOGLN(10, ("rdpCapMonitors: monitor %d slot %d busy with "
+                   "frame %d", index, slot, flow->slot_frame_id[slot]));
+            flow->ack_waits++;
+            waiting++;
+            continue;
+        }
+        if ((CARD32) (now - flow->last_update_time) <
+            (CARD32) flow->pacing.interval_ms)
+        {
+            waiting++;
+            (*paced)++;
+            continue;
+        }
+        start_us = g_time_us();
+        pixels = clientCon->pacing.pixels;
+        rdpCapSurface(clientCon, &cap_rect, index, &id, surfaces + index);
+        flow->pacing.pixels += clientCon->pacing.pixels - pixels;
+        capture_us[index] = (int) (g_time_us() - start_us);
+    }
+    for (index = 0; index < dev->monitorCount; index++)
+    {
+        sent[index] = rdpClientConSurfaceGfxBytes(clientCon,
+                                                  surfaces + index) > 0;
+    }
+    rect_id = clientCon->rect_id;
+    rdpClientConSendPaintGfx(dev, clientCon, surfaces, dev->monitorCount);
+    for (index = 0; index < dev->monitorCount; index++)
+    {
+        if (sent[index] && (clientCon->rect_id != rect_id))
+        {
+            /* its part of the slot is busy until xrdp acks this frame */
+            flow = clientCon->monitors + index;
+            flow->slot_frame_id[clientCon->shm_slot] = clientCon->rect_id;
+            flow->last_update_time = now;
+            flow->frames++;
+            rdpPacingFrameSent(&(flow->pacing), clientCon->rect_id);
+            rdpPacingCaptureDone(&(flow->pacing), capture_us[index],
+                                 surfaces[index].id.width *
+                                 surfaces[index].id.height);
+        }
+        free(surfaces[index].rects);
+        if (surfaces[index].dirty != NULL)
+        {
+            rdpRegionDestroy(surfaces[index].dirty);
+        }
+    }
+    return waiting;
+}
+
 /******************************************************************************/
 static CARD32
 rdpDeferredUpdateCallback(OsTimerPtr timer, CARD32 now, pointer arg)
@@ -2891,8 +4973,12 @@ rdpDeferredUpdateCallback(OsTimerPtr timer, CARD32 now, pointer arg)
     int band_height;
     BoxRec cap_rect;
     BoxRec dirty_extents;
+    BoxRec tile_extents;
     int de_width;
     int de_height;
+    int paced;
+    int ack_wait;
+    uint64_t start_us;
 
     LLOGLN(10, ("rdpDeferredUpdateCallback:"));
     clientCon->updateScheduled = FALSE;
@@ -2908,23 +4994,59 @@ rdpDeferredUpdateCallback(OsTimerPtr timer, CARD32 now, pointer arg)
                clientCon->shmemstatus, clientCon->rect_id, clientCon->rect_id_ack));
         return 0;
     }
-    if ((clientCon->rect_id > clientCon->rect_id_ack) ||
-        /* do not allow captures until we have the client_info */
-        clientCon->client_info.size == 0)
+    /* without "MonitorFrames" a full ring always waits, with it only the
+       monitors whose part of the slot is busy wait, see rdpCapMonitors */
+    if (rdpClientConShmRingFull(clientCon) &&
+        (!clientCon->dev->monitor_frames ||
+         !rdpClientConMonitorsFit(clientCon)))
+    {
+        clientCon->stats.ack_waits++;
+        return 0;
+    }
+    /* do not allow captures until we have the client_info */
+    if (clientCon->client_info.size == 0)
+    {
+        return 0;
+    }
+    if (clientCon->out_queue.head != NULL)
     {
+        /* xrdp is not reading, rdpClientConFlush reschedules when the
+           queue drains */
+        LLOGLN(10, ("rdpDeferredUpdateCallback: out queue %d bytes",
+               clientCon->out_queue.bytes));
         return 0;
     }
     clientCon->lastUpdateTime = now;
+    start_us = g_time_us();
+    RDP_TRACE(&(clientCon->dev->trace), update, 'B',
+              clientCon->conNumber, clientCon->rect_id, 0);
     LLOGLN(10, ("rdpDeferredUpdateCallback: sending"));
     clientCon->updateRetries = 0;
+    ack_wait = FALSE;
     rdpClientConGetScreenImageRect(clientCon->dev, clientCon, &id);
     LLOGLN(10, ("rdpDeferredUpdateCallback: rdp_width %d rdp_height %d "
            "rdp_Bpp %d screen width %d screen height %d",
            clientCon->rdp_width, clientCon->rdp_height, clientCon->rdp_Bpp,
            id.width, id.height));
+    rdpClientConMovesCheck(clientCon->dev, clientCon);
     if (clientCon->dev->monitorCount < 1)
     {
         dirty_extents = *rdpRegionExtents(clientCon->dirtyRegion);
+        if ((clientCon->dirty_tile_shift != 0) &&
+            rdpClientConDirtyTilesExtents(clientCon, &tile_extents))
+        {
+            if (rdpRegionNotEmpty(clientCon->dirtyRegion))
+            {
+                dirty_extents.x1 = RDPMIN(dirty_extents.x1, tile_extents.x1);
+                dirty_extents.y1 = RDPMIN(dirty_extents.y1, tile_extents.y1);
+                dirty_extents.x2 = RDPMAX(dirty_extents.x2, tile_extents.x2);
+                dirty_extents.y2 = RDPMAX(dirty_extents.y2, tile_extents.y2);
+            }
+            else
+            {
+                dirty_extents = tile_extents;
+            }
+        }
         dirty_extents.x1 = RDPMAX(dirty_extents.x1, 0);
         dirty_extents.y1 = RDPMAX(dirty_extents.y1, 0);
         dirty_extents.x2 = RDPMIN(dirty_extents.x2, clientCon->rdp_width);
@@ -2939,11 +5061,18 @@ rdpDeferredUpdateCallback(OsTimerPtr timer, CARD32 now, pointer arg)
             band_height = MAX_CAPTURE_PIXELS / de_width;
             band_index = 0;
             band_count = (de_width * de_height / MAX_CAPTURE_PIXELS) + 1;
+            if ((clientCon->dirty_tile_shift != 0) &&
+                (band_height > (1 << clientCon->dirty_tile_shift)))
+            {
+                /* keep bands on tile rows so no tile is split */
+                band_height &= ~((1 << clientCon->dirty_tile_shift) - 1);
+                band_count = (de_height + band_height - 1) / band_height;
+            }
             LLOGLN(10, ("rdpDeferredUpdateCallback: band_index %d "
                    "band_count %d", band_index, band_count));
             while (band_index < band_count)
             {
-                if (clientCon->rect_id > clientCon->rect_id_ack)
+                if (rdpClientConShmRingFull(clientCon))
                 {
                     LLOGLN(10, ("rdpDeferredUpdateCallback: reschedule "
                            "rect_id %d rect_id_ack %d",
@@ -2962,15 +5091,26 @@ rdpDeferredUpdateCallback(OsTimerPtr timer, CARD32 now, pointer arg)
             if (band_index == band_count)
             {
                 /* gone through all bands, nothing changed */
-                rdpRegionDestroy(clientCon->dirtyRegion);
-                clientCon->dirtyRegion = rdpRegionCreate(NullBox, 0);
+                rdpClientConDirtyReset(clientCon);
             }
         }
         else
         {
             /* nothing changed in visible area */
-            rdpRegionDestroy(clientCon->dirtyRegion);
-            clientCon->dirtyRegion = rdpRegionCreate(NullBox, 0);
+            rdpClientConDirtyReset(clientCon);
+        }
+    }
+    else if (rdpClientConMonitorsFit(clientCon))
+    {
+        if (rdpCapMonitors(clientCon, now, &paced) == 0)
+        {
+            /* gone through all monitors, nothing changed */
+            rdpClientConDirtyReset(clientCon);
+        }
+        else if (paced == 0)
+        {
+            /* the rest wait on acks, those reschedule */
+            ack_wait = TRUE;
         }
     }
     else
@@ -2980,7 +5120,7 @@ rdpDeferredUpdateCallback(OsTimerPtr timer, CARD32 now, pointer arg)
         while (monitor_index < monitor_count)
         {
             // Did we get anything from the last monitor?
-            if (clientCon->rect_id > clientCon->rect_id_ack)
+            if (rdpClientConShmRingFull(clientCon))
             {
                 LLOGLN(10, ("rdpDeferredUpdateCallback: reschedule rect_id %d "
                        "rect_id_ack %d",
@@ -3006,11 +5146,22 @@ rdpDeferredUpdateCallback(OsTimerPtr timer, CARD32 now, pointer arg)
         if (monitor_index == monitor_count)
         {
             /* gone through all monitors, nothing changed */
-            rdpRegionDestroy(clientCon->dirtyRegion);
-            clientCon->dirtyRegion = rdpRegionCreate(NullBox, 0);
+            rdpClientConDirtyReset(clientCon);
         }
     }
-    if (rdpRegionNotEmpty(clientCon->dirtyRegion))
+    if ((clientCon->num_moves > 0) && !rdpClientConShmRingFull(clientCon))
+    {
+        /* nothing else was sent, the copies go in a frame of their own */
+        rdpClientConGetScreenImageRect(clientCon->dev, clientCon, &id);
+        rdpClientConSendPaintRectShmFd(clientCon->dev, clientCon, &id,
+                                       clientCon->dirtyRegion, NULL, 0);
+    }
+    rdpPacingCaptureDone(&(clientCon->pacing),
+                         (int) (g_time_us() - start_us),
+                         clientCon->dev->width * clientCon->dev->height);
+    RDP_TRACE(&(clientCon->dev->trace), update, 'E',
+              clientCon->conNumber, clientCon->rect_id, 0);
+    if (!ack_wait && rdpClientConDirtyNotEmpty(clientCon))
     {
         rdpScheduleDeferredUpdate(clientCon);
     }
@@ -3020,8 +5171,6 @@ rdpDeferredUpdateCallback(OsTimerPtr timer, CARD32 now, pointer arg)
 
 
 /******************************************************************************/
-#define MIN_MS_BETWEEN_FRAMES 40
-#define MIN_MS_TO_WAIT_FOR_MORE_UPDATES 4
 #define UPDATE_RETRY_TIMEOUT 200 // After this number of retries, give up and perform the capture anyway. This prevents an infinite loop.
 static void
 rdpScheduleDeferredUpdate(rdpClientCon *clientCon)
@@ -3029,6 +5178,8 @@ rdpScheduleDeferredUpdate(rdpClientCon *clientCon)
     uint32_t curTime;
     uint32_t msToWait;
     uint32_t minNextUpdateTime;
+    int interval_ms;
+    int index;
 
     if (clientCon->updateScheduled)
     {
@@ -3037,9 +5188,22 @@ rdpScheduleDeferredUpdate(rdpClientCon *clientCon)
     curTime = (uint32_t) GetTimeInMillis();
     /* use two separate delays in order to limit the update rate and wait a bit
        for more changes before sending an update. Always waiting the longer
-       delay would introduce unnecessarily much latency. */
-    msToWait = MIN_MS_TO_WAIT_FOR_MORE_UPDATES;
-    minNextUpdateTime = clientCon->lastUpdateTime + MIN_MS_BETWEEN_FRAMES;
+       delay would introduce unnecessarily much latency.
+       both come from the pacing, see rdpPacing.c */
+    msToWait = clientCon->pacing.wait_ms;
+    interval_ms = clientCon->pacing.interval_ms;
+    if (rdpClientConMonitorsFit(clientCon))
+    {
+        /* each monitor keeps its own pace, see rdpCapMonitors, wake up
+           for the quickest */
+        interval_ms = clientCon->pacing.max_interval_ms;
+        for (index = 0; index < clientCon->dev->monitorCount; index++)
+        {
+            interval_ms = RDPMIN(interval_ms,
+                                 clientCon->monitors[index].pacing.interval_ms);
+        }
+    }
+    minNextUpdateTime = clientCon->lastUpdateTime + interval_ms;
     /* the first check is to gracefully handle the infrequent case of
        the time wrapping around */
     if(clientCon->lastUpdateTime < curTime &&
@@ -3048,6 +5212,8 @@ rdpScheduleDeferredUpdate(rdpClientCon *clientCon)
         msToWait = minNextUpdateTime - curTime;
     }
 
+    RDP_TRACE(&(clientCon->dev->trace), schedule, 'i',
+              clientCon->conNumber, (int) msToWait, 0);
     clientCon->updateTimer = TimerSet(clientCon->updateTimer, 0,
                                       (CARD32) msToWait,
                                       rdpDeferredUpdateCallback,
@@ -3061,8 +5227,30 @@ int
 rdpClientConAddDirtyScreenReg(rdpPtr dev, rdpClientCon *clientCon,
                               RegionPtr reg)
 {
+    BoxPtr rects;
+    int num_rects;
+    int index;
+
     LLOGLN(10, ("rdpClientConAddDirtyScreenReg:"));
-    rdpRegionUnion(clientCon->dirtyRegion, clientCon->dirtyRegion, reg);
+    if (clientCon->dirty_tile_shift != 0)
+    {
+        rects = REGION_RECTS(reg);
+        num_rects = REGION_NUM_RECTS(reg);
+        for (index = 0; index < num_rects; index++)
+        {
+            if (rdpClientConDirtyTilesAddBox(clientCon, rects + index) != 0)
+            {
+                /* no bitmap, fall back to the region */
+                rdpRegionUnion(clientCon->dirtyRegion,
+                               clientCon->dirtyRegion, reg);
+                break;
+            }
+        }
+    }
+    else
+    {
+        rdpRegionUnion(clientCon->dirtyRegion, clientCon->dirtyRegion, reg);
+    }
     rdpScheduleDeferredUpdate(clientCon);
     return 0;
 }
@@ -3074,6 +5262,12 @@ rdpClientConAddDirtyScreenBox(rdpPtr dev, rdpClientCon *clientCon,
 {
     RegionPtr reg;
 
+    if ((clientCon->dirty_tile_shift != 0) &&
+        (rdpClientConDirtyTilesAddBox(clientCon, box) == 0))
+    {
+        rdpScheduleDeferredUpdate(clientCon);
+        return 0;
+    }
     reg = rdpRegionCreate(box, 0);
     rdpClientConAddDirtyScreenReg(dev, clientCon, reg);
     rdpRegionDestroy(reg);
@@ -3095,6 +5289,63 @@ rdpClientConAddDirtyScreen(rdpPtr dev, rdpClientCon *clientCon,
     return 0;
 }
 
+/******************************************************************************/
+/* reg was copied on the screen from reg translated by -dx, -dy
+   keep it as a move when the client already has the source, otherwise
+   it is just dirty */
+int
+rdpClientConAddDirtyScreenMove(rdpPtr dev, rdpClientCon *clientCon,
+                               RegionPtr reg, int dx, int dy)
+{
+    struct rdp_screen_move *move;
+    RegionRec src;
+    BoxRec box;
+    int capture_code;
+    int ok;
+
+    LLOGLN(10, ("rdpClientConAddDirtyScreenMove: dx %d dy %d", dx, dy));
+    if (!rdpRegionNotEmpty(reg))
+    {
+        return 0;
+    }
+    capture_code = clientCon->client_info.capture_code;
+    ok = dev->screen_copies && (clientCon->client_info.size != 0) &&
+         ((capture_code <= 2) || (capture_code == 4) ||
+          (capture_code == 5)) &&
+         (clientCon->num_moves < XRDP_MAX_SCREEN_MOVES) &&
+         (REGION_NUM_RECTS(reg) <= XRDP_MAX_SCREEN_MOVE_RECTS) &&
+         ((dx != 0) || (dy != 0));
+    if (ok)
+    {
+        box = *rdpRegionExtents(reg);
+        ok = (box.x1 >= 0) && (box.y1 >= 0) &&
+             (box.x2 <= dev->width) && (box.y2 <= dev->height) &&
+             (box.x1 - dx >= 0) && (box.y1 - dy >= 0) &&
+             (box.x2 - dx <= dev->width) && (box.y2 - dy <= dev->height);
+    }
+    if (ok)
+    {
+        rdpRegionInit(&src, NullBox, 0);
+        rdpRegionCopy(&src, reg);
+        rdpRegionTranslate(&src, -dx, -dy);
+        ok = !rdpClientConDirtyIntersects(clientCon, &src);
+        rdpRegionUninit(&src);
+    }
+    if (!ok)
+    {
+        return rdpClientConAddDirtyScreenReg(dev, clientCon, reg);
+    }
+    move = clientCon->moves + clientCon->num_moves;
+    move->dst = rdpRegionCreate(NullBox, 0);
+    rdpRegionCopy(move->dst, reg);
+    move->dx = dx;
+    move->dy = dy;
+    move->mon = 0;
+    clientCon->num_moves++;
+    rdpScheduleDeferredUpdate(clientCon);
+    return 0;
+}
+
 /******************************************************************************/
 void
 rdpClientConGetScreenImageRect(rdpPtr dev, rdpClientCon *clientCon,
@@ -3114,6 +5365,31 @@ rdpClientConGetScreenImageRect(rdpPtr dev, rdpClientCon *clientCon,
     id->shmem_bytes = clientCon->shmem_bytes;
     id->shmem_offset = 0;
     id->shmem_lineBytes = clientCon->shmem_lineBytes;
+    if (clientCon->zero_copy)
+    {
+        if (rdpClientConZeroCopy(dev, clientCon))
+        {
+            id->shmem_pixels = dev->pfbMemory;
+            id->shmem_fd = dev->fb_fd;
+            id->shmem_bytes = dev->fb_bytes;
+            id->shmem_lineBytes = dev->paddedWidthInBytes;
+        }
+        else
+        {
+            /* the screen changed under us, back to copying */
+            LLOGLN(0, ("rdpClientConGetScreenImageRect: zero copy off"));
+            clientCon->zero_copy = 0;
+            rdpClientConAllocateSharedMemory(clientCon,
+                                             clientCon->cap_width *
+                                             clientCon->cap_height *
+                                             clientCon->rdp_Bpp);
+            clientCon->pacing.slots = RDPMAX(clientCon->shm_slot_count, 1);
+            rdpClientConRegisterSharedMemory(dev, clientCon);
+            id->shmem_pixels = clientCon->shmemptr;
+            id->shmem_fd = clientCon->shmemfd;
+            id->shmem_bytes = clientCon->shmem_bytes;
+        }
+    }
 }
 
 /******************************************************************************/
@@ -3137,6 +5413,28 @@ rdpClientConAddAllReg(rdpPtr dev, RegionPtr reg, DrawablePtr pDrawable)
     return 0;
 }
 
+/******************************************************************************/
+int
+rdpClientConAddAllMove(rdpPtr dev, RegionPtr reg, int dx, int dy,
+                       DrawablePtr pDrawable)
+{
+    rdpClientCon *clientCon;
+    Bool drw_is_vis;
+
+    drw_is_vis = XRDP_DRAWABLE_IS_VISIBLE(dev, pDrawable);
+    if (!drw_is_vis)
+    {
+        return 0;
+    }
+    clientCon = dev->clientConHead;
+    while (clientCon != NULL)
+    {
+        rdpClientConAddDirtyScreenMove(dev, clientCon, reg, dx, dy);
+        clientCon = clientCon->next;
+    }
+    return 0;
+}
+
 /******************************************************************************/
 int
 rdpClientConAddAllBox(rdpPtr dev, BoxPtr box, DrawablePtr pDrawable)
@@ -26,6 +26,9 @@ Client connection to xrdp
 #include <xf86.h>
 
 #include "xrdp_client_info.h"
+#include "rdpPacing.h"
+#include "rdpOutQueue.h"
+#include "rdpLatency.h"
 
 #ifndef _RDPCLIENTCON_H
 #define _RDPCLIENTCON_H
@@ -49,6 +52,91 @@ struct rdpup_os_bitmap
     int stamp;
 };
 
+/* most shm frame buffers a connection can have in flight */
+#define XRDP_MAX_SHM_SLOTS 8
+
+/* set in the flags of msg 64 when the pixels are in the shared frame
+   buffer, a u32 frame buffer generation trails the message and the fd
+   only follows when the generation changes */
+#define XRDP_PAINT_SHARED_FB 0x00010000
+/* set in the flags of a paint when xrdp has the shm slot fds from msg 65,
+   the slot index always trails the message and no fd follows */
+#define XRDP_PAINT_SHM_REGISTERED 0x00020000
+/* set in the flags of a gfx wire to surface command when its pixels do not
+   start at the beginning of the shm slot, a u32 byte offset trails it */
+#define XRDP_PAINT_SHM_OFFSET 0x00040000
+
+/* most screen to screen copies held for one capture */
+#define XRDP_MAX_SCREEN_MOVES 16
+/* most rects in one of them */
+#define XRDP_MAX_SCREEN_MOVE_RECTS 16
+
+/* converted cursors kept per connection, see rdpCursor.c */
+#define XRDP_CURSOR_CACHE_SIZE 16
+
+/* a cursor converted for the client, data holds the pixels then the
+   mask, larger than 32x32 it is in shm so it can be sent again by fd */
+struct rdp_cursor_cache_entry
+{
+    CARD32 serial; /* CursorRec serialNumber, 0 when the entry is free */
+    int fgcolor; /* mono cursors can be recoloured */
+    int bgcolor;
+    int bpp;
+    int width;
+    int height;
+    int xhot;
+    int yhot;
+    int stamp;
+    uint8_t *data;
+    int bytes;
+    int fd; /* -1 when data is not shm */
+};
+
+/* a screen to screen copy not sent yet, dst is in screen coordinates and
+   came from dst translated by -dx, -dy */
+struct rdp_screen_move
+{
+    RegionPtr dst;
+    int dx;
+    int dy;
+    int mon; /* gfx surface it is sent to */
+};
+
+/* one monitor of a gfx frame, captured and waiting to be sent, dirty and
+   rects are monitor relative */
+struct rdp_cap_surface
+{
+    struct image_data id;
+    RegionPtr dirty;
+    BoxPtr rects;
+    int num_rects;
+};
+
+/* flow control of one monitor when gfx frames carry several, each monitor
+   has its own part of every shm slot, see rdpCapMonitors */
+struct rdp_monitor_flow
+{
+    /* last frame that used this monitor's part of each slot, the part is
+       free again once xrdp acks it */
+    int slot_frame_id[XRDP_MAX_SHM_SLOTS];
+    CARD32 last_update_time; /* millisecond timestamp */
+    int frames; /* frames this monitor was in */
+    int ack_waits; /* captures put off while its part of the slot was busy */
+    struct rdp_pacing pacing; /* time between its captures */
+};
+
+/* per connection counters, sent back on the control socket and logged
+   on SIGUSR1, see "StatsSignal" */
+struct rdp_con_stats
+{
+    int frames_captured;
+    int ack_waits; /* captures put off while the shm ring was full */
+    uint64_t dirty_pixels; /* damage handed to the capture */
+    uint64_t converted_pixels; /* what the capture converted */
+    int crc_tiles; /* rfx tiles hashed */
+    int crc_skips; /* of those, unchanged since last sent */
+};
+
 enum shared_memory_status {
     SHM_UNINITIALIZED = 0,
     SHM_RESIZING,
@@ -68,8 +156,14 @@ struct _rdpClientCon
     int sck;
     int sckControlListener;
     int sckControl;
+    char control_uds[256]; /* sckControlListener path */
     struct stream *out_s;
     struct stream *in_s;
+    /* what xrdp has not taken yet, see rdpOutQueue.c */
+    struct rdp_out_queue out_queue;
+    int want_write; /* boolean, sck is watched for writable */
+    int paint_frames; /* frame updates sent with a shm fd */
+    int paint_syscalls; /* send calls they took */
 
     int connected; /* boolean. Set to False when I/O fails */
     int begin; /* boolean */
@@ -106,29 +200,69 @@ struct _rdpClientCon
 
     struct xrdp_client_info client_info;
 
-    uint8_t *shmemptr;
+    uint8_t *shmemptr; /* slot the next frame is captured into */
     int shmemfd;
-    int shmem_bytes;
+    int shmem_bytes; /* size of one slot */
     int shmem_lineBytes;
     RegionPtr shmRegion;
     int rect_id;
     int rect_id_ack;
+    /* shm frame ring, frame rect_id is captured into slot
+       rect_id % shm_slot_count */
+    int shm_slot_count;
+    int shm_slot;
+    uint8_t *shm_slot_ptr[XRDP_MAX_SHM_SLOTS];
+    int shm_slot_fd[XRDP_MAX_SHM_SLOTS];
+    int shm_slot_frame_id[XRDP_MAX_SHM_SLOTS];
+    /* area captured into other slots since this one was last written */
+    RegionPtr shm_slot_stale[XRDP_MAX_SHM_SLOTS];
     enum shared_memory_status shmemstatus;
+    /* "ZeroCopy", xrdp reads the frame buffer itself, no shm slots */
+    int zero_copy;
+    int fb_gen_sent; /* dev->fb_gen whose fd xrdp has */
+    int shm_registered; /* boolean, xrdp has the slot fds, "ShmRegister" */
 
     OsTimerPtr updateTimer;
     CARD32 lastUpdateTime; /* millisecond timestamp */
     int updateScheduled; /* boolean */
     int updateRetries;
+    struct rdp_pacing pacing; /* time between captures */
+    struct rdp_latency latency; /* input to frame timing */
+    struct rdp_con_stats stats;
+    struct rdp_monitor_flow monitors[16]; /* gfx multi monitor */
 
     RegionPtr dirtyRegion;
+    /* tile dirty bitmap, see "DirtyTileSize", when dirty_tile_shift is
+       not zero drawing marks tiles here and dirtyRegion only holds what
+       is left of tiles captured partly */
+    int dirty_tile_shift;
+    int dirty_tiles_width; /* pixels the bitmap covers */
+    int dirty_tiles_height;
+    int dirty_tile_words; /* uint64_t words per tile row */
+    uint64_t *dirty_tiles;
+    uint64_t *dirty_tile_rows; /* one bit per tile row with a dirty tile */
+    /* copies the client replays ahead of the dirty region, in order */
+    struct rdp_screen_move moves[XRDP_MAX_SCREEN_MOVES];
+    int num_moves;
+
+    struct rdp_cursor_cache_entry cursors[XRDP_CURSOR_CACHE_SIZE];
+    int cursor_stamp;
+    int cursor_last; /* entry the client shows, -1 for none */
 
     int num_rfx_crcs_alloc[16];
-    int *rfx_crcs[16];
+    uint64_t *rfx_crcs[16];
+    uint64_t *rfx_src_crcs[16]; /* glamor, source side crcs */
     int send_key_frame[16];
 
     /* true = skip drawing */
     int suppress_output;
 
+    /* a mouse motion not posted yet, a later one replaces it */
+    int motion_pending; /* boolean */
+    int motion_x;
+    int motion_y;
+    int motion_coalesced; /* motions replaced */
+
     struct _rdpClientCon *next;
     struct _rdpClientCon *prev;
 };
@@ -142,8 +276,10 @@ rdpClientConSetFgcolor(rdpPtr dev, rdpClientCon *clientCon, int fgcolor);
 extern _X_EXPORT int
 rdpClientConFillRect(rdpPtr dev, rdpClientCon *clientCon,
                      short x, short y, int cx, int cy);
+#if XORG_VERSION_CURRENT < XORG_VERSION_NUMERIC(1, 18, 5, 0, 0)
 extern _X_EXPORT int
 rdpClientConCheck(ScreenPtr pScreen);
+#endif
 extern _X_EXPORT int
 rdpClientConInit(rdpPtr dev);
 extern _X_EXPORT int
@@ -176,6 +312,12 @@ rdpClientConAddAllReg(rdpPtr dev, RegionPtr reg, DrawablePtr pDrawable);
 extern _X_EXPORT int
 rdpClientConAddAllBox(rdpPtr dev, BoxPtr box, DrawablePtr pDrawable);
 extern _X_EXPORT int
+rdpClientConAddDirtyScreenMove(rdpPtr dev, rdpClientCon *clientCon,
+                               RegionPtr reg, int dx, int dy);
+extern _X_EXPORT int
+rdpClientConAddAllMove(rdpPtr dev, RegionPtr reg, int dx, int dy,
+                       DrawablePtr pDrawable);
+extern _X_EXPORT int
 rdpClientConSetCursor(rdpPtr dev, rdpClientCon *clientCon,
                       short x, short y, uint8_t *cur_data, uint8_t *cur_mask);
 extern _X_EXPORT int
@@ -184,8 +326,7 @@ rdpClientConSetCursorEx(rdpPtr dev, rdpClientCon *clientCon,
                         uint8_t *cur_mask, int bpp);
 extern _X_EXPORT int
 rdpClientConSetCursorShmFd(rdpPtr dev, rdpClientCon *clientCon,
-                           short x, short y,
-                           uint8_t *cur_data, uint8_t *cur_mask, int bpp,
+                           short x, short y, int fd, int bpp,
                            int width, int height);
 
 #endif
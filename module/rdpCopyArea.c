@@ -59,6 +59,37 @@ rdpCopyAreaOrg(DrawablePtr pSrc, DrawablePtr pDst, GCPtr pGC,
     return rv;
 }
 
+/******************************************************************************/
+/* a plain copy from a visible window, send the part that really came from
+   the source as a move, reg is the dest and gets what is left */
+static void
+rdpCopyAreaMove(rdpPtr dev, DrawablePtr pSrc, DrawablePtr pDst, GCPtr pGC,
+                RegionPtr reg, int dx, int dy)
+{
+    WindowPtr pSrcWin;
+    RegionRec moved;
+
+    pSrcWin = (WindowPtr) pSrc;
+    rdpRegionInit(&moved, NullBox, 0);
+    if (pGC->subWindowMode == IncludeInferiors)
+    {
+        rdpRegionCopy(&moved, &pSrcWin->borderClip);
+    }
+    else
+    {
+        rdpRegionCopy(&moved, &pSrcWin->clipList);
+    }
+    rdpRegionTranslate(&moved, dx, dy);
+    rdpRegionIntersect(&moved, &moved, reg);
+    rdpRegionSubtract(reg, reg, &moved);
+    rdpClientConAddAllMove(dev, &moved, dx, dy, pDst);
+    if (rdpRegionNotEmpty(reg))
+    {
+        rdpClientConAddAllReg(dev, reg, pDst);
+    }
+    rdpRegionUninit(&moved);
+}
+
 /******************************************************************************/
 RegionPtr
 rdpCopyArea(DrawablePtr pSrc, DrawablePtr pDst, GCPtr pGC,
@@ -90,7 +121,18 @@ rdpCopyArea(DrawablePtr pSrc, DrawablePtr pDst, GCPtr pGC,
     rv = rdpCopyAreaOrg(pSrc, pDst, pGC, srcx, srcy, w, h, dstx, dsty);
     if (cd != XRDP_CD_NODRAW)
     {
-        rdpClientConAddAllReg(dev, &reg, pDst);
+        if (dev->screen_copies && (pGC->alu == GXcopy) &&
+            ((pGC->planemask & 0xFFFFFF) == 0xFFFFFF) &&
+            XRDP_DRAWABLE_IS_VISIBLE(dev, pSrc))
+        {
+            rdpCopyAreaMove(dev, pSrc, pDst, pGC, &reg,
+                            box.x1 - (srcx + pSrc->x),
+                            box.y1 - (srcy + pSrc->y));
+        }
+        else
+        {
+            rdpClientConAddAllReg(dev, &reg, pDst);
+        }
     }
     rdpRegionUninit(&clip_reg);
     rdpRegionUninit(&reg);
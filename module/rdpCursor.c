@@ -51,6 +51,7 @@ cursor
 #include "rdp.h"
 #include "rdpDraw.h"
 #include "rdpClientCon.h"
+#include "rdpMisc.h"
 #include "rdpCursor.h"
 
 #ifndef X_BYTE_ORDER
@@ -118,109 +119,229 @@ rdpSpriteUnrealizeCursor(DeviceIntPtr pDev, ScreenPtr pScr, CursorPtr pCurs)
 }
 
 /******************************************************************************/
-static int
-get_pixel_safe(const uint8_t *data, int x, int y, int width, int height, int bpp)
+static void
+rdpCursorCacheFreeEntry(struct rdp_cursor_cache_entry *entry)
 {
-    int start;
-    int shift;
-    int c;
-    const uint32_t *src32;
-
-    if (x < 0)
+    if (entry->data != NULL)
     {
-        return 0;
+        if (entry->fd != -1)
+        {
+            /* xrdp keeps its own fd so it can still read it */
+            g_free_unmap_fd(entry->data, entry->fd, entry->bytes);
+        }
+        else
+        {
+            free(entry->data);
+        }
     }
+    memset(entry, 0, sizeof(struct rdp_cursor_cache_entry));
+    entry->fd = -1;
+}
 
-    if (y < 0)
-    {
-        return 0;
-    }
+/******************************************************************************/
+void
+rdpCursorCacheFree(rdpClientCon *clientCon)
+{
+    int index;
 
-    if (x >= width)
+    for (index = 0; index < XRDP_CURSOR_CACHE_SIZE; index++)
     {
-        return 0;
+        rdpCursorCacheFreeEntry(clientCon->cursors + index);
     }
+    clientCon->cursor_last = -1;
+}
 
-    if (y >= height)
-    {
-        return 0;
-    }
+/******************************************************************************/
+/* returns the entry index for the key, -1 if not cached */
+static int
+rdpCursorCacheFind(rdpClientCon *clientCon, CursorPtr pCurs,
+                   int fgcolor, int bgcolor, int bpp, int width, int height)
+{
+    struct rdp_cursor_cache_entry *entry;
+    int index;
 
-    if (bpp == 1)
+    for (index = 0; index < XRDP_CURSOR_CACHE_SIZE; index++)
     {
-        width = (width + 7) / 8;
-        start = (y * width) + x / 8;
-        shift = x % 8;
-        c = (uint8_t) (data[start]);
-#if (X_BYTE_ORDER == X_LITTLE_ENDIAN)
-        return (g_reverse_byte[c] & (0x80 >> shift)) != 0;
-#else
-        return (c & (0x80 >> shift)) != 0;
-#endif
-    }
-    else if (bpp == 32)
-    {
-        src32 = (const uint32_t *) data;
-        return src32[y * width + x];
+        entry = clientCon->cursors + index;
+        if ((entry->serial == pCurs->serialNumber) &&
+            (entry->data != NULL) &&
+            (entry->fgcolor == fgcolor) && (entry->bgcolor == bgcolor) &&
+            (entry->bpp == bpp) &&
+            (entry->width == width) && (entry->height == height))
+        {
+            return index;
+        }
     }
-
-    return 0;
+    return -1;
 }
 
 /******************************************************************************/
-static void
-set_pixel_safe(uint8_t *data, int x, int y, int width, int height, int bpp,
-               int pixel)
+/* returns a free or the least recently used entry index, -1 if the data
+   could not be allocated */
+static int
+rdpCursorCacheAlloc(rdpClientCon *clientCon, CursorPtr pCurs,
+                    int fgcolor, int bgcolor, int bpp, int width, int height)
 {
-    int start;
-    int shift;
-    uint32_t *dst32;
+    struct rdp_cursor_cache_entry *entry;
+    void *addr;
+    int index;
+    int lru;
+    int Bpp;
+    int bytes;
+    int fd;
 
-    if (x < 0)
+    lru = 0;
+    for (index = 0; index < XRDP_CURSOR_CACHE_SIZE; index++)
     {
-        return;
+        entry = clientCon->cursors + index;
+        if (entry->data == NULL)
+        {
+            lru = index;
+            break;
+        }
+        if (entry->stamp < clientCon->cursors[lru].stamp)
+        {
+            lru = index;
+        }
     }
-
-    if (y < 0)
+    entry = clientCon->cursors + lru;
+    rdpCursorCacheFreeEntry(entry);
+    if (clientCon->cursor_last == lru)
     {
-        return;
+        clientCon->cursor_last = -1;
     }
-
-    if (x >= width)
+    Bpp = (bpp == 0) ? 3 : (bpp + 7) / 8;
+    bytes = width * height * Bpp + width * height / 8;
+    if ((width == 32) && (height == 32))
     {
-        return;
+        entry->data = (uint8_t *) calloc(1, bytes);
+        if (entry->data == NULL)
+        {
+            return -1;
+        }
     }
-
-    if (y >= height)
+    else
     {
-        return;
+        /* written once, then only sent again, so xrdp never sees it
+           change under it */
+        if (g_alloc_shm_map_fd(&addr, &fd, bytes) != 0)
+        {
+            LLOGLN(0, ("rdpCursorCacheAlloc: g_alloc_shm_map_fd failed"));
+            return -1;
+        }
+        entry->data = (uint8_t *) addr;
+        entry->fd = fd;
     }
+    entry->bytes = bytes;
+    entry->serial = pCurs->serialNumber;
+    entry->fgcolor = fgcolor;
+    entry->bgcolor = bgcolor;
+    entry->bpp = bpp;
+    entry->width = width;
+    entry->height = height;
+    return lru;
+}
 
-    if (bpp == 1)
-    {
-        width = (width + 7) / 8;
-        start = (y * width) + x / 8;
-        shift = x % 8;
+/******************************************************************************/
+/* one row of a mono cursor, the X bitmaps are in server bit order, the
+   client wants msb first with the AND mask inverted and 24 bpp pixels
+   where the X mask is set */
+static void
+rdpCursorConvertMonoRow(const uint8_t *src, const uint8_t *src_mask,
+                        int src_bytes, uint8_t *dst, uint8_t *dst_mask,
+                        int dst_bytes, int fgcolor, int bgcolor)
+{
+    int index;
+    int bit;
+    int s8;
+    int m8;
+    int pixel;
 
-        if (pixel & 1)
+    for (index = 0; index < dst_bytes; index++)
+    {
+        if (index >= src_bytes)
         {
-            data[start] = data[start] | (0x80 >> shift);
+            /* past the X bitmap, transparent */
+            dst_mask[index] = 0xff;
+            continue;
         }
-        else
+#if (X_BYTE_ORDER == X_LITTLE_ENDIAN)
+        s8 = g_reverse_byte[src[index]];
+        m8 = g_reverse_byte[src_mask[index]];
+#else
+        s8 = src[index];
+        m8 = src_mask[index];
+#endif
+        dst_mask[index] = ~m8;
+        for (bit = 0; m8 != 0; bit++, m8 = (m8 << 1) & 0xff, s8 <<= 1)
         {
-            data[start] = data[start] & ~(0x80 >> shift);
+            if (m8 & 0x80)
+            {
+                pixel = (s8 & 0x80) ? fgcolor : bgcolor;
+                dst[(index * 8 + bit) * 3 + 0] = pixel;
+                dst[(index * 8 + bit) * 3 + 1] = pixel >> 8;
+                dst[(index * 8 + bit) * 3 + 2] = pixel >> 16;
+            }
         }
     }
-    else if (bpp == 24)
+}
+
+/******************************************************************************/
+/* fill entry->data for pCurs, a row at a time, the client wants the rows
+   bottom up, entry->data is zeroed */
+static void
+rdpCursorConvert(CursorPtr pCurs, struct rdp_cursor_cache_entry *entry)
+{
+    uint8_t *cur_data;
+    uint8_t *cur_mask;
+    const uint8_t *data;
+    const uint8_t *mask;
+    int jndex;
+    int rows;
+    int copy_width;
+    int paddedRowBytes;
+    int sending_width;
+    int sending_height;
+    int dst_row;
+
+    sending_width = entry->width;
+    sending_height = entry->height;
+    rows = RDPMIN(pCurs->bits->height, sending_height);
+    cur_data = entry->data;
+    cur_mask = cur_data + (entry->bytes - sending_width * sending_height / 8);
+    entry->xhot = pCurs->bits->xhot;
+    entry->yhot = pCurs->bits->yhot;
+    if (entry->bpp == 32)
     {
-        *(data + (3 * (y * width + x)) + 0) = pixel >> 0;
-        *(data + (3 * (y * width + x)) + 1) = pixel >> 8;
-        *(data + (3 * (y * width + x)) + 2) = pixel >> 16;
+        paddedRowBytes = PixmapBytePad(pCurs->bits->width, 32);
+        copy_width = RDPMIN(paddedRowBytes / 4, sending_width);
+        data = (const uint8_t *)(pCurs->bits->argb);
+        /* the AND mask stays clear, alpha does the work */
+        for (jndex = 0; jndex < rows; jndex++)
+        {
+            dst_row = (sending_height - 1) - jndex;
+            memcpy(cur_data + dst_row * sending_width * 4,
+                   data + jndex * paddedRowBytes, copy_width * 4);
+        }
     }
-    else if (bpp == 32)
+    else
     {
-        dst32 = (uint32_t *) data;
-        dst32[y * width + x] = pixel;
+        paddedRowBytes = PixmapBytePad(pCurs->bits->width, 1);
+        data = (const uint8_t *)(pCurs->bits->source);
+        mask = (const uint8_t *)(pCurs->bits->mask);
+        for (jndex = 0; jndex < rows; jndex++)
+        {
+            dst_row = (sending_height - 1) - jndex;
+            rdpCursorConvertMonoRow(data + jndex * paddedRowBytes,
+                                    mask + jndex * paddedRowBytes,
+                                    paddedRowBytes,
+                                    cur_data + dst_row * sending_width * 3,
+                                    cur_mask + dst_row * sending_width / 8,
+                                    sending_width / 8,
+                                    entry->fgcolor, entry->bgcolor);
+        }
+        /* rows below the X bitmap are transparent, they are at the top */
+        memset(cur_mask, 0xff, (sending_height - rows) * sending_width / 8);
     }
 }
 
@@ -230,18 +351,10 @@ rdpSpriteSetCursorCon(rdpClientCon *clientCon,
                       DeviceIntPtr pDev, ScreenPtr pScr, CursorPtr pCurs,
                       int x, int y)
 {
-    uint8_t *cur_data;
-    uint8_t *cur_mask;
-    uint8_t *mask;
-    uint8_t *data;
-    int index;
-    int jndex;
+    struct rdp_cursor_cache_entry *entry;
+    int cache_index;
     int server_width;
     int server_height;
-    int pixel;
-    int xhot;
-    int yhot;
-    int paddedRowBytes;
     int fgcolor;
     int bgcolor;
     int client_max_width;
@@ -270,12 +383,6 @@ rdpSpriteSetCursorCon(rdpClientCon *clientCon,
     {
         return;
     }
-    cur_data = (uint8_t *)calloc(1, 96 * 96 * 4 + 96 * 96 / 8);
-    if (cur_data == NULL)
-    {
-        return;
-    }
-    cur_mask = cur_data + 96 * 96 * 4;
     client_max_width = 32;
     client_max_height = 32;
     sending_bpp = 0;
@@ -312,77 +419,56 @@ rdpSpriteSetCursorCon(rdpClientCon *clientCon,
            "server_width %d server_height %d sending_bpp %d",
            sending_width, sending_height, server_width, server_height,
            sending_bpp));
-    if (sending_bpp == 32)
+    fgcolor = 0;
+    bgcolor = 0;
+    if (sending_bpp != 32)
     {
-        paddedRowBytes = PixmapBytePad(server_width, 32);
-        xhot = pCurs->bits->xhot;
-        yhot = pCurs->bits->yhot;
-        data = (uint8_t *)(pCurs->bits->argb);
-        memset(cur_data, 0, 96 * 96 * 4);
-        memset(cur_mask, 0, 96 * 96 / 8);
-        for (jndex = 0; jndex < sending_height; jndex++)
-        {
-            for (index = 0; index < sending_width; index++)
-            {
-                pixel = get_pixel_safe(data, index, jndex, paddedRowBytes / 4,
-                                   server_height, 32);
-                set_pixel_safe(cur_data, index, (sending_height - 1) - jndex,
-                               sending_width, sending_height, 32, pixel);
-            }
-        }
-    }
-    else
-    {
-        paddedRowBytes = PixmapBytePad(server_width, 1);
-        xhot = pCurs->bits->xhot;
-        yhot = pCurs->bits->yhot;
-        data = (uint8_t *)(pCurs->bits->source);
-        mask = (uint8_t *)(pCurs->bits->mask);
         fgcolor = (((pCurs->foreRed >> 8) & 0xff) << 16) |
                   (((pCurs->foreGreen >> 8) & 0xff) << 8) |
                   ((pCurs->foreBlue >> 8) & 0xff);
         bgcolor = (((pCurs->backRed >> 8) & 0xff) << 16) |
                   (((pCurs->backGreen >> 8) & 0xff) << 8) |
                   ((pCurs->backBlue >> 8) & 0xff);
-        memset(cur_data, 0, 96 * 96 * 4);
-        memset(cur_mask, 0, 96 * 96 / 8);
-        for (jndex = 0; jndex < sending_height; jndex++)
+    }
+    cache_index = rdpCursorCacheFind(clientCon, pCurs, fgcolor, bgcolor,
+                                     sending_bpp, sending_width,
+                                     sending_height);
+    if (cache_index == -1)
+    {
+        cache_index = rdpCursorCacheAlloc(clientCon, pCurs, fgcolor, bgcolor,
+                                          sending_bpp, sending_width,
+                                          sending_height);
+        if (cache_index == -1)
         {
-            for (index = 0; index < sending_width; index++)
-            {
-                pixel = get_pixel_safe(mask, index, jndex,
-                                       paddedRowBytes * 8,
-                                       server_height, 1);
-                set_pixel_safe(cur_mask, index,
-                               (sending_height - 1) - jndex,
-                               sending_width, sending_height, 1, !pixel);
-                if (pixel != 0)
-                {
-                    pixel = get_pixel_safe(data, index, jndex,
-                                           paddedRowBytes * 8,
-                                           server_height, 1);
-                    pixel = pixel ? fgcolor : bgcolor;
-                    set_pixel_safe(cur_data, index,
-                                   (sending_height - 1) - jndex,
-                                   sending_width, sending_height, 24, pixel);
-                }
-            }
+            return;
         }
+        rdpCursorConvert(pCurs, clientCon->cursors + cache_index);
+    }
+    else if (cache_index == clientCon->cursor_last)
+    {
+        LLOGLN(10, ("rdpSpriteSetCursorCon: client shows it already"));
+        return;
     }
+    entry = clientCon->cursors + cache_index;
+    entry->stamp = ++(clientCon->cursor_stamp);
+    clientCon->cursor_last = cache_index;
     rdpClientConBeginUpdate(clientCon->dev, clientCon);
-    if ((sending_width == 32) && (sending_height == 32))
+    if (entry->fd == -1)
     {
-        rdpClientConSetCursorEx(clientCon->dev, clientCon, xhot, yhot,
-                                cur_data, cur_mask, sending_bpp);
+        rdpClientConSetCursorEx(clientCon->dev, clientCon,
+                                entry->xhot, entry->yhot,
+                                entry->data,
+                                entry->data + entry->bytes - 32 * 32 / 8,
+                                entry->bpp);
     }
     else
     {
-        rdpClientConSetCursorShmFd(clientCon->dev, clientCon, xhot, yhot,
-                                   cur_data, cur_mask, sending_bpp,
-                                   sending_width, sending_height);
+        rdpClientConSetCursorShmFd(clientCon->dev, clientCon,
+                                   entry->xhot, entry->yhot, entry->fd,
+                                   entry->bpp,
+                                   entry->width, entry->height);
     }
     rdpClientConEndUpdate(clientCon->dev, clientCon);
-    free(cur_data);
 }
 
 /******************************************************************************/
@@ -41,5 +41,7 @@ extern _X_EXPORT Bool
 rdpSpriteDeviceCursorInitialize(DeviceIntPtr pDev, ScreenPtr pScr);
 extern _X_EXPORT void
 rdpSpriteDeviceCursorCleanup(DeviceIntPtr pDev, ScreenPtr pScr);
+extern _X_EXPORT void
+rdpCursorCacheFree(rdpClientCon *clientCon);
 
 #endif
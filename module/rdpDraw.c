@@ -331,6 +331,13 @@ rdpCopyWindow(WindowPtr pWin, DDXPointRec ptOldOrg, RegionPtr pOldRegion)
     if ((num_clip_rects == 0) || (num_reg_rects == 0))
     {
     }
+    else if (dev->screen_copies)
+    {
+        /* the window content moved as is, let the client copy it */
+        rdpRegionTranslate(&reg, dx, dy);
+        rdpRegionIntersect(&reg, &reg, &clip);
+        rdpClientConAddAllMove(dev, &reg, dx, dy, &(pWin->drawable));
+    }
     else
     {
         if ((num_clip_rects > 16) || (num_reg_rects > 16))
@@ -393,6 +400,80 @@ rdpCloseScreen(ScreenPtr pScreen)
 
 #endif
 
+/******************************************************************************/
+/* allocate the frame buffer for dev->sizeInBytes, from a memfd xrdp can
+   map when "ZeroCopy" is on, else from the heap, huge page backed when
+   "HugePages" is on */
+void
+rdpAllocFramebuffer(rdpPtr dev)
+{
+    void *ptr;
+    int fd;
+    int bytes;
+    int rv;
+
+    rdpFreeFramebuffer(dev);
+    bytes = dev->sizeInBytes;
+    if (dev->huge_pages)
+    {
+        bytes = g_huge_page_round(bytes);
+    }
+    if (dev->zero_copy)
+    {
+        if (dev->huge_pages)
+        {
+            rv = g_alloc_huge_map_fd(&ptr, &fd, bytes);
+        }
+        else
+        {
+            rv = g_alloc_memfd_map_fd(&ptr, &fd, bytes);
+        }
+        if (rv == 0)
+        {
+            dev->pfbMemory = (uint8_t *) ptr;
+            dev->fb_fd = fd;
+            dev->fb_bytes = bytes;
+            dev->fb_gen++;
+            LLOGLN(0, ("rdpAllocFramebuffer: shared fb_fd %d bytes %d "
+                   "fb_gen %d", fd, dev->fb_bytes, dev->fb_gen));
+            return;
+        }
+        LLOGLN(0, ("rdpAllocFramebuffer: shared allocation failed, "
+               "not sharing the frame buffer"));
+    }
+    if (dev->huge_pages)
+    {
+        ptr = g_alloc_huge(bytes);
+        if (ptr != NULL)
+        {
+            dev->pfbMemory = (uint8_t *) ptr;
+            dev->fb_bytes = bytes;
+            return;
+        }
+    }
+    dev->pfbMemory_alloc = g_new0(uint8_t, dev->sizeInBytes + 16);
+    dev->pfbMemory = (uint8_t *) RDPALIGN(dev->pfbMemory_alloc, 16);
+}
+
+/******************************************************************************/
+void
+rdpFreeFramebuffer(rdpPtr dev)
+{
+    if (dev->fb_fd != -1)
+    {
+        g_free_unmap_fd(dev->pfbMemory, dev->fb_fd, dev->fb_bytes);
+        dev->fb_fd = -1;
+    }
+    else if (dev->fb_bytes > 0)
+    {
+        g_free_huge(dev->pfbMemory, dev->fb_bytes);
+    }
+    dev->fb_bytes = 0;
+    free(dev->pfbMemory_alloc);
+    dev->pfbMemory_alloc = NULL;
+    dev->pfbMemory = NULL;
+}
+
 /******************************************************************************/
 WindowPtr
 rdpGetRootWindowPtr(ScreenPtr pScreen)
@@ -102,6 +102,10 @@ rdpCloseScreen(int index, ScreenPtr pScreen);
 extern _X_EXPORT Bool
 rdpCloseScreen(ScreenPtr pScreen);
 #endif
+extern _X_EXPORT void
+rdpAllocFramebuffer(rdpPtr dev);
+extern _X_EXPORT void
+rdpFreeFramebuffer(rdpPtr dev);
 extern _X_EXPORT WindowPtr
 rdpGetRootWindowPtr(ScreenPtr pScreen);
 extern _X_EXPORT rdpPtr
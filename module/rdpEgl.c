@@ -551,7 +551,6 @@ rdpEglOut(rdpClientCon *clientCon, struct rdp_egl *egl, RegionPtr in_reg,
     int crc_offset;
     int crc_stride;
     int crc;
-    int num_crcs;
     int tile_extents_stride;
     int mon_index;
 
@@ -566,18 +565,7 @@ rdpEglOut(rdpClientCon *clientCon, struct rdp_egl *egl, RegionPtr in_reg,
     }
     dst = id->shmem_pixels;
     dst_stride = ((id->width + 63) & ~63) * 4;
-    /* check crc list size */
     crc_stride = (id->width + 63) / 64;
-    num_crcs = crc_stride * ((id->height + 63) / 64);
-    if (num_crcs != clientCon->num_rfx_crcs_alloc[mon_index])
-    {
-        LLOGLN(0, ("rdpEglOut: resize the crc list was %d now %d",
-               clientCon->num_rfx_crcs_alloc[mon_index], num_crcs));
-        /* resize the crc list */
-        clientCon->num_rfx_crcs_alloc[mon_index] = num_crcs;
-        free(clientCon->rfx_crcs[mon_index]);
-        clientCon->rfx_crcs[mon_index] = g_new0(int, num_crcs);
-    }
     tile_extents_stride = (tile_extents_rect->x2 - tile_extents_rect->x1) / 64;
     out_rect_index = 0;
     y = tile_extents_rect->y1;
@@ -621,7 +609,8 @@ rdpEglOut(rdpClientCon *clientCon, struct rdp_egl *egl, RegionPtr in_reg,
 #endif
                 crc = crcs[(ly / 64) * tile_extents_stride + (lx / 64)];
                 crc_offset = (y / 64) * crc_stride + (x / 64);
-                if (crc == clientCon->rfx_crcs[mon_index][crc_offset])
+                if ((uint32_t) crc ==
+                    clientCon->rfx_crcs[mon_index][crc_offset])
                 {
                     LLOGLN(10, ("rdpEglOut: crc skip at x %d y %d", x, y));
                     rdpRegionInit(&tile_reg, &rect, 0);
@@ -632,7 +621,7 @@ rdpEglOut(rdpClientCon *clientCon, struct rdp_egl *egl, RegionPtr in_reg,
                 {
                     glReadPixels(lx, ly, 64, 64, GL_BGRA,
                                  GL_UNSIGNED_INT_8_8_8_8_REV, tile_dst);
-                    clientCon->rfx_crcs[mon_index][crc_offset] = crc;
+                    clientCon->rfx_crcs[mon_index][crc_offset] = (uint32_t) crc;
                     out_rects[out_rect_index] = rect;
                     if (out_rect_index < RDP_MAX_TILES)
                     {
@@ -655,6 +644,109 @@ rdpEglOut(rdpClientCon *clientCon, struct rdp_egl *egl, RegionPtr in_reg,
     return 0;
 }
 
+/******************************************************************************/
+/* make sure the crc lists match the monitor size */
+static int
+rdpEglCrcListCheck(rdpClientCon *clientCon, struct image_data *id)
+{
+    int crc_stride;
+    int num_crcs;
+    int mon_index;
+
+    mon_index = (id->flags >> 28) & 0xF;
+    crc_stride = (id->width + 63) / 64;
+    num_crcs = crc_stride * ((id->height + 63) / 64);
+    if ((num_crcs != clientCon->num_rfx_crcs_alloc[mon_index]) ||
+        (clientCon->rfx_src_crcs[mon_index] == NULL))
+    {
+        LLOGLN(0, ("rdpEglCrcListCheck: resize the crc list was %d now %d",
+               clientCon->num_rfx_crcs_alloc[mon_index], num_crcs));
+        /* resize the crc list */
+        clientCon->num_rfx_crcs_alloc[mon_index] = num_crcs;
+        free(clientCon->rfx_crcs[mon_index]);
+        clientCon->rfx_crcs[mon_index] = g_new0(uint64_t, num_crcs);
+        free(clientCon->rfx_src_crcs[mon_index]);
+        clientCon->rfx_src_crcs[mon_index] = g_new0(uint64_t, num_crcs);
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* drop the fully dirty tiles whose source crc matches the last one sent
+ * from in_reg, before any yuv work is done
+ * a partly dirty tile only updates part of the client's copy so it
+ * clears the tile's entry, valid entries have bit 32 set
+ * returns the number of tiles left */
+static int
+rdpEglSrcCheck(rdpClientCon *clientCon, RegionPtr in_reg,
+               struct image_data *id, BoxPtr tile_extents_rect,
+               int *src_crcs)
+{
+    int x;
+    int y;
+    int lx;
+    int ly;
+    int rcode;
+    int crc_offset;
+    int crc_stride;
+    int tile_extents_stride;
+    int mon_index;
+    int num_tiles;
+    uint64_t crc;
+    uint64_t *last_crcs;
+    BoxRec rect;
+    RegionRec tile_reg;
+
+    mon_index = (id->flags >> 28) & 0xF;
+    last_crcs = clientCon->rfx_src_crcs[mon_index];
+    crc_stride = (id->width + 63) / 64;
+    tile_extents_stride = (tile_extents_rect->x2 - tile_extents_rect->x1) / 64;
+    num_tiles = 0;
+    for (y = tile_extents_rect->y1; y < tile_extents_rect->y2;
+         y += XRDP_RFX_ALIGN)
+    {
+        for (x = tile_extents_rect->x1; x < tile_extents_rect->x2;
+             x += XRDP_RFX_ALIGN)
+        {
+            rect.x1 = x;
+            rect.y1 = y;
+            rect.x2 = rect.x1 + 64;
+            rect.y2 = rect.y1 + 64;
+            rcode = rdpRegionContainsRect(in_reg, &rect);
+            if (rcode == rgnOUT)
+            {
+                continue;
+            }
+            crc_offset = (y / 64) * crc_stride + (x / 64);
+            if (rcode == rgnPART)
+            {
+                last_crcs[crc_offset] = 0;
+                num_tiles++;
+                continue;
+            }
+            lx = x - tile_extents_rect->x1;
+            ly = y - tile_extents_rect->y1;
+            crc = (uint32_t) src_crcs[(ly / 64) * tile_extents_stride +
+                                      (lx / 64)];
+            crc |= ((uint64_t) 1) << 32;
+            if (crc == last_crcs[crc_offset])
+            {
+                LLOGLN(10, ("rdpEglSrcCheck: src crc skip at x %d y %d",
+                       x, y));
+                rdpRegionInit(&tile_reg, &rect, 0);
+                rdpRegionSubtract(in_reg, in_reg, &tile_reg);
+                rdpRegionUninit(&tile_reg);
+            }
+            else
+            {
+                last_crcs[crc_offset] = crc;
+                num_tiles++;
+            }
+        }
+    }
+    return num_tiles;
+}
+
 /******************************************************************************/
 static int
 rdpEglRfxClear(GCPtr rfxGC, PixmapPtr yuv_pixmap, BoxPtr tile_extents_rect,
@@ -698,6 +790,8 @@ rdpEglCaptureRfx(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
     rdpPtr dev;
     struct rdp_egl *egl;
     int *crcs;
+    int *src_crcs;
+    int num_tiles;
 
     dev = clientCon->dev;
     pScreen = dev->pScreen;
@@ -724,11 +818,17 @@ rdpEglCaptureRfx(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
     height = tile_extents_rect.y2 - tile_extents_rect.y1;
     LLOGLN(10, ("rdpEglCaptureRfx: width %d height %d", width, height));
     crcs = g_new(int, (width / 64) * (height / 64));
-    if (crcs == NULL)
+    src_crcs = g_new(int, (width / 64) * (height / 64));
+    if ((crcs == NULL) || (src_crcs == NULL))
     {
-        free(out_rects);
+        free(crcs);
+        free(src_crcs);
+        free(*out_rects);
+        *out_rects = NULL;
         return FALSE;
     }
+    *num_out_rects = 0;
+    rdpEglCrcListCheck(clientCon, id);
     rfxGC = GetScratchGC(dev->depth, pScreen);
     if (rfxGC != NULL)
     {
@@ -760,14 +860,22 @@ rdpEglCaptureRfx(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
                                          tile_extents_rect.x1 + id->left,
                                          tile_extents_rect.y1 + id->top,
                                          width, height, 0, 0);
-                    rdpEglRfxRgbToYuv(egl, tex, yuv_tex, width, height);
-                    rdpEglRfxClear(rfxGC, yuv_pixmap, &tile_extents_rect,
-                                   in_reg);
-                    rdpEglRfxYuvToYuvlp(egl, yuv_tex, tex, width, height);
-                    rdpEglRfxCrc(egl, tex, crc_tex, width, height, crcs);
-                    rdpEglOut(clientCon, egl, in_reg, *out_rects,
-                              num_out_rects, id, tex, &tile_extents_rect,
-                              crcs);
+                    /* crc the source first, unchanged tiles skip the
+                       yuv passes and the read back */
+                    rdpEglRfxCrc(egl, tex, crc_tex, width, height, src_crcs);
+                    num_tiles = rdpEglSrcCheck(clientCon, in_reg, id,
+                                               &tile_extents_rect, src_crcs);
+                    if (num_tiles > 0)
+                    {
+                        rdpEglRfxRgbToYuv(egl, tex, yuv_tex, width, height);
+                        rdpEglRfxClear(rfxGC, yuv_pixmap, &tile_extents_rect,
+                                       in_reg);
+                        rdpEglRfxYuvToYuvlp(egl, yuv_tex, tex, width, height);
+                        rdpEglRfxCrc(egl, tex, crc_tex, width, height, crcs);
+                        rdpEglOut(clientCon, egl, in_reg, *out_rects,
+                                  num_out_rects, id, tex, &tile_extents_rect,
+                                  crcs);
+                    }
                     pScreen->DestroyPixmap(yuv_pixmap);
                 }
                 else
@@ -793,5 +901,6 @@ rdpEglCaptureRfx(rdpClientCon *clientCon, RegionPtr in_reg, BoxPtr *out_rects,
         LLOGLN(0, ("rdpEglCaptureRfx: GetScratchGC failed"));
     }
     free(crcs);
+    free(src_crcs);
     return TRUE;
 }
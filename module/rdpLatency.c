@@ -0,0 +1,248 @@
+/*
+Copyright 2026 Jay Sorg
+
+Permission to use, copy, modify, distribute, and sell this software and its
+documentation for any purpose is hereby granted without fee, provided that
+the above copyright notice appear in all copies and that both that
+copyright notice and this permission notice appear in supporting
+documentation.
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+input to frame latency
+
+input is timestamped as it arrives, the first frame captured after it
+counts as showing it, each frame keeps its capture and send times until
+xrdp acks it, so a slow session can be put down to pacing, capture, send
+or the client
+
+*/
+
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/time.h>
+
+/* this should be before all X11 .h files */
+#include <xorg-server.h>
+#include <xorgVersion.h>
+
+/* all driver need this */
+#include <xf86.h>
+#include <xf86_OSproc.h>
+
+#include "rdp.h"
+#include "rdpMisc.h"
+#include "rdpLatency.h"
+
+#define LOG_LEVEL 1
+#define LLOGLN(_level, _args) \
+    do { if (_level < LOG_LEVEL) { ErrorF _args ; ErrorF("\n"); } } while (0)
+
+/*****************************************************************************/
+static void
+rdpLatencyHistAdd(struct rdp_latency_hist *hist, uint64_t start_us,
+                  uint64_t end_us)
+{
+    int sample_us;
+    int bucket;
+
+    if ((start_us == 0) || (end_us < start_us))
+    {
+        return;
+    }
+    sample_us = (int) RDPMIN(end_us - start_us, (uint64_t) INT_MAX);
+    bucket = 0;
+    while ((bucket < RDP_LATENCY_BUCKETS - 1) && ((sample_us >> 1) >> bucket))
+    {
+        bucket++;
+    }
+    hist->buckets[bucket]++;
+    hist->count++;
+    hist->total_us += sample_us;
+    hist->max_us = RDPMAX(hist->max_us, sample_us);
+}
+
+/*****************************************************************************/
+void
+rdpLatencyInit(struct rdp_latency *latency)
+{
+    memset(latency, 0, sizeof(struct rdp_latency));
+}
+
+/*****************************************************************************/
+/* a keyboard or mouse event arrived */
+void
+rdpLatencyInput(struct rdp_latency *latency)
+{
+    if (latency->input_us == 0)
+    {
+        latency->input_us = g_time_us();
+    }
+}
+
+/*****************************************************************************/
+void
+rdpLatencyCaptureStart(struct rdp_latency *latency)
+{
+    latency->capture_start_us = g_time_us();
+    latency->capture_end_us = 0;
+}
+
+/*****************************************************************************/
+void
+rdpLatencyCaptureEnd(struct rdp_latency *latency)
+{
+    latency->capture_end_us = g_time_us();
+}
+
+/*****************************************************************************/
+/* the frame of the capture in progress went to xrdp, a frame with only
+   screen copies has no capture and counts from when it was sent */
+void
+rdpLatencyFrameSent(struct rdp_latency *latency, int frame_id)
+{
+    struct rdp_latency_frame *frame;
+    uint64_t now;
+
+    now = g_time_us();
+    frame = latency->frames + ((unsigned int) frame_id) % RDP_LATENCY_FRAMES;
+    memset(frame, 0, sizeof(struct rdp_latency_frame));
+    frame->frame_id = frame_id;
+    frame->sent_us = now;
+    if (latency->capture_start_us != 0)
+    {
+        frame->capture_start_us = latency->capture_start_us;
+        frame->capture_end_us = latency->capture_end_us;
+        if (frame->capture_end_us == 0)
+        {
+            frame->capture_end_us = now;
+        }
+    }
+    else
+    {
+        frame->capture_start_us = now;
+        frame->capture_end_us = now;
+    }
+    /* input that came during the capture waits for the next frame */
+    if ((latency->input_us != 0) &&
+        (latency->input_us <= frame->capture_start_us))
+    {
+        frame->input_us = latency->input_us;
+        latency->input_us = 0;
+        rdpLatencyHistAdd(&(latency->input_to_capture), frame->input_us,
+                          frame->capture_start_us);
+    }
+    rdpLatencyHistAdd(&(latency->capture), frame->capture_start_us,
+                      frame->capture_end_us);
+    rdpLatencyHistAdd(&(latency->send), frame->capture_end_us, now);
+    latency->capture_start_us = 0;
+    latency->capture_end_us = 0;
+}
+
+/*****************************************************************************/
+/* xrdp acks in order, frame_id acks it and all frames before it */
+void
+rdpLatencyFrameAcked(struct rdp_latency *latency, int frame_id)
+{
+    struct rdp_latency_frame *frame;
+    uint64_t now;
+    int index;
+
+    now = g_time_us();
+    for (index = 0; index < RDP_LATENCY_FRAMES; index++)
+    {
+        frame = latency->frames + index;
+        if ((frame->sent_us == 0) || (frame_id - frame->frame_id < 0))
+        {
+            continue;
+        }
+        rdpLatencyHistAdd(&(latency->capture_to_ack),
+                          frame->capture_start_us, now);
+        frame->sent_us = 0;
+    }
+}
+
+/*****************************************************************************/
+/* wall clock time for the timestamp of a gfx start frame, UTC hours,
+   minutes, seconds and milliseconds packed as [MS-RDPEGFX] has it */
+uint32_t
+rdpLatencyGfxTimestamp(void)
+{
+    struct timeval tv;
+    uint32_t secs;
+
+    gettimeofday(&tv, NULL);
+    secs = (uint32_t) (tv.tv_sec % (24 * 60 * 60));
+    return ((secs / 3600) << 22) | (((secs / 60) % 60) << 16) |
+           ((secs % 60) << 10) | (uint32_t) (tv.tv_usec / 1000);
+}
+
+/*****************************************************************************/
+/* returns the microseconds percent of the samples are below, to the top
+   of their bucket */
+int
+rdpLatencyHistPercentile(const struct rdp_latency_hist *hist, int percent)
+{
+    int index;
+    int want;
+    int seen;
+
+    if (hist->count < 1)
+    {
+        return 0;
+    }
+    want = (int) (((int64_t) hist->count * percent + 99) / 100);
+    seen = 0;
+    for (index = 0; index < RDP_LATENCY_BUCKETS - 1; index++)
+    {
+        seen += hist->buckets[index];
+        if (seen >= want)
+        {
+            return RDPMIN(2 << index, hist->max_us);
+        }
+    }
+    return hist->max_us;
+}
+
+/*****************************************************************************/
+static void
+rdpLatencyLogHist(const struct rdp_latency_hist *hist, const char *name,
+                  int con_number)
+{
+    if (hist->count < 1)
+    {
+        return;
+    }
+    LLOGLN(0, ("rdpLatencyLog: con %d %s: %d frames avg %d us p50 %d p90 %d "
+           "p99 %d max %d", con_number, name, hist->count,
+           (int) (hist->total_us / hist->count),
+           rdpLatencyHistPercentile(hist, 50),
+           rdpLatencyHistPercentile(hist, 90),
+           rdpLatencyHistPercentile(hist, 99), hist->max_us));
+}
+
+/*****************************************************************************/
+void
+rdpLatencyLog(const struct rdp_latency *latency, int con_number)
+{
+    rdpLatencyLogHist(&(latency->input_to_capture), "input to capture",
+                      con_number);
+    rdpLatencyLogHist(&(latency->capture), "capture", con_number);
+    rdpLatencyLogHist(&(latency->send), "capture to send", con_number);
+    rdpLatencyLogHist(&(latency->capture_to_ack), "capture to ack",
+                      con_number);
+}
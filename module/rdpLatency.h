@@ -0,0 +1,87 @@
+/*
+Copyright 2026 Jay Sorg
+
+Permission to use, copy, modify, distribute, and sell this software and its
+documentation for any purpose is hereby granted without fee, provided that
+the above copyright notice appear in all copies and that both that
+copyright notice and this permission notice appear in supporting
+documentation.
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+input to frame latency
+
+*/
+
+#ifndef __RDPLATENCY_H
+#define __RDPLATENCY_H
+
+#include <xorg-server.h>
+#include <xorgVersion.h>
+#include <xf86.h>
+
+/* bucket n counts samples from 2^n up to 2^(n + 1) microseconds, the last
+   one everything longer */
+#define RDP_LATENCY_BUCKETS 24
+/* frames remembered until acked */
+#define RDP_LATENCY_FRAMES 16
+
+struct rdp_latency_hist
+{
+    int count;
+    int max_us;
+    uint64_t total_us;
+    int buckets[RDP_LATENCY_BUCKETS];
+};
+
+/* times of a frame sent and not acked yet, sent_us is 0 when free */
+struct rdp_latency_frame
+{
+    int frame_id;
+    uint64_t input_us; /* oldest input the frame can show, 0 for none */
+    uint64_t capture_start_us;
+    uint64_t capture_end_us;
+    uint64_t sent_us;
+};
+
+struct rdp_latency
+{
+    uint64_t input_us; /* oldest input no frame has shown yet, 0 for none */
+    /* the capture in progress */
+    uint64_t capture_start_us;
+    uint64_t capture_end_us;
+    struct rdp_latency_frame frames[RDP_LATENCY_FRAMES];
+    struct rdp_latency_hist input_to_capture;
+    struct rdp_latency_hist capture; /* capture start to end */
+    struct rdp_latency_hist send; /* capture end to sent */
+    struct rdp_latency_hist capture_to_ack;
+};
+
+extern _X_EXPORT void
+rdpLatencyInit(struct rdp_latency *latency);
+extern _X_EXPORT void
+rdpLatencyInput(struct rdp_latency *latency);
+extern _X_EXPORT void
+rdpLatencyCaptureStart(struct rdp_latency *latency);
+extern _X_EXPORT void
+rdpLatencyCaptureEnd(struct rdp_latency *latency);
+extern _X_EXPORT void
+rdpLatencyFrameSent(struct rdp_latency *latency, int frame_id);
+extern _X_EXPORT void
+rdpLatencyFrameAcked(struct rdp_latency *latency, int frame_id);
+extern _X_EXPORT uint32_t
+rdpLatencyGfxTimestamp(void);
+extern _X_EXPORT int
+rdpLatencyHistPercentile(const struct rdp_latency_hist *hist, int percent);
+extern _X_EXPORT void
+rdpLatencyLog(const struct rdp_latency *latency, int con_number);
+
+#endif
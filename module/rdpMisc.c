@@ -25,6 +25,11 @@ the rest
 #include "config_ac.h"
 #endif
 
+/* memfd_create and the seals */
+#if defined(HAVE_MEMFD_CREATE) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,6 +42,7 @@ the rest
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <time.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 
@@ -97,6 +103,9 @@ static const unsigned int g_crc_table[256] =
     0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 };
 
+/* byte at a time crc32, the same crc the glamor shader computes for
+   each tile, only rdpEgl.c uses it, to check the gpu when
+   XRDP_CRC_CHECK is set, the capture code uses tile_hash */
 #define CRC_START(in_crc) (in_crc) = 0xFFFFFFFF
 #define CRC_PASS(in_pixel, in_crc) \
     (in_crc) = g_crc_table[((in_crc) ^ (in_pixel)) & 0xff] ^ ((in_crc) >> 8)
@@ -135,6 +144,106 @@ crc_end(int crc)
     return crc;
 }
 
+/* 64 bit tile hash, xxh64 */
+#define HASH_P1 0x9E3779B185EBCA87ULL
+#define HASH_P2 0xC2B2AE3D27D4EB4FULL
+#define HASH_P3 0x165667B19E3779F9ULL
+#define HASH_P4 0x85EBCA77C2B2AE63ULL
+#define HASH_P5 0x27D4EB2F165667C5ULL
+#define HASH_ROTL(_val, _bits) (((_val) << (_bits)) | ((_val) >> (64 - (_bits))))
+
+/******************************************************************************/
+static uint64_t
+tile_hash_round(uint64_t acc, uint64_t input)
+{
+    acc += input * HASH_P2;
+    acc = HASH_ROTL(acc, 31);
+    return acc * HASH_P1;
+}
+
+/******************************************************************************/
+static uint64_t
+tile_hash_merge(uint64_t acc, uint64_t val)
+{
+    acc ^= tile_hash_round(0, val);
+    return acc * HASH_P1 + HASH_P4;
+}
+
+/******************************************************************************/
+/* tile_hash_proc, chain calls by passing the last result as seed */
+uint64_t
+tile_hash(uint64_t seed, const void *data, int data_bytes)
+{
+    const uint8_t *data8;
+    const uint8_t *end8;
+    uint64_t v1;
+    uint64_t v2;
+    uint64_t v3;
+    uint64_t v4;
+    uint64_t h;
+    uint64_t k;
+    uint32_t k32;
+
+    data8 = (const uint8_t *) data;
+    end8 = data8 + data_bytes;
+    if (data_bytes >= 32)
+    {
+        v1 = seed + HASH_P1 + HASH_P2;
+        v2 = seed + HASH_P2;
+        v3 = seed;
+        v4 = seed - HASH_P1;
+        while (end8 - data8 >= 32)
+        {
+            memcpy(&k, data8, 8);
+            v1 = tile_hash_round(v1, k);
+            memcpy(&k, data8 + 8, 8);
+            v2 = tile_hash_round(v2, k);
+            memcpy(&k, data8 + 16, 8);
+            v3 = tile_hash_round(v3, k);
+            memcpy(&k, data8 + 24, 8);
+            v4 = tile_hash_round(v4, k);
+            data8 += 32;
+        }
+        h = HASH_ROTL(v1, 1) + HASH_ROTL(v2, 7) +
+            HASH_ROTL(v3, 12) + HASH_ROTL(v4, 18);
+        h = tile_hash_merge(h, v1);
+        h = tile_hash_merge(h, v2);
+        h = tile_hash_merge(h, v3);
+        h = tile_hash_merge(h, v4);
+    }
+    else
+    {
+        h = seed + HASH_P5;
+    }
+    h += (uint64_t) data_bytes;
+    while (end8 - data8 >= 8)
+    {
+        memcpy(&k, data8, 8);
+        h ^= tile_hash_round(0, k);
+        h = HASH_ROTL(h, 27) * HASH_P1 + HASH_P4;
+        data8 += 8;
+    }
+    if (end8 - data8 >= 4)
+    {
+        memcpy(&k32, data8, 4);
+        h ^= k32 * HASH_P1;
+        h = HASH_ROTL(h, 23) * HASH_P2 + HASH_P3;
+        data8 += 4;
+    }
+    while (data8 < end8)
+    {
+        h ^= (*data8) * HASH_P5;
+        h = HASH_ROTL(h, 11) * HASH_P1;
+        data8++;
+    }
+    h ^= h >> 33;
+    h *= HASH_P2;
+    h ^= h >> 29;
+    h *= HASH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
 /******************************************************************************/
 int
 rdpBitsPerPixel(int depth)
@@ -221,6 +330,17 @@ g_sleep(int msecs)
     usleep(msecs * 1000);
 }
 
+/*****************************************************************************/
+/* monotonic microseconds, only good for differences */
+uint64_t
+g_time_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
 /*****************************************************************************/
 int
 g_sck_send(int sck, const void *ptr, int len, int flags)
@@ -594,6 +714,172 @@ g_alloc_shm_map_fd(void **addr, int *fd, size_t size)
     return 0;
 }
 
+/******************************************************************************/
+/* like g_alloc_shm_map_fd but from a memfd that can not shrink, so a
+   process mapping the fd never faults past the end, falls back to
+   g_alloc_shm_map_fd when there is no memfd */
+int
+g_alloc_memfd_map_fd(void **addr, int *fd, size_t size)
+{
+#if defined(HAVE_MEMFD_CREATE)
+    int lfd;
+    void *laddr;
+
+    lfd = memfd_create("xorgxrdp", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (lfd == -1)
+    {
+        return g_alloc_shm_map_fd(addr, fd, size);
+    }
+    if (ftruncate(lfd, size) == -1)
+    {
+        close(lfd);
+        return 2;
+    }
+    fcntl(lfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+    /* map fd to address space */
+    laddr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, lfd, 0);
+    if (laddr == MAP_FAILED)
+    {
+        close(lfd);
+        return 3;
+    }
+    *addr = laddr;
+    *fd = lfd;
+    return 0;
+#else
+    return g_alloc_shm_map_fd(addr, fd, size);
+#endif
+}
+
+/******************************************************************************/
+/* huge page backing, see "HugePages", buffers are 2 MB pages from
+   hugetlbfs when the admin reserved some, else transparent huge pages
+   are asked for with madvise */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+static int g_huge_hits = 0; /* hugetlbfs */
+static int g_huge_advised = 0; /* madvise(MADV_HUGEPAGE) took it */
+static int g_huge_misses = 0; /* 4 KB pages */
+
+/******************************************************************************/
+static void
+g_huge_log(const char *where, size_t size, const char *how)
+{
+    ErrorF("%s: %lu bytes %s, huge page hits %d advised %d misses %d\n",
+           where, (unsigned long) size, how,
+           g_huge_hits, g_huge_advised, g_huge_misses);
+}
+
+/******************************************************************************/
+/* ask for transparent huge pages, counts the outcome */
+static void
+g_huge_advise(const char *where, void *addr, size_t size)
+{
+#if defined(MADV_HUGEPAGE)
+    if (madvise(addr, size, MADV_HUGEPAGE) == 0)
+    {
+        g_huge_advised++;
+        g_huge_log(where, size, "advised");
+        return;
+    }
+#endif
+    g_huge_misses++;
+    g_huge_log(where, size, "small pages");
+}
+
+/******************************************************************************/
+/* size rounded up to whole huge pages, the huge page allocators need it */
+size_t
+g_huge_page_round(size_t size)
+{
+    return (size + (HUGE_PAGE_SIZE - 1)) & ~((size_t) (HUGE_PAGE_SIZE - 1));
+}
+
+/******************************************************************************/
+/* like g_alloc_memfd_map_fd but huge page backed, size must come from
+   g_huge_page_round */
+int
+g_alloc_huge_map_fd(void **addr, int *fd, size_t size)
+{
+    int rv;
+#if defined(HAVE_MEMFD_CREATE) && defined(MFD_HUGETLB)
+    int lfd;
+    unsigned int flags;
+    void *laddr;
+
+    flags = MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_HUGETLB;
+#if defined(MFD_HUGE_2MB)
+    flags |= MFD_HUGE_2MB;
+#endif
+    lfd = memfd_create("xorgxrdp", flags);
+    if (lfd != -1)
+    {
+        if (ftruncate(lfd, size) == 0)
+        {
+            fcntl(lfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+            /* fails when no huge pages are reserved */
+            laddr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         lfd, 0);
+            if (laddr != MAP_FAILED)
+            {
+                *addr = laddr;
+                *fd = lfd;
+                g_huge_hits++;
+                g_huge_log("g_alloc_huge_map_fd", size, "hugetlbfs");
+                return 0;
+            }
+        }
+        close(lfd);
+    }
+#endif
+    rv = g_alloc_memfd_map_fd(addr, fd, size);
+    if (rv == 0)
+    {
+        g_huge_advise("g_alloc_huge_map_fd", *addr, size);
+    }
+    return rv;
+}
+
+/******************************************************************************/
+/* zeroed, private, huge page backed memory, size must come from
+   g_huge_page_round, returns NULL on failure, free with g_free_huge */
+void *
+g_alloc_huge(size_t size)
+{
+    void *addr;
+
+#if defined(MAP_HUGETLB)
+    int flags;
+
+    flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#if defined(MAP_HUGE_2MB)
+    flags |= MAP_HUGE_2MB;
+#endif
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (addr != MAP_FAILED)
+    {
+        g_huge_hits++;
+        g_huge_log("g_alloc_huge", size, "hugetlbfs");
+        return addr;
+    }
+#endif
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+    {
+        return NULL;
+    }
+    g_huge_advise("g_alloc_huge", addr, size);
+    return addr;
+}
+
+/******************************************************************************/
+void
+g_free_huge(void *addr, size_t size)
+{
+    munmap(addr, size);
+}
+
 /******************************************************************************/
 int
 g_alloc_map_fd(void **addr, int *fd, size_t size)
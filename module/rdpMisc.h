@@ -40,12 +40,15 @@ the rest
 #endif
 
 
+/* table crc32, only for checking the glamor tile crcs in rdpEgl.c */
 extern _X_EXPORT int
 crc_start(void);
 extern _X_EXPORT int
 crc_process_data(int crc, const void *data, int data_bytes);
 extern _X_EXPORT int
 crc_end(int crc);
+extern _X_EXPORT uint64_t
+tile_hash(uint64_t seed, const void *data, int data_bytes);
 
 extern _X_EXPORT int
 rdpBitsPerPixel(int depth);
@@ -59,6 +62,8 @@ extern _X_EXPORT int
 g_sck_last_error_would_block(int sck);
 extern _X_EXPORT void
 g_sleep(int msecs);
+extern _X_EXPORT uint64_t
+g_time_us(void);
 extern _X_EXPORT int
 g_sck_send(int sck, const void *ptr, int len, int flags);
 extern _X_EXPORT void
@@ -103,6 +108,16 @@ g_sck_send_fd_set(int sck, const void *ptr, unsigned int len,
 extern _X_EXPORT int
 g_alloc_shm_map_fd(void **addr, int *fd, size_t size);
 extern _X_EXPORT int
+g_alloc_memfd_map_fd(void **addr, int *fd, size_t size);
+extern _X_EXPORT size_t
+g_huge_page_round(size_t size);
+extern _X_EXPORT int
+g_alloc_huge_map_fd(void **addr, int *fd, size_t size);
+extern _X_EXPORT void *
+g_alloc_huge(size_t size);
+extern _X_EXPORT void
+g_free_huge(void *addr, size_t size);
+extern _X_EXPORT int
 g_alloc_map_fd(void **addr, int *fd, size_t size);
 extern _X_EXPORT void
 g_free_unmap_fd(void *addr, int fd, size_t size);
@@ -112,6 +127,8 @@ g_free_unmap_fd(void *addr, int fd, size_t size);
     (struct_type *) xnfalloc(sizeof(struct_type) * (n_structs))
 #define g_new0(struct_type, n_structs) \
     (struct_type *) xnfcalloc((n_structs), sizeof(struct_type))
+#define g_renew(struct_type, mem, n_structs) \
+    (struct_type *) xnfrealloc((mem), sizeof(struct_type) * (n_structs))
 
 
 #if defined(X_BYTE_ORDER)
@@ -0,0 +1,449 @@
+/*
+Copyright 2026 Jay Sorg
+
+Permission to use, copy, modify, distribute, and sell this software and its
+documentation for any purpose is hereby granted without fee, provided that
+the above copyright notice appear in all copies and that both that
+copyright notice and this permission notice appear in supporting
+documentation.
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+outbound message queue
+
+messages go straight to the socket while it takes them, what it does not
+take is copied here and sent with writev when the socket is writable
+again, so a slow xrdp never blocks the X server
+an fd is passed after its message with a 4 byte "int" of its own, xrdp
+reads that with its own recvmsg, a plain recv would drop the fd, the two
+go out in one sendmmsg when there is no queue
+
+*/
+
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+/* sendmmsg */
+#if defined(HAVE_SENDMMSG) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/* this should be before all X11 .h files */
+#include <xorg-server.h>
+#include <xorgVersion.h>
+
+/* all driver need this */
+#include <xf86.h>
+#include <xf86_OSproc.h>
+
+#include "rdp.h"
+#include "rdpMisc.h"
+#include "rdpOutQueue.h"
+
+#define LOG_LEVEL 1
+#define LLOGLN(_level, _args) \
+    do { if (_level < LOG_LEVEL) { ErrorF _args ; ErrorF("\n"); } } while (0)
+
+/* most messages in one writev */
+#define OUT_QUEUE_IOV 64
+
+/* what xrdp reads the passed fd with */
+static const char g_fd_carrier[4] = "int";
+
+/* on the stack, no allocation per fd */
+union out_control
+{
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+};
+
+/*****************************************************************************/
+/* returns boolean */
+static int
+out_would_block(void)
+{
+    return (errno == EAGAIN) || (errno == EWOULDBLOCK) ||
+           (errno == EINPROGRESS) || (errno == EINTR);
+}
+
+/*****************************************************************************/
+/* set msg up to send len bytes of data, with fd if not -1, control must
+   stay in scope until it is sent */
+static void
+out_msg_init(struct msghdr *msg, struct iovec *iov, const void *data,
+             int len, int fd, union out_control *control)
+{
+    struct cmsghdr *cmptr;
+
+    memset(msg, 0, sizeof(struct msghdr));
+    iov->iov_base = (void *) data;
+    iov->iov_len = len;
+    msg->msg_iov = iov;
+    msg->msg_iovlen = 1;
+    if (fd != -1)
+    {
+        memset(control, 0, sizeof(union out_control));
+        msg->msg_control = control->buf;
+        msg->msg_controllen = sizeof(control->buf);
+        cmptr = CMSG_FIRSTHDR(msg);
+        cmptr->cmsg_len = CMSG_LEN(sizeof(int));
+        cmptr->cmsg_level = SOL_SOCKET;
+        cmptr->cmsg_type = SCM_RIGHTS;
+        memcpy(CMSG_DATA(cmptr), &fd, sizeof(int));
+    }
+}
+
+/*****************************************************************************/
+/* returns bytes sent, 0 if the socket is full, -1 on error */
+static int
+out_send_fd(struct rdp_out_queue *queue, int sck, const void *data, int len,
+            int fd)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    union out_control control;
+    int sent;
+
+    out_msg_init(&msg, &iov, data, len, fd, &control);
+    queue->syscalls++;
+    sent = sendmsg(sck, &msg, 0);
+    if (sent == -1)
+    {
+        return out_would_block() ? 0 : -1;
+    }
+    queue->bytes_sent += sent;
+    if ((fd != -1) && (sent > 0))
+    {
+        queue->fds_sent++;
+    }
+    return sent;
+}
+
+/*****************************************************************************/
+static void
+out_msg_free(struct rdp_out_msg *msg)
+{
+    if (msg->fd != -1)
+    {
+        close(msg->fd);
+    }
+    free(msg);
+}
+
+/*****************************************************************************/
+/* copy what is left of a message to the tail, the fd is dup'ed as the
+   caller can close its own before it goes out */
+static int
+out_queue_add(struct rdp_out_queue *queue, const void *data, int len,
+              int fd)
+{
+    struct rdp_out_msg *msg;
+
+    msg = (struct rdp_out_msg *) malloc(sizeof(struct rdp_out_msg) + len);
+    if (msg == NULL)
+    {
+        return 1;
+    }
+    msg->next = NULL;
+    msg->fd = -1;
+    if (fd != -1)
+    {
+        msg->fd = dup(fd);
+        if (msg->fd == -1)
+        {
+            free(msg);
+            return 1;
+        }
+    }
+    msg->len = len;
+    msg->offset = 0;
+    memcpy(msg + 1, data, len);
+    if (queue->tail == NULL)
+    {
+        queue->head = msg;
+    }
+    else
+    {
+        queue->tail->next = msg;
+    }
+    queue->tail = msg;
+    queue->bytes += len;
+    queue->msgs++;
+    if (queue->bytes > queue->high_bytes)
+    {
+        /* log each time it doubles */
+        if (queue->bytes >= queue->high_bytes * 2)
+        {
+            LLOGLN(0, ("out_queue_add: high water %d bytes %d msgs, "
+                   "%d stalls", queue->bytes, queue->msgs, queue->stalls));
+        }
+        queue->high_bytes = queue->bytes;
+    }
+    queue->high_msgs = RDPMAX(queue->high_msgs, queue->msgs);
+    return 0;
+}
+
+/*****************************************************************************/
+/* the first sent bytes of the queue went out */
+static void
+out_queue_sent(struct rdp_out_queue *queue, int sent)
+{
+    struct rdp_out_msg *msg;
+    int bytes;
+
+    while (sent > 0)
+    {
+        msg = queue->head;
+        if (msg->fd != -1)
+        {
+            /* passed with the first byte */
+            close(msg->fd);
+            msg->fd = -1;
+        }
+        bytes = RDPMIN(sent, msg->len - msg->offset);
+        msg->offset += bytes;
+        queue->bytes -= bytes;
+        sent -= bytes;
+        if (msg->offset < msg->len)
+        {
+            break;
+        }
+        queue->head = msg->next;
+        if (queue->head == NULL)
+        {
+            queue->tail = NULL;
+        }
+        queue->msgs--;
+        free(msg);
+    }
+}
+
+/*****************************************************************************/
+void
+rdpOutQueueInit(struct rdp_out_queue *queue)
+{
+    memset(queue, 0, sizeof(struct rdp_out_queue));
+}
+
+/*****************************************************************************/
+void
+rdpOutQueueDeinit(struct rdp_out_queue *queue)
+{
+    struct rdp_out_msg *msg;
+
+    LLOGLN(0, ("rdpOutQueueDeinit: high water %d bytes %d msgs, %d stalls",
+           queue->high_bytes, queue->high_msgs, queue->stalls));
+    while (queue->head != NULL)
+    {
+        msg = queue->head;
+        queue->head = msg->next;
+        out_msg_free(msg);
+    }
+    queue->tail = NULL;
+    queue->bytes = 0;
+    queue->msgs = 0;
+}
+
+/*****************************************************************************/
+/* send the message and the fd after it in one call
+   returns messages sent, sent0 is the bytes of the first, -1 on error */
+static int
+out_send_with_fd(struct rdp_out_queue *queue, int sck, const void *data,
+                 int len, int fd, int *sent0)
+{
+#if defined(HAVE_SENDMMSG)
+    struct mmsghdr msgs[2];
+    struct iovec iov[2];
+    union out_control control;
+    int rv;
+
+    if (len <= RDP_OUT_QUEUE_ATOMIC_BYTES)
+    {
+        /* the message goes whole or not at all so the fd can not get
+           ahead of it */
+        memset(msgs, 0, sizeof(msgs));
+        out_msg_init(&(msgs[0].msg_hdr), iov + 0, data, len, -1, NULL);
+        out_msg_init(&(msgs[1].msg_hdr), iov + 1, g_fd_carrier, 4, fd,
+                     &control);
+        queue->syscalls++;
+        rv = sendmmsg(sck, msgs, 2, 0);
+        if (rv == -1)
+        {
+            *sent0 = 0;
+            return out_would_block() ? 0 : -1;
+        }
+        *sent0 = msgs[0].msg_len;
+        queue->bytes_sent += msgs[0].msg_len;
+        if (rv == 2)
+        {
+            queue->bytes_sent += msgs[1].msg_len;
+            queue->fds_sent++;
+        }
+        if ((rv == 2) && (msgs[0].msg_len != (unsigned int) len))
+        {
+            LLOGLN(0, ("out_send_with_fd: short message ahead of the fd"));
+            return -1;
+        }
+        return (rv == 2) && (msgs[1].msg_len == 4) ? 2 : 1;
+    }
+#endif
+    *sent0 = out_send_fd(queue, sck, data, len, -1);
+    if (*sent0 == -1)
+    {
+        return -1;
+    }
+    return 1;
+}
+
+/*****************************************************************************/
+/* send data, then fd after it if not -1, without blocking, what the
+   socket does not take is queued for rdpOutQueueFlush
+   returns error, the connection is not usable after an error */
+int
+rdpOutQueueSend(struct rdp_out_queue *queue, int sck,
+                const void *data, int len, int fd)
+{
+    int sent;
+    int count;
+
+    if (queue->head != NULL)
+    {
+        /* keep the order, this goes behind what is queued */
+        if (out_queue_add(queue, data, len, -1) != 0)
+        {
+            return 1;
+        }
+        if ((fd != -1) &&
+            (out_queue_add(queue, g_fd_carrier, 4, fd) != 0))
+        {
+            return 1;
+        }
+        return rdpOutQueueFlush(queue, sck);
+    }
+    if (fd == -1)
+    {
+        count = 1;
+        sent = out_send_fd(queue, sck, data, len, -1);
+    }
+    else
+    {
+        count = out_send_with_fd(queue, sck, data, len, fd, &sent);
+    }
+    if ((count == -1) || (sent == -1))
+    {
+        return 1;
+    }
+    if (count == 2)
+    {
+        return 0;
+    }
+    if (sent < len)
+    {
+        queue->stalls++;
+        if (out_queue_add(queue, ((const char *) data) + sent, len - sent,
+                          -1) != 0)
+        {
+            return 1;
+        }
+    }
+    if (fd != -1)
+    {
+        /* the fd and its carrier did not go */
+        if (out_queue_add(queue, g_fd_carrier, 4, fd) != 0)
+        {
+            return 1;
+        }
+        if (sent == len)
+        {
+            /* let the flush send it */
+            return rdpOutQueueFlush(queue, sck);
+        }
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/* send as much of the queue as the socket takes
+   returns error, the connection is not usable after an error */
+int
+rdpOutQueueFlush(struct rdp_out_queue *queue, int sck)
+{
+    struct iovec iov[OUT_QUEUE_IOV];
+    struct rdp_out_msg *msg;
+    int count;
+    int sent;
+    int want;
+
+    while (queue->head != NULL)
+    {
+        msg = queue->head;
+        if (msg->fd != -1)
+        {
+            want = msg->len - msg->offset;
+            sent = out_send_fd(queue, sck, ((char *) (msg + 1)) + msg->offset,
+                               want, msg->fd);
+        }
+        else
+        {
+            /* gather up to the next message passing an fd */
+            count = 0;
+            want = 0;
+            while ((msg != NULL) && (msg->fd == -1) &&
+                   (count < OUT_QUEUE_IOV))
+            {
+                iov[count].iov_base = ((char *) (msg + 1)) + msg->offset;
+                iov[count].iov_len = msg->len - msg->offset;
+                want += msg->len - msg->offset;
+                count++;
+                msg = msg->next;
+            }
+            queue->syscalls++;
+            sent = writev(sck, iov, count);
+            if (sent == -1)
+            {
+                sent = out_would_block() ? 0 : -1;
+            }
+            else
+            {
+                queue->bytes_sent += sent;
+            }
+        }
+        if (sent == -1)
+        {
+            LLOGLN(0, ("rdpOutQueueFlush: send failed errno %d", errno));
+            return 1;
+        }
+        out_queue_sent(queue, sent);
+        if (sent < want)
+        {
+            /* socket full, wait for it to be writable */
+            queue->stalls++;
+            break;
+        }
+    }
+    if (queue->bytes > RDP_OUT_QUEUE_MAX_BYTES)
+    {
+        LLOGLN(0, ("rdpOutQueueFlush: %d bytes queued, giving up",
+               queue->bytes));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+/*
+Copyright 2026 Jay Sorg
+
+Permission to use, copy, modify, distribute, and sell this software and its
+documentation for any purpose is hereby granted without fee, provided that
+the above copyright notice appear in all copies and that both that
+copyright notice and this permission notice appear in supporting
+documentation.
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+outbound message queue
+
+*/
+
+#ifndef __RDPOUTQUEUE_H
+#define __RDPOUTQUEUE_H
+
+#include <xorg-server.h>
+#include <xorgVersion.h>
+#include <xf86.h>
+
+/* queued bytes that mean xrdp is gone rather than slow */
+#define RDP_OUT_QUEUE_MAX_BYTES (64 * 1024 * 1024)
+/* messages up to this size go in one socket buffer, the socket takes all
+   of one or none of it */
+#define RDP_OUT_QUEUE_ATOMIC_BYTES (32 * 1024 + 1024)
+
+/* a message, or what is left of it, waiting for the socket */
+struct rdp_out_msg
+{
+    struct rdp_out_msg *next;
+    int fd; /* passed with the first byte, -1 for none */
+    int len;
+    int offset; /* bytes already sent */
+    /* len bytes follow */
+};
+
+struct rdp_out_queue
+{
+    struct rdp_out_msg *head;
+    struct rdp_out_msg *tail;
+    int bytes; /* not sent yet */
+    int msgs;
+    /* high water marks and how often the socket was full */
+    int high_bytes;
+    int high_msgs;
+    int stalls;
+    int syscalls; /* send calls made */
+    uint64_t bytes_sent;
+    int fds_sent;
+};
+
+extern _X_EXPORT void
+rdpOutQueueInit(struct rdp_out_queue *queue);
+extern _X_EXPORT void
+rdpOutQueueDeinit(struct rdp_out_queue *queue);
+extern _X_EXPORT int
+rdpOutQueueSend(struct rdp_out_queue *queue, int sck,
+                const void *data, int len, int fd);
+extern _X_EXPORT int
+rdpOutQueueFlush(struct rdp_out_queue *queue, int sck);
+
+#endif
@@ -0,0 +1,203 @@
+/*
+Copyright 2026 Jay Sorg
+
+Permission to use, copy, modify, distribute, and sell this software and its
+documentation for any purpose is hereby granted without fee, provided that
+the above copyright notice appear in all copies and that both that
+copyright notice and this permission notice appear in supporting
+documentation.
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+frame pacing
+
+picks the time between captures for a connection from how long the
+captures take, how long xrdp takes to ack a frame and how big the frames
+are, between the "MaxFps" and "MinFps" limits
+
+*/
+
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+/* this should be before all X11 .h files */
+#include <xorg-server.h>
+#include <xorgVersion.h>
+
+/* all driver need this */
+#include <xf86.h>
+#include <xf86_OSproc.h>
+
+#include "rdp.h"
+#include "rdpMisc.h"
+#include "rdpPacing.h"
+
+#define LOG_LEVEL 1
+#define LLOGLN(_level, _args) \
+    do { if (_level < LOG_LEVEL) { ErrorF _args ; ErrorF("\n"); } } while (0)
+
+/* running averages move 1/8 of the way to each new sample */
+#define PACING_AVG(_avg, _sample) \
+    do { (_avg) += ((_sample) - (_avg)) / 8; } while (0)
+
+/*****************************************************************************/
+void
+rdpPacingInit(struct rdp_pacing *pacing, int min_fps, int max_fps,
+              int slots)
+{
+    memset(pacing, 0, sizeof(struct rdp_pacing));
+    max_fps = RDPCLAMP(max_fps, 1, 1000);
+    min_fps = RDPCLAMP(min_fps, 1, max_fps);
+    pacing->min_interval_ms = 1000 / max_fps;
+    pacing->max_interval_ms = 1000 / min_fps;
+    pacing->slots = RDPMAX(slots, 1);
+    pacing->interval_ms = pacing->min_interval_ms;
+    pacing->wait_ms = RDPCLAMP(pacing->interval_ms / 10, 1, 8);
+    pacing->limit = RDP_PACING_LIMIT_MAX_FPS;
+    LLOGLN(0, ("rdpPacingInit: %d to %d fps, %d frames in flight",
+           min_fps, max_fps, pacing->slots));
+}
+
+/*****************************************************************************/
+static void
+rdpPacingUpdate(struct rdp_pacing *pacing, int screen_pixels)
+{
+    enum rdp_pacing_limit limit;
+    int target_us;
+    int interval_ms;
+
+    /* leave the X server at least half of each frame */
+    target_us = pacing->capture_us * 2;
+    limit = RDP_PACING_LIMIT_CAPTURE;
+    /* no point capturing faster than xrdp drains the frames */
+    if (pacing->ack_us / pacing->slots > target_us)
+    {
+        target_us = pacing->ack_us / pacing->slots;
+        limit = RDP_PACING_LIMIT_ACK;
+    }
+    /* big frames, more than 1/8 of the screen, queue up in the encoder,
+       send one at a time and let the damage gather meanwhile */
+    if ((pacing->frame_pixels > screen_pixels / 8) &&
+        (pacing->ack_us > target_us))
+    {
+        target_us = pacing->ack_us;
+        limit = RDP_PACING_LIMIT_BULK;
+    }
+    interval_ms = (target_us + 999) / 1000;
+    if (interval_ms <= pacing->min_interval_ms)
+    {
+        interval_ms = pacing->min_interval_ms;
+        limit = RDP_PACING_LIMIT_MAX_FPS;
+    }
+    else if (interval_ms >= pacing->max_interval_ms)
+    {
+        interval_ms = pacing->max_interval_ms;
+        limit = RDP_PACING_LIMIT_MIN_FPS;
+    }
+    if (limit != pacing->limit)
+    {
+        LLOGLN(0, ("rdpPacingUpdate: %d ms between frames, limited by %s, "
+               "capture %d us ack %d us frame pixels %d",
+               interval_ms, rdpPacingLimitName(limit), pacing->capture_us,
+               pacing->ack_us, pacing->frame_pixels));
+    }
+    pacing->interval_ms = interval_ms;
+    pacing->wait_ms = RDPCLAMP(interval_ms / 10, 1, 8);
+    pacing->limit = limit;
+}
+
+/*****************************************************************************/
+void
+rdpPacingFrameSent(struct rdp_pacing *pacing, int frame_id)
+{
+    int index;
+
+    index = ((unsigned int) frame_id) % RDP_PACING_FRAMES;
+    pacing->frame_id[index] = frame_id;
+    pacing->frame_sent_us[index] = g_time_us();
+}
+
+/*****************************************************************************/
+/* xrdp acks in order, frame_id acks it and all frames before it */
+void
+rdpPacingFrameAcked(struct rdp_pacing *pacing, int frame_id)
+{
+    uint64_t now;
+    int index;
+    int sample_us;
+
+    now = g_time_us();
+    for (index = 0; index < RDP_PACING_FRAMES; index++)
+    {
+        if ((pacing->frame_sent_us[index] == 0) ||
+            (frame_id - pacing->frame_id[index] < 0))
+        {
+            continue;
+        }
+        sample_us = (int) RDPMIN(now - pacing->frame_sent_us[index],
+                                 (uint64_t) INT_MAX / 2);
+        if (pacing->ack_us == 0)
+        {
+            pacing->ack_us = sample_us;
+        }
+        else
+        {
+            PACING_AVG(pacing->ack_us, sample_us);
+        }
+        pacing->frame_sent_us[index] = 0;
+    }
+}
+
+/*****************************************************************************/
+/* called after each capture pass with the time it took, pixels captured
+   were added to pacing->pixels during the pass */
+void
+rdpPacingCaptureDone(struct rdp_pacing *pacing, int capture_us,
+                     int screen_pixels)
+{
+    if (pacing->capture_us == 0)
+    {
+        pacing->capture_us = capture_us;
+    }
+    else
+    {
+        PACING_AVG(pacing->capture_us, capture_us);
+    }
+    PACING_AVG(pacing->frame_pixels, pacing->pixels);
+    pacing->pixels = 0;
+    rdpPacingUpdate(pacing, screen_pixels);
+}
+
+/*****************************************************************************/
+const char *
+rdpPacingLimitName(enum rdp_pacing_limit limit)
+{
+    switch (limit)
+    {
+        case RDP_PACING_LIMIT_MAX_FPS:
+            return "max fps";
+        case RDP_PACING_LIMIT_CAPTURE:
+            return "capture";
+        case RDP_PACING_LIMIT_ACK:
+            return "ack";
+        case RDP_PACING_LIMIT_BULK:
+            return "bulk";
+        case RDP_PACING_LIMIT_MIN_FPS:
+            return "min fps";
+    }
+    return "unknown";
+}
@@ -0,0 +1,76 @@
+/*
+Copyright 2026 Jay Sorg
+
+Permission to use, copy, modify, distribute, and sell this software and its
+documentation for any purpose is hereby granted without fee, provided that
+the above copyright notice appear in all copies and that both that
+copyright notice and this permission notice appear in supporting
+documentation.
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+frame pacing
+
+*/
+
+#ifndef __RDPPACING_H
+#define __RDPPACING_H
+
+#include <xorg-server.h>
+#include <xorgVersion.h>
+#include <xf86.h>
+
+/* frames remembered for ack latency */
+#define RDP_PACING_FRAMES 16
+
+/* what picked the current frame interval */
+enum rdp_pacing_limit
+{
+    RDP_PACING_LIMIT_MAX_FPS = 0, /* nothing slow, running at max fps */
+    RDP_PACING_LIMIT_CAPTURE,     /* capture time on the X server */
+    RDP_PACING_LIMIT_ACK,         /* xrdp acking frames */
+    RDP_PACING_LIMIT_BULK,        /* large updates, one frame in flight */
+    RDP_PACING_LIMIT_MIN_FPS      /* everything slow, held at min fps */
+};
+
+struct rdp_pacing
+{
+    int min_interval_ms; /* from the max fps */
+    int max_interval_ms; /* from the min fps */
+    int slots; /* frames allowed in flight */
+    /* current target, see rdpPacingUpdate */
+    int interval_ms;
+    int wait_ms; /* time to gather more damage before a capture */
+    enum rdp_pacing_limit limit;
+    /* running averages */
+    int capture_us;
+    int ack_us;
+    int frame_pixels; /* pixels captured per frame */
+    int pixels; /* pixels captured since the last rdpPacingCaptureDone */
+    /* send times of the frames not acked yet */
+    int frame_id[RDP_PACING_FRAMES];
+    uint64_t frame_sent_us[RDP_PACING_FRAMES];
+};
+
+extern _X_EXPORT void
+rdpPacingInit(struct rdp_pacing *pacing, int min_fps, int max_fps,
+              int slots);
+extern _X_EXPORT void
+rdpPacingFrameSent(struct rdp_pacing *pacing, int frame_id);
+extern _X_EXPORT void
+rdpPacingFrameAcked(struct rdp_pacing *pacing, int frame_id);
+extern _X_EXPORT void
+rdpPacingCaptureDone(struct rdp_pacing *pacing, int capture_us,
+                     int screen_pixels);
+extern _X_EXPORT const char *
+rdpPacingLimitName(enum rdp_pacing_limit limit);
+
+#endif
@@ -153,9 +153,7 @@ rdpRRScreenSetSize(ScreenPtr pScreen, CARD16 width, CARD16 height,
     pScreen->mmWidth = mmWidth;
     pScreen->mmHeight = mmHeight;
     screenPixmap = dev->screenSwPixmap;
-    free(dev->pfbMemory_alloc);
-    dev->pfbMemory_alloc = g_new0(uint8_t, dev->sizeInBytes + 16);
-    dev->pfbMemory = (uint8_t *) RDPALIGN(dev->pfbMemory_alloc, 16);
+    rdpAllocFramebuffer(dev);
     pScreen->ModifyPixmapHeader(screenPixmap, width, height,
                                 -1, -1,
                                 dev->paddedWidthInBytes,
@@ -41,6 +41,7 @@ SIMD function assigning
 #include "rdpXv.h"
 #include "rdpCapture.h"
 #include "rdpSimd.h"
+#include "rdpMisc.h"
 
 /* use simd, run time */
 int g_simd_use_accel = 1;
@@ -77,11 +78,18 @@ rdpSimdInit(ScreenPtr pScreen, ScrnInfoPtr pScrn)
     dev->uyvy_to_rgb32 = UYVY_to_RGB32;
     dev->a8r8g8b8_to_a8b8g8r8_box = a8r8g8b8_to_a8b8g8r8_box;
     dev->a8r8g8b8_to_nv12_box = a8r8g8b8_to_nv12_box;
+    dev->a8r8g8b8_to_yuvalp_box = a8r8g8b8_to_yuvalp_box;
+    /* xxh64 on every cpu, crc32c is linear and only 32 bit strong */
+    dev->tile_hash = tile_hash;
 #if SIMD_USE_ACCEL
     if (g_simd_use_accel)
     {
 #if defined(__x86_64__) || defined(__AMD64__) || defined (_M_AMD64)
         int ax, bx, cx, dx;
+        int max_leaf;
+        int xcr0_lo, xcr0_hi;
+        cpuid_amd64(0, 0, &ax, &bx, &cx, &dx);
+        max_leaf = ax;
         cpuid_amd64(1, 0, &ax, &bx, &cx, &dx);
         LLOGLN(0, ("rdpSimdInit: cpuid ax 1 cx 0 return ax 0x%8.8x bx "
                "0x%8.8x cx 0x%8.8x dx 0x%8.8x", ax, bx, cx, dx));
@@ -93,8 +101,33 @@ rdpSimdInit(ScreenPtr pScreen, ScrnInfoPtr pScrn)
             dev->uyvy_to_rgb32 = uyvy_to_rgb32_amd64_sse2;
             dev->a8r8g8b8_to_a8b8g8r8_box = a8r8g8b8_to_a8b8g8r8_box_amd64_sse2;
             dev->a8r8g8b8_to_nv12_box = a8r8g8b8_to_nv12_box_amd64_sse2;
+            dev->a8r8g8b8_to_yuvalp_box = a8r8g8b8_to_yuvalp_box_amd64_sse2;
             LLOGLN(0, ("rdpSimdInit: sse2 amd64 yuv functions assigned"));
         }
+        /* AVX 2 needs the cpu bit and the OS saving the ymm registers */
+        if ((max_leaf >= 7) &&
+            (cx & (1 << 27)) && /* OSXSAVE */
+            (cx & (1 << 28)))   /* AVX */
+        {
+            xgetbv_amd64(0, &xcr0_lo, &xcr0_hi);
+            if ((xcr0_lo & 6) == 6) /* xmm and ymm state */
+            {
+                cpuid_amd64(7, 0, &ax, &bx, &cx, &dx);
+                LLOGLN(0, ("rdpSimdInit: cpuid ax 7 cx 0 return ax 0x%8.8x bx "
+                       "0x%8.8x cx 0x%8.8x dx 0x%8.8x", ax, bx, cx, dx));
+                if (bx & (1 << 5)) /* AVX 2 */
+                {
+                    dev->yv12_to_rgb32 = yv12_to_rgb32_amd64_avx2;
+                    dev->i420_to_rgb32 = i420_to_rgb32_amd64_avx2;
+                    dev->yuy2_to_rgb32 = yuy2_to_rgb32_amd64_avx2;
+                    dev->uyvy_to_rgb32 = uyvy_to_rgb32_amd64_avx2;
+                    dev->a8r8g8b8_to_a8b8g8r8_box = a8r8g8b8_to_a8b8g8r8_box_amd64_avx2;
+                    dev->a8r8g8b8_to_nv12_box = a8r8g8b8_to_nv12_box_amd64_avx2;
+                    dev->a8r8g8b8_to_yuvalp_box = a8r8g8b8_to_yuvalp_box_amd64_avx2;
+                    LLOGLN(0, ("rdpSimdInit: avx2 amd64 yuv functions assigned"));
+                }
+            }
+        }
 #elif defined(__x86__) || defined(_M_IX86) || defined(__i386__)
         int ax, bx, cx, dx;
         cpuid_x86(1, 0, &ax, &bx, &cx, &dx);
@@ -0,0 +1,238 @@
+/*
+Copyright 2026 Jay Sorg
+
+Permission to use, copy, modify, distribute, and sell this software and its
+documentation for any purpose is hereby granted without fee, provided that
+the above copyright notice appear in all copies and that both that
+copyright notice and this permission notice appear in supporting
+documentation.
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+worker threads for capture and color conversion
+
+the X server thread hands out a batch of work items and takes part in
+running them, it returns when all items are done so callers see the
+same ordering as a plain loop
+
+*/
+
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+
+/* this should be before all X11 .h files */
+#include <xorg-server.h>
+#include <xorgVersion.h>
+
+/* all driver need this */
+#include <xf86.h>
+#include <xf86_OSproc.h>
+
+#include "rdp.h"
+#include "rdpMisc.h"
+#include "rdpThreads.h"
+
+#define LOG_LEVEL 1
+#define LLOGLN(_level, _args) \
+    do { if (_level < LOG_LEVEL) { ErrorF _args ; ErrorF("\n"); } } while (0)
+
+struct rdp_thread_pool
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    pthread_t *threads;
+    int num_threads; /* worker threads, not counting the X server thread */
+    int shutdown; /* boolean */
+    int generation; /* bumped for each batch */
+    rdp_thread_work_proc proc;
+    void *arg;
+    int count;
+    int next; /* next index to hand out */
+    int busy; /* workers that have not finished the current batch */
+};
+
+/*****************************************************************************/
+/* run items of the current batch until none are left, called and returns
+   with the mutex held */
+static void
+rdpThreadPoolWork(struct rdp_thread_pool *pool)
+{
+    int index;
+
+    while (pool->next < pool->count)
+    {
+        index = pool->next;
+        pool->next++;
+        pthread_mutex_unlock(&(pool->mutex));
+        pool->proc(pool->arg, index);
+        pthread_mutex_lock(&(pool->mutex));
+    }
+}
+
+/*****************************************************************************/
+static void *
+rdpThreadPoolThread(void *arg)
+{
+    struct rdp_thread_pool *pool;
+    int generation;
+
+    pool = (struct rdp_thread_pool *) arg;
+    /* a batch may be posted before this thread first gets the mutex */
+    generation = 0;
+    pthread_mutex_lock(&(pool->mutex));
+    for (;;)
+    {
+        while (!pool->shutdown && (pool->generation == generation))
+        {
+            pthread_cond_wait(&(pool->work_cond), &(pool->mutex));
+        }
+        if (pool->shutdown)
+        {
+            break;
+        }
+        generation = pool->generation;
+        rdpThreadPoolWork(pool);
+        pool->busy--;
+        if (pool->busy == 0)
+        {
+            pthread_cond_signal(&(pool->done_cond));
+        }
+    }
+    pthread_mutex_unlock(&(pool->mutex));
+    return 0;
+}
+
+/*****************************************************************************/
+/* num_threads includes the X server thread, returns NULL if no extra
+   threads are wanted or they can not be started */
+struct rdp_thread_pool *
+rdpThreadPoolCreate(int num_threads)
+{
+    struct rdp_thread_pool *pool;
+    sigset_t sigs;
+    sigset_t old_sigs;
+    int index;
+
+    num_threads = RDPMIN(num_threads, RDP_MAX_THREADS);
+    if (num_threads < 2)
+    {
+        return NULL;
+    }
+    pool = g_new0(struct rdp_thread_pool, 1);
+    pthread_mutex_init(&(pool->mutex), NULL);
+    pthread_cond_init(&(pool->work_cond), NULL);
+    pthread_cond_init(&(pool->done_cond), NULL);
+    pool->threads = g_new0(pthread_t, num_threads - 1);
+    /* workers never handle signals, the X server thread does */
+    sigfillset(&sigs);
+    pthread_sigmask(SIG_SETMASK, &sigs, &old_sigs);
+    for (index = 0; index < num_threads - 1; index++)
+    {
+        if (pthread_create(pool->threads + index, NULL,
+                           rdpThreadPoolThread, pool) != 0)
+        {
+            LLOGLN(0, ("rdpThreadPoolCreate: pthread_create failed"));
+            break;
+        }
+        pool->num_threads++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old_sigs, NULL);
+    if (pool->num_threads < 1)
+    {
+        rdpThreadPoolDestroy(pool);
+        return NULL;
+    }
+    LLOGLN(0, ("rdpThreadPoolCreate: started %d worker threads",
+           pool->num_threads));
+    return pool;
+}
+
+/*****************************************************************************/
+void
+rdpThreadPoolDestroy(struct rdp_thread_pool *pool)
+{
+    int index;
+
+    if (pool == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&(pool->mutex));
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&(pool->work_cond));
+    pthread_mutex_unlock(&(pool->mutex));
+    for (index = 0; index < pool->num_threads; index++)
+    {
+        pthread_join(pool->threads[index], NULL);
+    }
+    pthread_cond_destroy(&(pool->done_cond));
+    pthread_cond_destroy(&(pool->work_cond));
+    pthread_mutex_destroy(&(pool->mutex));
+    free(pool->threads);
+    free(pool);
+}
+
+/*****************************************************************************/
+/* returns the number of threads that run work, including the X server
+   thread */
+int
+rdpThreadPoolGetNumThreads(struct rdp_thread_pool *pool)
+{
+    if (pool == NULL)
+    {
+        return 1;
+    }
+    return pool->num_threads + 1;
+}
+
+/*****************************************************************************/
+/* calls proc(arg, index) for every index in [0, count) and returns when
+   all calls are done, a NULL pool runs them in order on this thread
+   returns error */
+int
+rdpThreadPoolRun(struct rdp_thread_pool *pool, int count,
+                 rdp_thread_work_proc proc, void *arg)
+{
+    int index;
+
+    if ((pool == NULL) || (count < 2))
+    {
+        for (index = 0; index < count; index++)
+        {
+            proc(arg, index);
+        }
+        return 0;
+    }
+    pthread_mutex_lock(&(pool->mutex));
+    pool->proc = proc;
+    pool->arg = arg;
+    pool->count = count;
+    pool->next = 0;
+    pool->busy = pool->num_threads;
+    pool->generation++;
+    pthread_cond_broadcast(&(pool->work_cond));
+    rdpThreadPoolWork(pool);
+    /* every worker has to see this batch before the next one starts */
+    while (pool->busy > 0)
+    {
+        pthread_cond_wait(&(pool->done_cond), &(pool->mutex));
+    }
+    pthread_mutex_unlock(&(pool->mutex));
+    return 0;
+}
@@ -0,0 +1,50 @@
+/*
+Copyright 2026 Jay Sorg
+
+Permission to use, copy, modify, distribute, and sell this software and its
+documentation for any purpose is hereby granted without fee, provided that
+the above copyright notice appear in all copies and that both that
+copyright notice and this permission notice appear in supporting
+documentation.
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+worker threads for capture and color conversion
+
+*/
+
+#ifndef __RDPTHREADS_H
+#define __RDPTHREADS_H
+
+#include <xorg-server.h>
+#include <xorgVersion.h>
+#include <xf86.h>
+
+/* most threads, including the X server thread, a pool can use */
+#define RDP_MAX_THREADS 16
+
+/* called once for each index in [0, count), from any pool thread,
+   must not call into the X server */
+typedef void (*rdp_thread_work_proc)(void *arg, int index);
+
+struct rdp_thread_pool;
+
+extern _X_EXPORT struct rdp_thread_pool *
+rdpThreadPoolCreate(int num_threads);
+extern _X_EXPORT void
+rdpThreadPoolDestroy(struct rdp_thread_pool *pool);
+extern _X_EXPORT int
+rdpThreadPoolGetNumThreads(struct rdp_thread_pool *pool);
+extern _X_EXPORT int
+rdpThreadPoolRun(struct rdp_thread_pool *pool, int count,
+                 rdp_thread_work_proc proc, void *arg);
+
+#endif
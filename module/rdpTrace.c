@@ -0,0 +1,171 @@
+/*
+Copyright 2026 Jay Sorg
+
+Permission to use, copy, modify, distribute, and sell this software and its
+documentation for any purpose is hereby granted without fee, provided that
+the above copyright notice appear in all copies and that both that
+copyright notice and this permission notice appear in supporting
+documentation.
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+binary trace ring
+
+a fixed ring of timestamped events from the capture and send paths, off
+unless "TraceEvents" gives it a size, written out as Chrome trace JSON
+for chrome://tracing or Perfetto, the same points are USDT probes for
+perf and bpftrace when sys/sdt.h is there
+
+*/
+
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* this should be before all X11 .h files */
+#include <xorg-server.h>
+#include <xorgVersion.h>
+
+/* all driver need this */
+#include <xf86.h>
+#include <xf86_OSproc.h>
+
+#include "rdp.h"
+#include "rdpMisc.h"
+#include "rdpTrace.h"
+
+#define LOG_LEVEL 1
+#define LLOGLN(_level, _args) \
+    do { if (_level < LOG_LEVEL) { ErrorF _args ; ErrorF("\n"); } } while (0)
+
+/* most events in the ring */
+#define RDP_TRACE_MAX_EVENTS (16 * 1024 * 1024)
+
+static const char *g_trace_names[RDP_TRACE_COUNT] =
+{
+    "schedule",
+    "update",
+    "cap_rect",
+    "capture",
+    "send",
+    "ack"
+};
+
+/*****************************************************************************/
+/* events is rounded up to a power of 2, less than 1 leaves tracing off
+   returns error */
+int
+rdpTraceInit(struct rdp_trace *trace, int events)
+{
+    unsigned int size;
+
+    memset(trace, 0, sizeof(struct rdp_trace));
+    if (events < 1)
+    {
+        return 0;
+    }
+    events = RDPMIN(events, RDP_TRACE_MAX_EVENTS);
+    size = 1;
+    while (size < (unsigned int) events)
+    {
+        size <<= 1;
+    }
+    trace->events = g_new0(struct rdp_trace_event, size);
+    if (trace->events == NULL)
+    {
+        LLOGLN(0, ("rdpTraceInit: alloc failed for %u events", size));
+        return 1;
+    }
+    trace->mask = size - 1;
+    LLOGLN(0, ("rdpTraceInit: %u events", size));
+    return 0;
+}
+
+/*****************************************************************************/
+void
+rdpTraceDeinit(struct rdp_trace *trace)
+{
+    free(trace->events);
+    memset(trace, 0, sizeof(struct rdp_trace));
+}
+
+/*****************************************************************************/
+/* main thread only */
+void
+rdpTraceAdd(struct rdp_trace *trace, enum rdp_trace_id id, char ph,
+            int con, int a0, int a1)
+{
+    struct rdp_trace_event *event;
+
+    event = trace->events + (trace->head & trace->mask);
+    trace->head++;
+    event->time_us = g_time_us();
+    event->id = id;
+    event->ph = ph;
+    event->con = con;
+    event->a0 = a0;
+    event->a1 = a1;
+}
+
+/*****************************************************************************/
+/* write the ring, oldest first, as Chrome trace JSON, one track per
+   connection
+   returns error */
+int
+rdpTraceDump(const struct rdp_trace *trace, const char *filename)
+{
+    const struct rdp_trace_event *event;
+    unsigned int index;
+    unsigned int first;
+    FILE *file;
+    int pid;
+
+    if (trace->events == NULL)
+    {
+        return 0;
+    }
+    file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        LLOGLN(0, ("rdpTraceDump: can not open %s", filename));
+        return 1;
+    }
+    pid = getpid();
+    first = 0;
+    if (trace->head > trace->mask + 1)
+    {
+        first = trace->head - (trace->mask + 1);
+    }
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (index = first; index != trace->head; index++)
+    {
+        event = trace->events + (index & trace->mask);
+        /* instants are scoped to their own track */
+        fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,"
+                "\"pid\":%d,\"tid\":%d,%s\"args\":{\"a0\":%d,\"a1\":%d}}",
+                (index == first) ? "" : ",\n",
+                (event->id < RDP_TRACE_COUNT) ?
+                g_trace_names[event->id] : "?",
+                event->ph, (unsigned long long) event->time_us, pid,
+                event->con, (event->ph == 'i') ? "\"s\":\"t\"," : "",
+                event->a0, event->a1);
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    LLOGLN(0, ("rdpTraceDump: %u events to %s", trace->head - first,
+           filename));
+    return 0;
+}
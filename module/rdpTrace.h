@@ -0,0 +1,95 @@
+/*
+Copyright 2026 Jay Sorg
+
+Permission to use, copy, modify, distribute, and sell this software and its
+documentation for any purpose is hereby granted without fee, provided that
+the above copyright notice appear in all copies and that both that
+copyright notice and this permission notice appear in supporting
+documentation.
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+binary trace ring
+
+*/
+
+#ifndef __RDPTRACE_H
+#define __RDPTRACE_H
+
+#include <xorg-server.h>
+#include <xorgVersion.h>
+#include <xf86.h>
+
+#if defined(HAVE_SYS_SDT_H)
+#include <sys/sdt.h>
+#endif
+
+/* what was traced, the names after RDP_TRACE_ are the USDT probe names,
+   see rdpTraceNames in rdpTrace.c */
+enum rdp_trace_id
+{
+    RDP_TRACE_schedule = 0, /* rdpScheduleDeferredUpdate, a0 ms to wait */
+    RDP_TRACE_update,       /* rdpDeferredUpdateCallback, a0 rect_id */
+    RDP_TRACE_cap_rect,     /* rdpCapRect, a0 dirty rects, a1 pixels */
+    RDP_TRACE_capture,      /* rdpCapture, a0 capture code, a1 rects out */
+    RDP_TRACE_send,         /* rdpClientConSendWithFd, a0 bytes, a1 fd */
+    RDP_TRACE_ack,          /* frame ack, a0 rect_id_ack, a1 rect_id */
+    RDP_TRACE_COUNT
+};
+
+/* one event, ph is 'B'egin, 'E'nd or 'i'nstant as in Chrome traces */
+struct rdp_trace_event
+{
+    uint64_t time_us;
+    uint8_t id;
+    char ph;
+    uint16_t con;
+    int32_t a0;
+    int32_t a1;
+};
+
+/* events is NULL when tracing is off */
+struct rdp_trace
+{
+    struct rdp_trace_event *events;
+    unsigned int mask; /* events in the ring less one, a power of 2 less 1 */
+    unsigned int head; /* events added, the next goes at head & mask */
+};
+
+#if defined(HAVE_SYS_SDT_H)
+#define RDP_TRACE_PROBE(_name, _ph, _con, _a0, _a1) \
+    DTRACE_PROBE4(xorgxrdp, _name, _ph, _con, _a0, _a1)
+#else
+#define RDP_TRACE_PROBE(_name, _ph, _con, _a0, _a1)
+#endif
+
+/* always compiled, costs a test when the ring is off and no probe is
+   attached */
+#define RDP_TRACE(_trace, _name, _ph, _con, _a0, _a1) \
+    do { \
+        RDP_TRACE_PROBE(_name, _ph, _con, _a0, _a1); \
+        if ((_trace)->events != NULL) \
+        { \
+            rdpTraceAdd(_trace, RDP_TRACE_ ## _name, _ph, _con, _a0, _a1); \
+        } \
+    } while (0)
+
+extern _X_EXPORT int
+rdpTraceInit(struct rdp_trace *trace, int events);
+extern _X_EXPORT void
+rdpTraceDeinit(struct rdp_trace *trace);
+extern _X_EXPORT void
+rdpTraceAdd(struct rdp_trace *trace, enum rdp_trace_id id, char ph,
+            int con, int a0, int a1);
+extern _X_EXPORT int
+rdpTraceDump(const struct rdp_trace *trace, const char *filename);
+
+#endif
@@ -0,0 +1,1124 @@
+/*
+Copyright 2026 Jay Sorg
+
+Permission to use, copy, modify, distribute, and sell this software and its
+documentation for any purpose is hereby granted without fee, provided that
+the above copyright notice appear in all copies and that both that
+copyright notice and this permission notice appear in supporting
+documentation.
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+capture pipeline speed testing
+runs rdpCapture for every capture code and output format over synthetic
+damage, without an X server or a client
+
+*/
+
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* this should be before all X11 .h files */
+#include <xorg-server.h>
+#include <xorgVersion.h>
+
+/* all driver need this */
+#include <xf86.h>
+#include <xf86_OSproc.h>
+
+#include "rdp.h"
+#include "rdpClientCon.h"
+#include "rdpCapture.h"
+#include "rdpReg.h"
+#include "rdpMisc.h"
+#include "rdpSimd.h"
+#include "rdpThreads.h"
+
+#include "xserver_shim.h"
+
+#if defined(SIMD_USE_ACCEL)
+#if defined(__x86_64__) || defined(__AMD64__) || defined (_M_AMD64)
+#include "amd64/funcs_amd64.h"
+#define CHECK_SIMD_AMD64 1
+#endif
+#endif
+
+#define BENCH_MAX_MONITORS 2
+
+/* glyph cell, like a small terminal font */
+#define BENCH_CHAR_WIDTH 8
+#define BENCH_CHAR_HEIGHT 16
+#define BENCH_TITLE_HEIGHT 24
+
+#define BENCH_DESKTOP_PIXEL 0x003a6ea5
+#define BENCH_TITLE_PIXEL 0x00404040
+#define BENCH_PAPER_PIXEL 0x00ffffff
+#define BENCH_INK_PIXEL 0x00202020
+
+struct bench
+{
+    rdpPtr dev;
+    rdpClientCon *clientCon;
+    int width;
+    int height;
+    int stride;
+    uint8_t *fb;
+    uint8_t *shm;
+    uint32_t seed;
+    int num_monitors;
+    BoxRec monitors[BENCH_MAX_MONITORS];
+    BoxRec text; /* text area of the document window */
+    int cursor_x;
+    int cursor_y;
+    int line;
+};
+
+struct bench_result
+{
+    int frames;
+    int captures;
+    int failures;
+    int64_t pixels;
+    int64_t tiles;
+    int64_t skipped;
+    int64_t elapsed_ns;
+};
+
+typedef void (*bench_init_proc)(struct bench *b);
+/* changes the frame buffer and adds what changed to damage */
+typedef void (*bench_frame_proc)(struct bench *b, int frame,
+                                 RegionPtr damage);
+
+struct bench_pattern
+{
+    const char *name;
+    bench_init_proc init;
+    bench_frame_proc frame;
+};
+
+struct bench_format
+{
+    int capture_code;
+    int format;
+    const char *name;
+};
+
+static const struct bench_format g_formats[] =
+{
+    { 0, XRDP_a8r8g8b8, "a8r8g8b8" },
+    { 0, XRDP_a8b8g8r8, "a8b8g8r8" },
+    { 0, XRDP_r5g6b5, "r5g6b5" },
+    { 0, XRDP_a1r5g5b5, "a1r5g5b5" },
+    { 0, XRDP_r3g3b2, "r3g3b2" },
+    { 1, XRDP_a8b8g8r8, "a8b8g8r8" },
+    { 2, XRDP_a8r8g8b8, "yuvalp" },
+    { 3, XRDP_nv12, "nv12" },
+    { 3, XRDP_a8r8g8b8, "a8r8g8b8" },
+    { 4, XRDP_a8r8g8b8, "yuvalp" },
+    { 5, XRDP_nv12, "nv12" },
+    { 5, XRDP_a8r8g8b8, "a8r8g8b8" }
+};
+
+#define NUM_FORMATS ((int) (sizeof(g_formats) / sizeof(g_formats[0])))
+
+static ScrnInfoRec g_scrn;
+
+/******************************************************************************/
+static int64_t
+bench_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/******************************************************************************/
+/* xorshift, the same seed always draws the same frames */
+static uint32_t
+bench_rand(struct bench *b)
+{
+    uint32_t x;
+
+    x = b->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    b->seed = x;
+    return x;
+}
+
+/******************************************************************************/
+static uint32_t
+bench_hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+/******************************************************************************/
+static void
+bench_fill(struct bench *b, const BoxRec *box, uint32_t pixel)
+{
+    uint32_t *d32;
+    int index;
+    int jndex;
+
+    for (jndex = box->y1; jndex < box->y2; jndex++)
+    {
+        d32 = (uint32_t *) (b->fb + jndex * b->stride) + box->x1;
+        for (index = box->x1; index < box->x2; index++)
+        {
+            *(d32++) = pixel;
+        }
+    }
+}
+
+/******************************************************************************/
+static void
+bench_noise(struct bench *b, const BoxRec *box)
+{
+    uint32_t *d32;
+    int index;
+    int jndex;
+
+    for (jndex = box->y1; jndex < box->y2; jndex++)
+    {
+        d32 = (uint32_t *) (b->fb + jndex * b->stride) + box->x1;
+        for (index = box->x1; index < box->x2; index++)
+        {
+            *(d32++) = bench_rand(b) & 0x00ffffff;
+        }
+    }
+}
+
+/******************************************************************************/
+/* draws one character cell, the same ch always looks the same */
+static void
+bench_glyph(struct bench *b, int x, int y, int ch)
+{
+    uint32_t *d32;
+    uint32_t bits;
+    BoxRec box;
+    int index;
+    int jndex;
+
+    box.x1 = x;
+    box.y1 = y;
+    box.x2 = x + BENCH_CHAR_WIDTH;
+    box.y2 = y + BENCH_CHAR_HEIGHT;
+    bench_fill(b, &box, BENCH_PAPER_PIXEL);
+    if (ch == ' ')
+    {
+        return;
+    }
+    for (jndex = 3; jndex < BENCH_CHAR_HEIGHT - 3; jndex++)
+    {
+        bits = bench_hash((ch << 4) | jndex);
+        d32 = (uint32_t *) (b->fb + (y + jndex) * b->stride) + x;
+        for (index = 1; index < BENCH_CHAR_WIDTH - 1; index++)
+        {
+            if (bits & (1 << index))
+            {
+                d32[index] = BENCH_INK_PIXEL;
+            }
+        }
+    }
+}
+
+/******************************************************************************/
+/* draws one line of the document at y, every few lines is blank */
+static void
+bench_text_line(struct bench *b, int y, int line)
+{
+    BoxRec box;
+    int cols;
+    int count;
+    int index;
+    int ch;
+
+    box.x1 = b->text.x1;
+    box.y1 = y;
+    box.x2 = b->text.x2;
+    box.y2 = y + BENCH_CHAR_HEIGHT;
+    bench_fill(b, &box, BENCH_PAPER_PIXEL);
+    if ((line % 7) == 6)
+    {
+        return;
+    }
+    cols = (b->text.x2 - b->text.x1) / BENCH_CHAR_WIDTH;
+    count = cols / 4 + bench_hash(line) % (cols - cols / 4);
+    for (index = 0; index < count; index++)
+    {
+        ch = bench_hash(line * 131 + index) % 95 + ' ';
+        if ((ch % 6) == 0)
+        {
+            ch = ' ';
+        }
+        bench_glyph(b, b->text.x1 + index * BENCH_CHAR_WIDTH, y, ch);
+    }
+}
+
+/******************************************************************************/
+/* a desktop with one document window on it */
+static void
+bench_desktop(struct bench *b)
+{
+    BoxRec box;
+    int y;
+
+    box.x1 = 0;
+    box.y1 = 0;
+    box.x2 = b->width;
+    box.y2 = b->height;
+    bench_fill(b, &box, BENCH_DESKTOP_PIXEL);
+    box.x1 = b->width / 16;
+    box.y1 = b->height / 16;
+    box.x2 = box.x1 + (b->width * 5 / 8) / BENCH_CHAR_WIDTH * BENCH_CHAR_WIDTH;
+    box.y2 = box.y1 + BENCH_TITLE_HEIGHT;
+    bench_fill(b, &box, BENCH_TITLE_PIXEL);
+    b->text.x1 = box.x1;
+    b->text.y1 = box.y2;
+    b->text.x2 = box.x2;
+    b->text.y2 = box.y2 + (b->height * 3 / 4) / BENCH_CHAR_HEIGHT *
+                 BENCH_CHAR_HEIGHT;
+    b->line = 0;
+    for (y = b->text.y1; y < b->text.y2; y += BENCH_CHAR_HEIGHT)
+    {
+        bench_text_line(b, y, b->line);
+        b->line++;
+    }
+    b->cursor_x = b->text.x1;
+    b->cursor_y = b->text.y1;
+}
+
+/******************************************************************************/
+static void
+bench_init_desktop(struct bench *b)
+{
+    bench_desktop(b);
+}
+
+/******************************************************************************/
+/* everything changes every frame, a full screen game or video */
+static void
+bench_frame_full_screen(struct bench *b, int frame, RegionPtr damage)
+{
+    BoxRec box;
+
+    box.x1 = 0;
+    box.y1 = 0;
+    box.x2 = b->width;
+    box.y2 = b->height;
+    bench_noise(b, &box);
+    rdpRegionUnionRect(damage, &box);
+}
+
+/******************************************************************************/
+/* one character a frame, every 8th frame the editor repaints the whole
+   line without changing it */
+static void
+bench_frame_typing(struct bench *b, int frame, RegionPtr damage)
+{
+    BoxRec box;
+
+    if ((frame % 8) == 7)
+    {
+        box.x1 = b->text.x1;
+        box.y1 = b->cursor_y;
+        box.x2 = b->text.x2;
+        box.y2 = b->cursor_y + BENCH_CHAR_HEIGHT;
+        rdpRegionUnionRect(damage, &box);
+    }
+    bench_glyph(b, b->cursor_x, b->cursor_y, frame % 95 + ' ');
+    box.x1 = b->cursor_x;
+    box.y1 = b->cursor_y;
+    box.x2 = b->cursor_x + BENCH_CHAR_WIDTH;
+    box.y2 = b->cursor_y + BENCH_CHAR_HEIGHT;
+    rdpRegionUnionRect(damage, &box);
+    b->cursor_x += BENCH_CHAR_WIDTH;
+    if (b->cursor_x + BENCH_CHAR_WIDTH > b->text.x2)
+    {
+        b->cursor_x = b->text.x1;
+        b->cursor_y += BENCH_CHAR_HEIGHT;
+        if (b->cursor_y + BENCH_CHAR_HEIGHT > b->text.y2)
+        {
+            b->cursor_y = b->text.y1;
+        }
+    }
+}
+
+/******************************************************************************/
+/* the document scrolls up one line a frame, the client repaints the
+   whole text area */
+static void
+bench_frame_scrolling(struct bench *b, int frame, RegionPtr damage)
+{
+    uint8_t *d8;
+    int bytes;
+    int y;
+
+    bytes = (b->text.x2 - b->text.x1) * 4;
+    for (y = b->text.y1; y < b->text.y2 - BENCH_CHAR_HEIGHT; y++)
+    {
+        d8 = b->fb + y * b->stride + b->text.x1 * 4;
+        memcpy(d8, d8 + BENCH_CHAR_HEIGHT * b->stride, bytes);
+    }
+    bench_text_line(b, b->text.y2 - BENCH_CHAR_HEIGHT, b->line);
+    b->line++;
+    rdpRegionUnionRect(damage, &(b->text));
+}
+
+/******************************************************************************/
+/* a video playing in a window */
+static void
+bench_frame_video(struct bench *b, int frame, RegionPtr damage)
+{
+    BoxRec box;
+
+    box.x1 = b->width / 6;
+    box.y1 = b->height / 6;
+    box.x2 = b->width - b->width / 6;
+    box.y2 = b->height - b->height / 6;
+    bench_noise(b, &box);
+    rdpRegionUnionRect(damage, &box);
+}
+
+/******************************************************************************/
+/* two monitors side by side */
+static void
+bench_init_multi_monitor(struct bench *b)
+{
+    bench_desktop(b);
+    b->num_monitors = 2;
+    b->monitors[0].x1 = 0;
+    b->monitors[0].y1 = 0;
+    b->monitors[0].x2 = b->width / 2;
+    b->monitors[0].y2 = b->height;
+    b->monitors[1].x1 = b->width / 2;
+    b->monitors[1].y1 = 0;
+    b->monitors[1].x2 = b->width;
+    b->monitors[1].y2 = b->height;
+}
+
+/******************************************************************************/
+/* a window across both monitors changes every frame and the document
+   gets typed into */
+static void
+bench_frame_multi_monitor(struct bench *b, int frame, RegionPtr damage)
+{
+    BoxRec box;
+
+    box.x1 = b->width / 4;
+    box.y1 = b->height / 2;
+    box.x2 = b->width - b->width / 4;
+    box.y2 = b->height - b->height / 8;
+    bench_noise(b, &box);
+    rdpRegionUnionRect(damage, &box);
+    bench_frame_typing(b, frame, damage);
+}
+
+static const struct bench_pattern g_patterns[] =
+{
+    { "fullscreen", bench_init_desktop, bench_frame_full_screen },
+    { "typing", bench_init_desktop, bench_frame_typing },
+    { "scrolling", bench_init_desktop, bench_frame_scrolling },
+    { "video", bench_init_desktop, bench_frame_video },
+    { "multimon", bench_init_multi_monitor, bench_frame_multi_monitor }
+};
+
+#define NUM_PATTERNS ((int) (sizeof(g_patterns) / sizeof(g_patterns[0])))
+
+/******************************************************************************/
+/* sets up the capture fields like rdpClientConProcessMsgClientInfo does */
+static void
+bench_set_format(struct bench *b, const struct bench_format *format)
+{
+    rdpClientCon *clientCon;
+    int index;
+
+    clientCon = b->clientCon;
+    clientCon->client_info.capture_code = format->capture_code;
+    clientCon->client_info.capture_format = format->format;
+    clientCon->rdp_format = format->format;
+    clientCon->cap_left = 0;
+    clientCon->cap_top = 0;
+    switch (format->capture_code)
+    {
+        case 2:
+        case 4:
+            clientCon->cap_width = RDPALIGN(b->width, XRDP_RFX_ALIGN);
+            clientCon->cap_height = RDPALIGN(b->height, XRDP_RFX_ALIGN);
+            clientCon->shmemstatus = SHM_RFX_ACTIVE;
+            break;
+        case 3:
+        case 5:
+            clientCon->cap_width = b->width;
+            clientCon->cap_height = b->height;
+            clientCon->shmemstatus = SHM_H264_ACTIVE;
+            break;
+        default:
+            clientCon->cap_width = b->width;
+            clientCon->cap_height = b->height;
+            clientCon->shmemstatus = SHM_ACTIVE;
+            break;
+    }
+    switch (format->format)
+    {
+        case XRDP_a8r8g8b8:
+        case XRDP_a8b8g8r8:
+            clientCon->cap_stride_bytes = clientCon->cap_width * 4;
+            break;
+        case XRDP_r5g6b5:
+        case XRDP_a1r5g5b5:
+            clientCon->cap_stride_bytes = clientCon->cap_width * 2;
+            break;
+        default:
+            clientCon->cap_stride_bytes = clientCon->cap_width * 1;
+            break;
+    }
+    for (index = 0; index < 16; index++)
+    {
+        clientCon->send_key_frame[index] = 1;
+    }
+}
+
+/******************************************************************************/
+/* 64x64 tiles, from left, top, that have some of reg in them */
+static int
+bench_count_tiles(RegionPtr reg, int left, int top)
+{
+    BoxRec extents;
+    BoxRec rect;
+    int x;
+    int y;
+    int rv;
+
+    rv = 0;
+    extents = *rdpRegionExtents(reg);
+    y = top + ((extents.y1 - top) & ~63);
+    while (y < extents.y2)
+    {
+        x = left + ((extents.x1 - left) & ~63);
+        while (x < extents.x2)
+        {
+            rect.x1 = x;
+            rect.y1 = y;
+            rect.x2 = x + XRDP_RFX_ALIGN;
+            rect.y2 = y + XRDP_RFX_ALIGN;
+            if (rdpRegionContainsRect(reg, &rect) != rgnOUT)
+            {
+                rv++;
+            }
+            x += XRDP_RFX_ALIGN;
+        }
+        y += XRDP_RFX_ALIGN;
+    }
+    return rv;
+}
+
+/******************************************************************************/
+/* captures the part of damage on one monitor like rdpCapRect does, only
+   the rdpCapture call is timed */
+static void
+bench_capture(struct bench *b, int mon, RegionPtr damage,
+              struct bench_result *result)
+{
+    rdpClientCon *clientCon;
+    RegionPtr cap_dirty;
+    BoxPtr cap_rect;
+    BoxPtr rects;
+    struct image_data id;
+    int num_rects;
+    int tiles;
+    int64_t start_ns;
+    Bool ok;
+
+    clientCon = b->clientCon;
+    cap_rect = b->monitors + mon;
+    cap_dirty = rdpRegionCreate(cap_rect, 0);
+    rdpRegionIntersect(cap_dirty, cap_dirty, damage);
+    if (!rdpRegionNotEmpty(cap_dirty))
+    {
+        rdpRegionDestroy(cap_dirty);
+        return;
+    }
+    g_memset(&id, 0, sizeof(id));
+    id.width = b->width;
+    id.height = b->height;
+    id.bpp = 32;
+    id.Bpp = 4;
+    id.lineBytes = b->stride;
+    id.pixels = b->fb;
+    id.shmem_pixels = b->shm;
+    id.shmem_lineBytes = clientCon->cap_stride_bytes;
+    if (b->num_monitors > 1)
+    {
+        id.left = cap_rect->x1;
+        id.top = cap_rect->y1;
+        id.width = cap_rect->x2 - cap_rect->x1;
+        id.height = cap_rect->y2 - cap_rect->y1;
+        id.flags = (mon & 0xF) << 28;
+    }
+    result->pixels += rdpRegionPixelCount(cap_dirty);
+    tiles = bench_count_tiles(cap_dirty, id.left, id.top);
+    result->tiles += tiles;
+    rects = NULL;
+    num_rects = 0;
+    start_ns = bench_time_ns();
+    ok = rdpCapture(clientCon, cap_dirty, &rects, &num_rects, &id);
+    result->elapsed_ns += bench_time_ns() - start_ns;
+    result->captures++;
+    if (ok)
+    {
+        switch (clientCon->client_info.capture_code)
+        {
+            case 2:
+            case 4:
+                /* tiles that hashed the same as last time are dropped */
+                result->skipped += tiles - num_rects;
+                break;
+        }
+        free(rects);
+    }
+    else
+    {
+        result->failures++;
+    }
+    rdpRegionDestroy(cap_dirty);
+}
+
+/******************************************************************************/
+static void
+bench_run(struct bench *b, const struct bench_pattern *pattern,
+          const struct bench_format *format, int frames,
+          struct bench_result *result)
+{
+    RegionPtr damage;
+    int frame;
+    int mon;
+
+    /* the last run may have left crcs for a different capture code */
+    b->clientCon->client_info.capture_code = 2;
+    rdpCaptureResetState(b->clientCon);
+    bench_set_format(b, format);
+    b->seed = 0x2545f491;
+    b->num_monitors = 1;
+    b->monitors[0].x1 = 0;
+    b->monitors[0].y1 = 0;
+    b->monitors[0].x2 = b->width;
+    b->monitors[0].y2 = b->height;
+    pattern->init(b);
+    g_memset(result, 0, sizeof(struct bench_result));
+    for (frame = 0; frame < frames; frame++)
+    {
+        damage = rdpRegionCreate(NullBox, 0);
+        pattern->frame(b, frame, damage);
+        for (mon = 0; mon < b->num_monitors; mon++)
+        {
+            bench_capture(b, mon, damage, result);
+        }
+        rdpRegionDestroy(damage);
+        result->frames++;
+    }
+}
+
+/******************************************************************************/
+static void
+bench_print_result(const struct bench_pattern *pattern,
+                   const struct bench_format *format,
+                   const struct bench_result *result)
+{
+    double mpixels;
+    double ns_per_tile;
+    char skip_text[32];
+
+    mpixels = 0;
+    ns_per_tile = 0;
+    if (result->elapsed_ns > 0)
+    {
+        mpixels = (double) result->pixels * 1000.0 /
+                  (double) result->elapsed_ns;
+    }
+    if (result->tiles > 0)
+    {
+        ns_per_tile = (double) result->elapsed_ns / (double) result->tiles;
+    }
+    if (((format->capture_code == 2) || (format->capture_code == 4)) &&
+        (result->tiles > 0))
+    {
+        snprintf(skip_text, sizeof(skip_text), "%5.1f%%",
+                 100.0 * (double) result->skipped / (double) result->tiles);
+    }
+    else
+    {
+        snprintf(skip_text, sizeof(skip_text), "%6s", "-");
+    }
+    printf("%-10s %4d  %-8s %6d %10.1f %10.1f %9s %s\n",
+           pattern->name, format->capture_code, format->name,
+           result->frames, mpixels, ns_per_tile, skip_text,
+           result->failures == 0 ? "" : "FAILED");
+}
+
+#if defined(CHECK_SIMD_AMD64)
+
+/* source pixels left of the box, so the box is on the right edge of
+   each row */
+#define CHECK_PAD 8
+
+typedef int (*check_yuvalp_proc)(const uint8_t *s8, int src_stride,
+                                 uint8_t *d8, int dst_stride,
+                                 int width, int height);
+typedef int (*check_nv12_proc)(const uint8_t *s8, int src_stride,
+                               uint8_t *d8_y, int dst_stride_y,
+                               uint8_t *d8_uv, int dst_stride_uv,
+                               int width, int height);
+
+/* memory that ends right before an unmapped page, a kernel that reads
+   past the right edge of the last row faults */
+struct check_buf
+{
+    uint8_t *map;
+    size_t map_bytes;
+    uint8_t *data;
+};
+
+/******************************************************************************/
+static int
+check_buf_create(struct check_buf *buf, int bytes)
+{
+    size_t page;
+
+    page = sysconf(_SC_PAGESIZE);
+    buf->map_bytes = (bytes + page - 1) / page * page + page;
+    buf->map = (uint8_t *) mmap(NULL, buf->map_bytes, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf->map == MAP_FAILED)
+    {
+        return 1;
+    }
+    if (mprotect(buf->map + buf->map_bytes - page, page, PROT_NONE) != 0)
+    {
+        munmap(buf->map, buf->map_bytes);
+        return 1;
+    }
+    buf->data = buf->map + buf->map_bytes - page - bytes;
+    return 0;
+}
+
+/******************************************************************************/
+static void
+check_buf_destroy(struct check_buf *buf)
+{
+    munmap(buf->map, buf->map_bytes);
+}
+
+/******************************************************************************/
+/* rows of CHECK_PAD + width random pixels, returns the box */
+static const uint8_t *
+check_src_create(struct check_buf *buf, int width, int height,
+                 int *src_stride)
+{
+    uint32_t *s32;
+    int count;
+    int index;
+
+    *src_stride = (CHECK_PAD + width) * 4;
+    if (check_buf_create(buf, *src_stride * height) != 0)
+    {
+        return NULL;
+    }
+    s32 = (uint32_t *) (buf->data);
+    count = (CHECK_PAD + width) * height;
+    for (index = 0; index < count; index++)
+    {
+        s32[index] = bench_hash(index ^ (width << 20) ^ (height << 8));
+    }
+    return buf->data + CHECK_PAD * 4;
+}
+
+/******************************************************************************/
+/* same as rdpSimdInit */
+static int
+check_has_avx2(void)
+{
+    int ax, bx, cx, dx;
+    int max_leaf;
+    int xcr0_lo, xcr0_hi;
+
+    cpuid_amd64(0, 0, &ax, &bx, &cx, &dx);
+    max_leaf = ax;
+    cpuid_amd64(1, 0, &ax, &bx, &cx, &dx);
+    if ((max_leaf < 7) ||
+        !(cx & (1 << 27)) || /* OSXSAVE */
+        !(cx & (1 << 28)))   /* AVX */
+    {
+        return 0;
+    }
+    xgetbv_amd64(0, &xcr0_lo, &xcr0_hi);
+    if ((xcr0_lo & 6) != 6) /* xmm and ymm state */
+    {
+        return 0;
+    }
+    cpuid_amd64(7, 0, &ax, &bx, &cx, &dx);
+    return (bx & (1 << 5)) != 0; /* AVX 2 */
+}
+
+/******************************************************************************/
+/* the kernels do whole row pairs, for an odd height the last row is
+   left alone so C gets height & ~1, the destination is wider than the
+   box and all of it is compared so writes past the box show up */
+static int
+check_nv12(const char *name, check_nv12_proc proc, int width, int height)
+{
+    struct check_buf src;
+    const uint8_t *s8;
+    uint8_t *y_ref;
+    uint8_t *uv_ref;
+    uint8_t *y_test;
+    uint8_t *uv_test;
+    int src_stride;
+    int dst_stride;
+    int y_bytes;
+    int uv_bytes;
+    int rv;
+
+    s8 = check_src_create(&src, width, height, &src_stride);
+    if (s8 == NULL)
+    {
+        printf("check_nv12: check_src_create failed\n");
+        return 1;
+    }
+    dst_stride = width + CHECK_PAD;
+    y_bytes = dst_stride * height;
+    uv_bytes = dst_stride * ((height + 1) / 2);
+    y_ref = g_new(uint8_t, y_bytes);
+    uv_ref = g_new(uint8_t, uv_bytes);
+    y_test = g_new(uint8_t, y_bytes);
+    uv_test = g_new(uint8_t, uv_bytes);
+    memset(y_ref, 0xcd, y_bytes);
+    memset(uv_ref, 0xcd, uv_bytes);
+    memset(y_test, 0xcd, y_bytes);
+    memset(uv_test, 0xcd, uv_bytes);
+    a8r8g8b8_to_nv12_box(s8, src_stride, y_ref, dst_stride,
+                         uv_ref, dst_stride, width, height & ~1);
+    proc(s8, src_stride, y_test, dst_stride,
+         uv_test, dst_stride, width, height);
+    rv = 0;
+    if ((memcmp(y_ref, y_test, y_bytes) != 0) ||
+        (memcmp(uv_ref, uv_test, uv_bytes) != 0))
+    {
+        printf("check_nv12: %s %dx%d does not match C\n",
+               name, width, height);
+        rv = 1;
+    }
+    free(uv_test);
+    free(y_test);
+    free(uv_ref);
+    free(y_ref);
+    check_buf_destroy(&src);
+    return rv;
+}
+
+/******************************************************************************/
+/* 8, 24, 40 and 1928 have width & 8 set, that goes through the avx2
+   8 pixel tail */
+static int
+check_nv12_sizes(const char *name, check_nv12_proc proc)
+{
+    static const int widths[] = { 8, 16, 24, 40, 64, 200, 1928 };
+    static const int heights[] = { 2, 7, 64, 65 };
+    int failures;
+    int index;
+    int jndex;
+
+    failures = 0;
+    for (index = 0; index < (int) (sizeof(widths) / sizeof(widths[0]));
+         index++)
+    {
+        for (jndex = 0; jndex < (int) (sizeof(heights) / sizeof(heights[0]));
+             jndex++)
+        {
+            failures += check_nv12(name, proc, widths[index], heights[jndex]);
+        }
+    }
+    printf("simd check nv12 %-5s %s\n", name, failures == 0 ? "ok" : "FAILED");
+    return failures;
+}
+
+/******************************************************************************/
+/* one 64x64 tile, the box starts at x in the tile, all four planes are
+   compared so writes past the box show up */
+static int
+check_yuvalp(const char *name, check_yuvalp_proc proc,
+             int x, int width, int height)
+{
+    struct check_buf src;
+    const uint8_t *s8;
+    uint8_t *ref;
+    uint8_t *test;
+    int src_stride;
+    int rv;
+
+    s8 = check_src_create(&src, width, height, &src_stride);
+    if (s8 == NULL)
+    {
+        printf("check_yuvalp: check_src_create failed\n");
+        return 1;
+    }
+    ref = g_new(uint8_t, 64 * 64 * 4);
+    test = g_new(uint8_t, 64 * 64 * 4);
+    memset(ref, 0xcd, 64 * 64 * 4);
+    memset(test, 0xcd, 64 * 64 * 4);
+    a8r8g8b8_to_yuvalp_box(s8, src_stride, ref + x, 64, width, height);
+    proc(s8, src_stride, test + x, 64, width, height);
+    rv = 0;
+    if (memcmp(ref, test, 64 * 64 * 4) != 0)
+    {
+        printf("check_yuvalp: %s x %d %dx%d does not match C\n",
+               name, x, width, height);
+        rv = 1;
+    }
+    free(test);
+    free(ref);
+    check_buf_destroy(&src);
+    return rv;
+}
+
+/******************************************************************************/
+/* every width from 1 to 64, so every tail length of the 8 and 16 pixel
+   loops, at the left and the right edge of the tile */
+static int
+check_yuvalp_sizes(const char *name, check_yuvalp_proc proc)
+{
+    static const int heights[] = { 1, 2, 7, 64 };
+    int failures;
+    int width;
+    int jndex;
+
+    failures = 0;
+    for (width = 1; width <= 64; width++)
+    {
+        for (jndex = 0; jndex < (int) (sizeof(heights) / sizeof(heights[0]));
+             jndex++)
+        {
+            failures += check_yuvalp(name, proc, 0, width, heights[jndex]);
+            failures += check_yuvalp(name, proc, 64 - width, width,
+                                     heights[jndex]);
+        }
+    }
+    printf("simd check yuvalp %-5s %s\n", name,
+           failures == 0 ? "ok" : "FAILED");
+    return failures;
+}
+
+/******************************************************************************/
+/* the asm kernels have to match the C ones byte for byte */
+static int
+check_simd(void)
+{
+    int failures;
+    int avx2;
+
+    avx2 = check_has_avx2();
+    failures = 0;
+    failures += check_nv12_sizes("sse2", a8r8g8b8_to_nv12_box_amd64_sse2);
+    failures += check_yuvalp_sizes("sse2", a8r8g8b8_to_yuvalp_box_amd64_sse2);
+    if (avx2)
+    {
+        failures += check_nv12_sizes("avx2", a8r8g8b8_to_nv12_box_amd64_avx2);
+        failures += check_yuvalp_sizes("avx2",
+                                       a8r8g8b8_to_yuvalp_box_amd64_avx2);
+    }
+    else
+    {
+        printf("simd check avx2 not supported, skipped\n");
+    }
+    return failures;
+}
+
+#endif
+
+/******************************************************************************/
+static int
+output_params(void)
+{
+    printf("usage: capture_bench run|runtest [options]\n");
+    printf("  run      run every pattern and format\n");
+    printf("  runtest  short run at a small size, for make check\n");
+    printf("options:\n");
+    printf("  -s WxH   screen size, default 1920x1080\n");
+    printf("  -f N     frames for each pattern, default 100\n");
+    printf("  -t N     capture threads, 0 for one per cpu, default 1\n");
+    printf("  -p NAME  only this pattern\n");
+    printf("  -c N     only this capture code\n");
+    printf("  -v       show log output\n");
+    return 0;
+}
+
+/******************************************************************************/
+int
+main(int argc, char **argv)
+{
+    struct bench b;
+    struct bench_result result;
+    const char *pattern_name;
+    int frames;
+    int threads;
+    int capture_code;
+    int failures;
+    int index;
+    int jndex;
+
+    if (argc < 2)
+    {
+        return output_params();
+    }
+    g_memset(&b, 0, sizeof(b));
+    b.width = 1920;
+    b.height = 1080;
+    frames = 100;
+    threads = 1;
+    capture_code = -1;
+    pattern_name = NULL;
+    if (strcmp(argv[1], "runtest") == 0)
+    {
+        b.width = 640;
+        b.height = 480;
+        frames = 10;
+    }
+    else if (strcmp(argv[1], "run") != 0)
+    {
+        output_params();
+        return 1;
+    }
+    for (index = 2; index < argc; index++)
+    {
+        if (strcmp(argv[index], "-v") == 0)
+        {
+            g_shim_verbose = 1;
+        }
+        else if (index + 1 >= argc)
+        {
+            output_params();
+            return 1;
+        }
+        else if (strcmp(argv[index], "-s") == 0)
+        {
+            index++;
+            if (sscanf(argv[index], "%dx%d", &b.width, &b.height) != 2)
+            {
+                output_params();
+                return 1;
+            }
+        }
+        else if (strcmp(argv[index], "-f") == 0)
+        {
+            frames = atoi(argv[++index]);
+        }
+        else if (strcmp(argv[index], "-t") == 0)
+        {
+            threads = atoi(argv[++index]);
+        }
+        else if (strcmp(argv[index], "-p") == 0)
+        {
+            pattern_name = argv[++index];
+        }
+        else if (strcmp(argv[index], "-c") == 0)
+        {
+            capture_code = atoi(argv[++index]);
+        }
+        else
+        {
+            output_params();
+            return 1;
+        }
+    }
+    if ((b.width < 320) || (b.height < 240) || (b.width > 8192) ||
+        (b.height > 8192) || (frames < 1))
+    {
+        output_params();
+        return 1;
+    }
+    if (threads < 1)
+    {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    b.dev = g_new0(rdpRec, 1);
+    b.clientCon = g_new0(rdpClientCon, 1);
+    b.clientCon->dev = b.dev;
+    b.stride = b.width * 4;
+    b.fb = g_new0(uint8_t, b.stride * b.height);
+    /* room for a whole screen of rfx tiles */
+    b.shm = g_new0(uint8_t, RDPALIGN(b.width, XRDP_RFX_ALIGN) *
+                   RDPALIGN(b.height, XRDP_RFX_ALIGN) * 4);
+    b.dev->width = b.width;
+    b.dev->height = b.height;
+    b.dev->depth = 24;
+    b.dev->paddedWidthInBytes = b.stride;
+    b.dev->pfbMemory = b.fb;
+    g_scrn.driverPrivate = b.dev;
+    rdpSimdInit(NULL, &g_scrn);
+    b.dev->capture_pool = rdpThreadPoolCreate(threads);
+    failures = 0;
+#if defined(CHECK_SIMD_AMD64)
+    failures += check_simd();
+#endif
+
+    printf("screen %dx%d frames %d capture threads %d\n", b.width, b.height,
+           frames, rdpThreadPoolGetNumThreads(b.dev->capture_pool));
+    printf("%-10s %4s  %-8s %6s %10s %10s %9s\n", "pattern", "code",
+           "format", "frames", "Mpixel/s", "ns/tile", "crc skip");
+    for (index = 0; index < NUM_PATTERNS; index++)
+    {
+        if ((pattern_name != NULL) &&
+            (strcmp(pattern_name, g_patterns[index].name) != 0))
+        {
+            continue;
+        }
+        for (jndex = 0; jndex < NUM_FORMATS; jndex++)
+        {
+            if ((capture_code >= 0) &&
+                (capture_code != g_formats[jndex].capture_code))
+            {
+                continue;
+            }
+            bench_run(&b, g_patterns + index, g_formats + jndex, frames,
+                      &result);
+            bench_print_result(g_patterns + index, g_formats + jndex,
+                               &result);
+            failures += result.failures;
+        }
+    }
+
+    b.clientCon->client_info.capture_code = 2;
+    rdpCaptureResetState(b.clientCon);
+    rdpThreadPoolDestroy(b.dev->capture_pool);
+    free(b.shm);
+    free(b.fb);
+    free(b.clientCon);
+    free(b.dev);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+/*
+Copyright 2026 Jay Sorg
+
+Permission to use, copy, modify, distribute, and sell this software and its
+documentation for any purpose is hereby granted without fee, provided that
+the above copyright notice appear in all copies and that both that
+copyright notice and this permission notice appear in supporting
+documentation.
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+OPEN GROUP BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+the few X server functions the capture code links against, so it can run
+outside the X server
+the inline region calls in regionstr.h go straight to pixman, only the
+out of line ones are here
+rdpSimdInit also assigns the Xv colour converters, rdpXv.c needs the whole
+Xv extension so they are stubbed, capture never calls them
+
+*/
+
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+/* this should be before all X11 .h files */
+#include <xorg-server.h>
+#include <xorgVersion.h>
+
+/* all driver need this */
+#include <xf86.h>
+#include <xf86_OSproc.h>
+
+#include <regionstr.h>
+
+#include "rdpXv.h"
+
+#include "xserver_shim.h"
+
+int g_shim_verbose = 0;
+
+BoxRec RegionEmptyBox = { 0, 0, 0, 0 };
+RegDataRec RegionEmptyData = { 0, 0 };
+RegDataRec RegionBrokenData = { 0, 0 };
+
+/*****************************************************************************/
+void
+ErrorF(const char *f, ...)
+{
+    va_list ap;
+
+    if (g_shim_verbose)
+    {
+        va_start(ap, f);
+        vfprintf(stderr, f, ap);
+        va_end(ap);
+    }
+}
+
+/*****************************************************************************/
+static void
+shim_out_of_memory(unsigned long amount)
+{
+    fprintf(stderr, "xserver_shim: out of memory allocating %lu bytes\n",
+            amount);
+    abort();
+}
+
+/*****************************************************************************/
+void *
+XNFalloc(unsigned long amount)
+{
+    void *ptr;
+
+    ptr = malloc(amount);
+    if (ptr == NULL)
+    {
+        shim_out_of_memory(amount);
+    }
+    return ptr;
+}
+
+/*****************************************************************************/
+void *
+XNFcalloc(unsigned long amount)
+{
+    void *ptr;
+
+    ptr = calloc(1, amount);
+    if (ptr == NULL)
+    {
+        shim_out_of_memory(amount);
+    }
+    return ptr;
+}
+
+/*****************************************************************************/
+void *
+XNFrealloc(void *ptr, unsigned long amount)
+{
+    ptr = realloc(ptr, amount);
+    if (ptr == NULL)
+    {
+        shim_out_of_memory(amount);
+    }
+    return ptr;
+}
+
+/*****************************************************************************/
+RegionPtr
+RegionCreate(BoxPtr rect, int size)
+{
+    RegionPtr pReg;
+
+    pReg = (RegionPtr) XNFalloc(sizeof(RegionRec));
+    RegionInit(pReg, rect, size);
+    return pReg;
+}
+
+/*****************************************************************************/
+void
+RegionDestroy(RegionPtr pReg)
+{
+    RegionUninit(pReg);
+    free(pReg);
+}
+
+/*****************************************************************************/
+Bool
+RegionBreak(RegionPtr pReg)
+{
+    RegionUninit(pReg);
+    pReg->extents = RegionEmptyBox;
+    pReg->data = &RegionBrokenData;
+    return FALSE;
+}
+
+/*****************************************************************************/
+/* pixman sorts and bands the boxes itself so ctype does not matter */
+RegionPtr
+RegionFromRects(int nrects, xRectanglePtr prect, int ctype)
+{
+    RegionPtr pReg;
+    BoxPtr boxes;
+    int index;
+
+    pReg = (RegionPtr) XNFalloc(sizeof(RegionRec));
+    if (nrects < 1)
+    {
+        RegionInit(pReg, NullBox, 0);
+        return pReg;
+    }
+    boxes = (BoxPtr) XNFalloc(sizeof(BoxRec) * nrects);
+    for (index = 0; index < nrects; index++)
+    {
+        boxes[index].x1 = prect[index].x;
+        boxes[index].y1 = prect[index].y;
+        boxes[index].x2 = prect[index].x + prect[index].width;
+        boxes[index].y2 = prect[index].y + prect[index].height;
+    }
+    if (!pixman_region_init_rects(pReg, boxes, nrects))
+    {
+        pReg->extents = RegionEmptyBox;
+        pReg->data = &RegionBrokenData;
+    }
+    free(boxes);
+    return pReg;
+}
+
+/*****************************************************************************/
+int
+YV12_to_RGB32(const uint8_t *yuvs, int width, int height, int *rgbs)
+{
+    return 1;
+}
+
+/*****************************************************************************/
+int
+I420_to_RGB32(const uint8_t *yuvs, int width, int height, int *rgbs)
+{
+    return 1;
+}
+
+/*****************************************************************************/
+int
+YUY2_to_RGB32(const uint8_t *yuvs, int width, int height, int *rgbs)
+{
+    return 1;
+}
+
+/*****************************************************************************/
+int
+UYVY_to_RGB32(const uint8_t *yuvs, int width, int height, int *rgbs)
+{
+    return 1;
+}
@@ -61,6 +61,7 @@ This is the main driver file
 #include "rdpClientCon.h"
 #include "rdpXv.h"
 #include "rdpSimd.h"
+#include "rdpThreads.h"
 
 #if defined(XORGXRDP_GLAMOR)
 #include "xrdpdri2.h"
@@ -87,6 +88,29 @@ Bool g_use_dri3 = TRUE;
   while (0)
 
 static int g_setup_done = 0;
+/* shm frame buffers per connection, read from xorg.conf */
+static int g_shm_slots = 1;
+/* capture threads, read from xorg.conf */
+static int g_capture_threads = 1;
+/* dirty tile size, read from xorg.conf */
+static int g_dirty_tile_size = 0;
+/* send screen to screen copies, read from xorg.conf */
+static int g_screen_copies = 0;
+/* capture rate limits, read from xorg.conf */
+static int g_min_fps = 5;
+static int g_max_fps = 60;
+/* share the frame buffer with xrdp, read from xorg.conf */
+static int g_zero_copy = 0;
+/* huge page backed frame buffer and shm, read from xorg.conf */
+static int g_huge_pages = 0;
+/* register shm buffers with xrdp once, read from xorg.conf */
+static int g_shm_register = 0;
+/* one gfx frame for all monitors, read from xorg.conf */
+static int g_monitor_frames = 0;
+/* trace ring size, read from xorg.conf */
+static int g_trace_events = 0;
+/* SIGUSR1 handler, read from xorg.conf */
+static int g_stats_signal = 0;
 static OsTimerPtr g_randr_timer = 0;
 static OsTimerPtr g_damage_timer = 0;
 
@@ -171,6 +195,19 @@ rdpPreInit(ScrnInfoPtr pScrn, int flags)
     dev = XRDPPTR(pScrn);
 
     dev->glamor = FALSE;
+    dev->shm_slots = g_shm_slots;
+    dev->capture_threads = g_capture_threads;
+    dev->dirty_tile_size = g_dirty_tile_size;
+    dev->screen_copies = g_screen_copies;
+    dev->min_fps = g_min_fps;
+    dev->max_fps = g_max_fps;
+    dev->zero_copy = g_zero_copy;
+    dev->huge_pages = g_huge_pages;
+    dev->shm_register = g_shm_register;
+    dev->monitor_frames = g_monitor_frames;
+    dev->trace_events = g_trace_events;
+    dev->stats_signal = g_stats_signal;
+    dev->fb_fd = -1;
 
 #if defined(XORGXRDP_GLAMOR)
     if (getenv("XORGXRDP_DRM_DEVICE") != NULL)
@@ -515,7 +552,10 @@ rdpWakeupHandler1(pointer blockData, int result, pointer pReadmask)
 rdpWakeupHandler1(void *blockData, int result)
 #endif
 {
+#if XORG_VERSION_CURRENT < XORG_VERSION_NUMERIC(1, 18, 5, 0, 0)
+    /* newer servers call rdpClientCon.c for each readable fd */
     rdpClientConCheck((ScreenPtr)blockData);
+#endif
 }
 
 #if defined(XORGXRDP_GLAMOR)
@@ -615,8 +655,7 @@ rdpScreenInit(ScreenPtr pScreen, int argc, char **argv)
     dev->bitsPerPixel = rdpBitsPerPixel(dev->depth);
     dev->sizeInBytes = dev->paddedWidthInBytes * dev->height;
     LLOGLN(0, ("rdpScreenInit: pfbMemory bytes %d", dev->sizeInBytes));
-    dev->pfbMemory_alloc = g_new0(uint8_t, dev->sizeInBytes + 16);
-    dev->pfbMemory = (uint8_t *) RDPALIGN(dev->pfbMemory_alloc, 16);
+    rdpAllocFramebuffer(dev);
     LLOGLN(0, ("rdpScreenInit: pfbMemory %p", dev->pfbMemory));
     if (!fbScreenInit(pScreen, dev->pfbMemory,
                       pScrn->virtualX, pScrn->virtualY,
@@ -936,6 +975,120 @@ rdpProbe(DriverPtr drv, int flags)
             LLOGLN(0, ("rdpProbe: found DRI3 xorg.conf value [%s]", val));
 #endif
         }
+        val = xf86FindOptionValue(dev_sections[i]->options,
+                                  "ShmFrameBuffers");
+        if (val != NULL)
+        {
+            g_shm_slots = RDPCLAMP(atoi(val), 1, XRDP_MAX_SHM_SLOTS);
+            LLOGLN(0, ("rdpProbe: found ShmFrameBuffers xorg.conf value [%s]",
+                   val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options,
+                                  "CaptureThreads");
+        if (val != NULL)
+        {
+            g_capture_threads = RDPCLAMP(atoi(val), 0, RDP_MAX_THREADS);
+            LLOGLN(0, ("rdpProbe: found CaptureThreads xorg.conf value [%s]",
+                   val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options,
+                                  "DirtyTileSize");
+        if (val != NULL)
+        {
+            g_dirty_tile_size = atoi(val);
+            if ((g_dirty_tile_size != 16) && (g_dirty_tile_size != 64))
+            {
+                g_dirty_tile_size = 0;
+            }
+            LLOGLN(0, ("rdpProbe: found DirtyTileSize xorg.conf value [%s]",
+                   val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "ScreenCopies");
+        if (val != NULL)
+        {
+            if ((strcmp(val, "1") == 0) ||
+                (strcmp(val, "yes") == 0) ||
+                (strcmp(val, "true") == 0))
+            {
+                g_screen_copies = 1;
+            }
+            LLOGLN(0, ("rdpProbe: found ScreenCopies xorg.conf value [%s]",
+                   val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "MinFps");
+        if (val != NULL)
+        {
+            g_min_fps = RDPCLAMP(atoi(val), 1, 1000);
+            LLOGLN(0, ("rdpProbe: found MinFps xorg.conf value [%s]", val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "MaxFps");
+        if (val != NULL)
+        {
+            g_max_fps = RDPCLAMP(atoi(val), 1, 1000);
+            LLOGLN(0, ("rdpProbe: found MaxFps xorg.conf value [%s]", val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "ZeroCopy");
+        if (val != NULL)
+        {
+            if ((strcmp(val, "1") == 0) ||
+                (strcmp(val, "yes") == 0) ||
+                (strcmp(val, "true") == 0))
+            {
+                g_zero_copy = 1;
+            }
+            LLOGLN(0, ("rdpProbe: found ZeroCopy xorg.conf value [%s]", val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "HugePages");
+        if (val != NULL)
+        {
+            if ((strcmp(val, "1") == 0) ||
+                (strcmp(val, "yes") == 0) ||
+                (strcmp(val, "true") == 0))
+            {
+                g_huge_pages = 1;
+            }
+            LLOGLN(0, ("rdpProbe: found HugePages xorg.conf value [%s]", val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "ShmRegister");
+        if (val != NULL)
+        {
+            if ((strcmp(val, "1") == 0) ||
+                (strcmp(val, "yes") == 0) ||
+                (strcmp(val, "true") == 0))
+            {
+                g_shm_register = 1;
+            }
+            LLOGLN(0, ("rdpProbe: found ShmRegister xorg.conf value [%s]", val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "MonitorFrames");
+        if (val != NULL)
+        {
+            if ((strcmp(val, "1") == 0) ||
+                (strcmp(val, "yes") == 0) ||
+                (strcmp(val, "true") == 0))
+            {
+                g_monitor_frames = 1;
+            }
+            LLOGLN(0, ("rdpProbe: found MonitorFrames xorg.conf value [%s]",
+                   val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "TraceEvents");
+        if (val != NULL)
+        {
+            g_trace_events = RDPMAX(atoi(val), 0);
+            LLOGLN(0, ("rdpProbe: found TraceEvents xorg.conf value [%s]", val));
+        }
+        val = xf86FindOptionValue(dev_sections[i]->options, "StatsSignal");
+        if (val != NULL)
+        {
+            if ((strcmp(val, "1") == 0) ||
+                (strcmp(val, "yes") == 0) ||
+                (strcmp(val, "true") == 0))
+            {
+                g_stats_signal = 1;
+            }
+            LLOGLN(0, ("rdpProbe: found StatsSignal xorg.conf value [%s]", val));
+        }
         entity = xf86ClaimFbSlot(drv, 0, dev_sections[i], 1);
         pscrn = xf86ConfigFbEntity(pscrn, 0, entity, 0, 0, 0, 0);
         if (pscrn)